@@ -22,70 +22,24 @@ flist_backend_t *libflist_backend_init(flist_db_t *database, char *rootpath) {
 
     backend->database = database;
     backend->rootpath = rootpath;
+    backend->inventory = NULL;
+    backend->compressor = NULL;
 
     return backend;
 }
 
-#if 0
-// FIXME: don't use global variable
-typedef struct flist_backend_t {
-    redisContext *redis;  // redis context
-    int pwrite;           // pending write
-    size_t buflen;        // buffer length
+// take a snapshot of the keys available on the backend, chunks
+// not in the snapshot will be uploaded without asking the backend first
+int libflist_backend_inventory(flist_backend_t *context) {
+    flist_inventory_t *inventory;
 
-} flist_backend_t;
-
-flist_backend_t bcontext = {
-    .redis = NULL,
-    .pwrite = 0,
-    .buflen = 0,
-};
-#endif
-
-#if 0
-static redisContext *backend_connect(flist_backend_t *context, char *hostname, int port) {
-    debug("[+] backend: connecting (%s, %d)\n", hostname, port);
-
-    if(!(context->redis = redisConnect(hostname, port)))
-        diep("redisConnect");
-
-    if(context->redis->err)
-        dies(context->redis->errstr);
-
-    return context->redis;
-}
-
-void upload_free() {
-    if(bcontext.redis)
-        redisFree(bcontext.redis);
-}
-#endif
-
-void upload_flush(flist_backend_t *context) {
-    (void) context;
-#if 0
-    redisReply *reply;
-
-    debug("[+] upload: flushing: %d items (%.2f KB)\n", context->pwrite, context->buflen / 1024.0);
-
-    for(int i = 0; i < context->pwrite; i++) {
-        redisGetReply(context->redis, (void **) &reply);
-
-        if(reply->type == REDIS_REPLY_ERROR) {
-            fprintf(stderr, "[-] redis error: %s\n", reply->str);
-        }
-
-        if(reply->len == 0) {
-            // if 0-db behind
-            // it's a duplicated key
-        }
+    if(!(inventory = libflist_inventory_snapshot(context->database)))
+        return 1;
 
-        freeReplyObject(reply);
-    }
+    libflist_inventory_free(context->inventory);
+    context->inventory = inventory;
 
-    context->pwrite = 0;
-    context->buflen = 0;
-#endif
+    return 0;
 }
 
 int libflist_backend_exists(flist_backend_t *context, flist_chunk_t *chunk) {
@@ -163,10 +117,15 @@ cleanup:
 // check if the chunk is already on the backend
 // if it's not on the backend, uploading it
 int libflist_backend_chunk_commit(flist_backend_t *context, flist_chunk_t *chunk) {
-    // check if chunk is already on the backend
-    if(libflist_backend_exists(context, chunk)) {
-        debug("[+] libflist: backend: chunk already on the backend, skipping\n");
-        return 0;
+    flist_inventory_t *inventory = context->inventory;
+
+    // check if chunk is already on the backend, a chunk
+    // not in the inventory doesn't need to be checked
+    if(!inventory || libflist_inventory_contains(inventory, chunk->id.data, chunk->id.length)) {
+        if(libflist_backend_exists(context, chunk)) {
+            debug("[+] libflist: backend: chunk already on the backend, skipping\n");
+            return 0;
+        }
     }
 
     debug("[+] libflist: backend: uploading chunk (%lu bytes)\n", chunk->encrypted.length);
@@ -177,9 +136,130 @@ int libflist_backend_chunk_commit(flist_backend_t *context, flist_chunk_t *chunk
         return -1;
     }
 
+    if(inventory)
+        libflist_inventory_add(inventory, chunk->id.data, chunk->id.length);
+
     return 1;
 }
 
+// batch version of libflist_backend_chunk_commit, existence of all the
+// chunks is checked at once, then missing chunks are uploaded at once
+// returns the amount of chunks uploaded, -1 on error
+int libflist_backend_chunks_commit(flist_backend_t *context, flist_chunk_t *chunks, size_t count) {
+    flist_inventory_t *inventory = context->inventory;
+    flist_db_t *db = context->database;
+    flist_db_batch_t batch[FLIST_CHUNK_BATCH];
+    flist_db_batch_t *check[FLIST_CHUNK_BATCH];
+    flist_db_batch_t checking[FLIST_CHUNK_BATCH];
+    size_t missing = 0, checks;
+    int uploaded = 0;
+
+    for(size_t offset = 0; offset < count; offset += FLIST_CHUNK_BATCH) {
+        size_t length = (count - offset < FLIST_CHUNK_BATCH) ? count - offset : FLIST_CHUNK_BATCH;
+
+        for(size_t i = 0; i < length; i++) {
+            flist_chunk_t *chunk = &chunks[offset + i];
+
+            batch[i] = (flist_db_batch_t) {
+                .key = chunk->id.data,
+                .keylen = chunk->id.length,
+                .data = chunk->encrypted.data,
+                .datalen = chunk->encrypted.length,
+            };
+        }
+
+        // only chunks probably on the backend (in the inventory)
+        // needs to be checked, others are missing for sure
+        checks = 0;
+
+        for(size_t i = 0; i < length; i++) {
+            if(inventory && !libflist_inventory_contains(inventory, batch[i].key, batch[i].keylen))
+                continue;
+
+            checking[checks] = batch[i];
+            check[checks++] = &batch[i];
+        }
+
+        if(libflist_db_mexists(db, checking, checks)) {
+            debug("[-] libflist: backend: chunks: exists: %s\n", libflist_strerror());
+            return -1;
+        }
+
+        for(size_t i = 0; i < checks; i++)
+            check[i]->exists = checking[i].exists;
+
+        if(inventory)
+            debug("[+] libflist: backend: chunks: %lu/%lu chunks checked (inventory)\n", checks, length);
+
+        // keep only missing chunks, in order
+        missing = 0;
+
+        for(size_t i = 0; i < length; i++)
+            if(!batch[i].exists)
+                batch[missing++] = batch[i];
+
+        debug("[+] libflist: backend: chunks: %lu/%lu chunks to upload\n", missing, length);
+
+        if(libflist_db_mset(db, batch, missing)) {
+            debug("[-] libflist: backend: chunks: upload: %s\n", libflist_strerror());
+            return -1;
+        }
+
+        for(size_t i = 0; i < missing && inventory; i++)
+            libflist_inventory_add(inventory, batch[i].key, batch[i].keylen);
+
+        uploaded += missing;
+    }
+
+    return uploaded;
+}
+
+// count chunks of a file not valid on the backend, checked
+// with one batch (mexists or mcheck)
+static int backend_chunks_count(flist_backend_t *context, inode_chunks_t *chunks, int (*handler)(flist_db_t *, flist_db_batch_t *, size_t)) {
+    flist_db_t *db = context->database;
+    flist_db_batch_t *batch;
+    int invalid = 0;
+
+    if(chunks->size == 0)
+        return 0;
+
+    if(!(batch = calloc(chunks->size, sizeof(flist_db_batch_t)))) {
+        libflist_errp("backend: chunks: calloc");
+        return -1;
+    }
+
+    for(size_t i = 0; i < chunks->size; i++) {
+        batch[i].key = chunks->list[i].entryid;
+        batch[i].keylen = chunks->list[i].entrylen;
+    }
+
+    if(handler(db, batch, chunks->size)) {
+        free(batch);
+        return -1;
+    }
+
+    for(size_t i = 0; i < chunks->size; i++)
+        invalid += (batch[i].exists <= 0);
+
+    free(batch);
+
+    return invalid;
+}
+
+// check that all the chunks of an inode are on the backend, existence
+// is checked with one batch request, returns the amount of missing
+// chunks, -1 on error
+int libflist_backend_chunks_missing(flist_backend_t *context, inode_chunks_t *chunks) {
+    return backend_chunks_count(context, chunks, libflist_db_mexists);
+}
+
+// like missing, but corrupted chunks are counted as well when the
+// backend can verify payloads itself (zdb CHECK), nothing is downloaded
+int libflist_backend_chunks_invalid(flist_backend_t *context, inode_chunks_t *chunks) {
+    return backend_chunks_count(context, chunks, libflist_db_mcheck);
+}
+
 void libflist_backend_chunks_free(flist_chunks_t *chunks) {
     for(size_t i = 0; i < chunks->length; i++)
         libflist_chunk_free(chunks->chunks[i]);
@@ -200,40 +280,66 @@ flist_chunks_t *libflist_backend_upload_inode(flist_backend_t *backend, char *pa
     return chunks;
 }
 
-flist_chunk_t *libflist_backend_download_chunk(flist_backend_t *backend, flist_chunk_t *chunk) {
+// download and decrypt a chunk using a codec
+// plain payload is written into the chunk plain buffer if provided by
+// the caller, otherwise it points to codec memory (valid until next codec call)
+flist_chunk_t *libflist_backend_download_chunk_codec(flist_backend_t *backend, flist_chunk_codec_t *codec, flist_chunk_t *chunk) {
     flist_db_t *db = backend->database;
+    char hexkey[(ZEROCHUNK_HASH_LENGTH * 2) + 1];
     value_t *value;
 
-    if(libflist_debug_flag) {
-        char *key = libflist_hashhex(chunk->id.data, chunk->id.length);
-        debug("[+] backend: downloading chunk: %s\n", key);
-        free(key);
-    }
+    // flist settings come with the backend (see libflist_context_set_backend)
+    flist_compressor_t *compressor = backend->compressor ? backend->compressor : &codec->compressor;
+
+    if(chunk->id.length <= ZEROCHUNK_HASH_LENGTH)
+        debug("[+] backend: downloading chunk: %s\n", libflist_hashhex_buffer(chunk->id.data, chunk->id.length, hexkey));
 
     if(!(value = db->get(db, chunk->id.data, chunk->id.length))) {
         libflist_set_error("key not found on the backend");
         return NULL;
     }
 
-    chunk->encrypted.data = (uint8_t *) value->data;
-    chunk->encrypted.length = value->length;
+    if(!value->data) {
+        libflist_set_error("key not found on the backend");
+        db->clean(value);
+        return NULL;
+    }
 
-    if(!libflist_chunk_decrypt(chunk))
+    // downloaded payload is not needed anymore after decryption
+    // let's decrypt it in place to avoid one copy
+    if(libflist_chunk_codec_decrypt_inplace_with(codec, compressor, (uint8_t *) value->data, value->length, chunk->cipher.data, chunk->cipher.length, &chunk->plain)) {
+        db->clean(value);
         return NULL;
+    }
 
     // clear the downloaded data not needed anymore
-    chunk->encrypted.data = NULL;
-    chunk->encrypted.length = 0;
     db->clean(value);
 
     return chunk;
 }
 
-void upload_inode_flush() {
-    // upload_flush(&bcontext);
+flist_chunk_t *libflist_backend_download_chunk(flist_backend_t *backend, flist_chunk_t *chunk) {
+    flist_chunk_codec_t *codec;
+
+    if(!(codec = libflist_chunk_codec_thread()))
+        return NULL;
+
+    // decrypt into codec memory then keep a copy
+    // owned by the chunk
+    chunk->plain.data = NULL;
+    chunk->plain.length = 0;
+
+    if(!libflist_backend_download_chunk_codec(backend, codec, chunk))
+        return NULL;
+
+    if(!(chunk->plain.data = libflist_bufdup(chunk->plain.data, chunk->plain.length)))
+        return libflist_errp("backend: download: malloc");
+
+    return chunk;
 }
 
 void libflist_backend_free(flist_backend_t *backend) {
+    libflist_inventory_free(backend->inventory);
     backend->database->close(backend->database);
     free(backend);
 }
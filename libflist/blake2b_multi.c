@@ -0,0 +1,245 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <blake2.h>
+#include "blake2b_multi.h"
+
+//
+// multi-buffer blake2b
+//
+// up to 4 independent messages are compressed in lock step, one
+// message per 64 bits lane of an avx2 register, each lane keeps
+// its own chaining value, counter and final flag, so messages of
+// different length can be mixed, when one message is done, the next
+// pending one takes its lane
+//
+// without avx2, each digest is computed by libb2
+//
+static int blake2b_multi_scalar(blake2b_job_t *jobs, size_t count) {
+    for(size_t i = 0; i < count; i++)
+        if(blake2b(jobs[i].hash, jobs[i].data, "", jobs[i].hashlen, jobs[i].length, 0))
+            return 1;
+
+    return 0;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BLAKE2B_MULTI_AVX2 1
+#define BLAKE2B_BLOCK      128
+
+typedef uint64_t b2vec_t __attribute__((vector_size(BLAKE2B_MULTI_LANES * sizeof(uint64_t))));
+
+typedef uint32_t b2vec32_t __attribute__((vector_size(sizeof(b2vec_t))));
+typedef uint8_t b2vec8_t __attribute__((vector_size(sizeof(b2vec_t))));
+
+#ifdef __clang__
+#define B2_SHUFFLE(a, b, ...) __builtin_shufflevector(a, b, __VA_ARGS__)
+#define B2_PERMUTE(type, a, ...) __builtin_shufflevector(a, a, __VA_ARGS__)
+#else
+#define B2_SHUFFLE(a, b, ...) __builtin_shuffle(a, b, (b2vec_t){__VA_ARGS__})
+#define B2_PERMUTE(type, a, ...) __builtin_shuffle(a, (type){__VA_ARGS__})
+#endif
+
+// rotations by a multiple of 8 bits are words or bytes shuffles
+#define B2_ROTR32(x) ((b2vec_t) B2_PERMUTE(b2vec32_t, (b2vec32_t)(x), 1, 0, 3, 2, 5, 4, 7, 6))
+
+#define B2_ROTR24(x) ((b2vec_t) B2_PERMUTE(b2vec8_t, (b2vec8_t)(x), \
+    3, 4, 5, 6, 7, 0, 1, 2, 11, 12, 13, 14, 15, 8, 9, 10, \
+    19, 20, 21, 22, 23, 16, 17, 18, 27, 28, 29, 30, 31, 24, 25, 26))
+
+#define B2_ROTR16(x) ((b2vec_t) B2_PERMUTE(b2vec8_t, (b2vec8_t)(x), \
+    2, 3, 4, 5, 6, 7, 0, 1, 10, 11, 12, 13, 14, 15, 8, 9, \
+    18, 19, 20, 21, 22, 23, 16, 17, 26, 27, 28, 29, 30, 31, 24, 25))
+
+#define B2_ROTR63(x) (((x) >> 63) ^ ((x) + (x)))
+
+#define B2_G(a, b, c, d, x, y) do { \
+    a = a + b + x; d = B2_ROTR32(d ^ a); \
+    c = c + d;     b = B2_ROTR24(b ^ c); \
+    a = a + b + y; d = B2_ROTR16(d ^ a); \
+    c = c + d;     b = B2_ROTR63(b ^ c); \
+} while(0)
+
+static const uint64_t blake2b_iv[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL,
+    0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL,
+    0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static const uint8_t blake2b_sigma[12][16] = {
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+    { 11,  8, 12,  0,  5,  2, 15, 13, 10, 14,  3,  6,  7,  1,  9,  4 },
+    {  7,  9,  3,  1, 13, 12, 11, 14,  2,  6,  5, 10,  4,  0, 15,  8 },
+    {  9,  0,  5,  7,  2,  4, 10, 15, 14,  1, 11, 12,  6,  8,  3, 13 },
+    {  2, 12,  6, 10,  0, 11,  8,  3,  4, 13,  7,  5, 15, 14,  1,  9 },
+    { 12,  5,  1, 15, 14, 13,  4, 10,  0,  7,  6,  3,  9,  2,  8, 11 },
+    { 13, 11,  7, 14, 12,  1,  3,  9,  5,  0, 15,  4,  8,  6,  2, 10 },
+    {  6, 15, 14,  9, 11,  3,  0,  8, 12,  2, 13,  7,  1,  4, 10,  5 },
+    { 10,  2,  8,  4,  7,  6,  1,  5, 15, 11,  9, 14,  3, 12, 13,  0 },
+    {  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15 },
+    { 14, 10,  4,  8,  9, 15, 13,  6,  1, 12,  0,  2, 11,  7,  5,  3 },
+};
+
+typedef struct b2lanes_t {
+    blake2b_job_t *job[BLAKE2B_MULTI_LANES];   // message hashed by the lane (NULL when idle)
+    size_t offset[BLAKE2B_MULTI_LANES];        // amount of bytes already compressed
+    b2vec_t h[8];                              // chaining values
+
+    uint8_t last[BLAKE2B_MULTI_LANES][BLAKE2B_BLOCK];  // zero padded final blocks
+    uint8_t idle[BLAKE2B_BLOCK];                       // block of idle lanes
+
+} b2lanes_t;
+
+static void b2lanes_assign(b2lanes_t *l, int lane, blake2b_job_t *job) {
+    l->job[lane] = job;
+    l->offset[lane] = 0;
+
+    for(int i = 0; i < 8; i++)
+        l->h[i][lane] = blake2b_iv[i];
+
+    // parameter block: digest length, no key, fanout and depth 1
+    if(job)
+        l->h[0][lane] ^= 0x01010000ULL ^ job->hashlen;
+}
+
+static void b2lanes_digest(b2lanes_t *l, int lane) {
+    blake2b_job_t *job = l->job[lane];
+    uint64_t words[8];
+
+    for(int i = 0; i < 8; i++)
+        words[i] = l->h[i][lane];
+
+    // x86 is little endian, words are already serialized
+    memcpy(job->hash, words, job->hashlen);
+}
+
+// compress one block of each lane
+__attribute__((target("avx2"))) static inline void b2lanes_compress(b2lanes_t *l, const uint8_t **blocks, b2vec_t t, b2vec_t f) {
+    b2vec_t m[16], v[16];
+
+    // message words transposition, m[i] contains word i of each lane
+    for(int g = 0; g < 16; g += 4) {
+        b2vec_t r[BLAKE2B_MULTI_LANES], t0, t1, t2, t3;
+
+        for(int lane = 0; lane < BLAKE2B_MULTI_LANES; lane++)
+            memcpy(&r[lane], blocks[lane] + (g * sizeof(uint64_t)), sizeof(b2vec_t));
+
+        t0 = B2_SHUFFLE(r[0], r[1], 0, 4, 2, 6);
+        t1 = B2_SHUFFLE(r[0], r[1], 1, 5, 3, 7);
+        t2 = B2_SHUFFLE(r[2], r[3], 0, 4, 2, 6);
+        t3 = B2_SHUFFLE(r[2], r[3], 1, 5, 3, 7);
+
+        m[g + 0] = B2_SHUFFLE(t0, t2, 0, 1, 4, 5);
+        m[g + 1] = B2_SHUFFLE(t1, t3, 0, 1, 4, 5);
+        m[g + 2] = B2_SHUFFLE(t0, t2, 2, 3, 6, 7);
+        m[g + 3] = B2_SHUFFLE(t1, t3, 2, 3, 6, 7);
+    }
+
+    for(int i = 0; i < 8; i++) {
+        v[i] = l->h[i];
+        v[i + 8] = (b2vec_t) {blake2b_iv[i], blake2b_iv[i], blake2b_iv[i], blake2b_iv[i]};
+    }
+
+    // counter is never larger than 64 bits here
+    v[12] ^= t;
+    v[14] ^= f;
+
+    for(int r = 0; r < 12; r++) {
+        const uint8_t *s = blake2b_sigma[r];
+
+        B2_G(v[0], v[4], v[8],  v[12], m[s[0]],  m[s[1]]);
+        B2_G(v[1], v[5], v[9],  v[13], m[s[2]],  m[s[3]]);
+        B2_G(v[2], v[6], v[10], v[14], m[s[4]],  m[s[5]]);
+        B2_G(v[3], v[7], v[11], v[15], m[s[6]],  m[s[7]]);
+        B2_G(v[0], v[5], v[10], v[15], m[s[8]],  m[s[9]]);
+        B2_G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+        B2_G(v[2], v[7], v[8],  v[13], m[s[12]], m[s[13]]);
+        B2_G(v[3], v[4], v[9],  v[14], m[s[14]], m[s[15]]);
+    }
+
+    for(int i = 0; i < 8; i++)
+        l->h[i] ^= v[i] ^ v[i + 8];
+}
+
+__attribute__((target("avx2"))) static int blake2b_multi_avx2(blake2b_job_t *jobs, size_t count) {
+    b2lanes_t lanes, *l = &lanes;
+    size_t next = 0, active = 0;
+
+    memset(l, 0, sizeof(b2lanes_t));
+
+    for(int lane = 0; lane < BLAKE2B_MULTI_LANES; lane++) {
+        b2lanes_assign(l, lane, next < count ? &jobs[next++] : NULL);
+        active += (l->job[lane] != NULL);
+    }
+
+    while(active) {
+        const uint8_t *blocks[BLAKE2B_MULTI_LANES];
+        int final[BLAKE2B_MULTI_LANES];
+        b2vec_t t, f;
+
+        for(int lane = 0; lane < BLAKE2B_MULTI_LANES; lane++) {
+            blake2b_job_t *job = l->job[lane];
+            size_t remain;
+
+            final[lane] = 0;
+            t[lane] = 0;
+            f[lane] = 0;
+            blocks[lane] = l->idle;
+
+            if(!job)
+                continue;
+
+            remain = job->length - l->offset[lane];
+
+            if(remain > BLAKE2B_BLOCK) {
+                blocks[lane] = job->data + l->offset[lane];
+                t[lane] = l->offset[lane] + BLAKE2B_BLOCK;
+                continue;
+            }
+
+            // last block (empty message still compress one block)
+            memset(l->last[lane], 0, BLAKE2B_BLOCK);
+            if(remain)
+                memcpy(l->last[lane], job->data + l->offset[lane], remain);
+
+            blocks[lane] = l->last[lane];
+            t[lane] = job->length;
+            f[lane] = ~0ULL;
+            final[lane] = 1;
+        }
+
+        b2lanes_compress(l, blocks, t, f);
+
+        for(int lane = 0; lane < BLAKE2B_MULTI_LANES; lane++) {
+            if(!l->job[lane])
+                continue;
+
+            if(!final[lane]) {
+                l->offset[lane] += BLAKE2B_BLOCK;
+                continue;
+            }
+
+            b2lanes_digest(l, lane);
+            b2lanes_assign(l, lane, next < count ? &jobs[next++] : NULL);
+            active -= (l->job[lane] == NULL);
+        }
+    }
+
+    return 0;
+}
+#endif
+
+int blake2b_multi(blake2b_job_t *jobs, size_t count) {
+    for(size_t i = 0; i < count; i++)
+        if(jobs[i].hashlen == 0 || jobs[i].hashlen > 64)
+            return 1;
+
+#ifdef BLAKE2B_MULTI_AVX2
+    if(count > 1 && __builtin_cpu_supports("avx2"))
+        return blake2b_multi_avx2(jobs, count);
+#endif
+
+    return blake2b_multi_scalar(jobs, count);
+}
@@ -0,0 +1,21 @@
+#ifndef LIBFLIST_BLAKE2B_MULTI_H
+    #define LIBFLIST_BLAKE2B_MULTI_H
+
+    #include <stdint.h>
+    #include <stddef.h>
+
+    #define BLAKE2B_MULTI_LANES  4
+
+    // one independent (unkeyed) blake2b digest
+    typedef struct blake2b_job_t {
+        const uint8_t *data;   // input
+        size_t length;         // input length
+        uint8_t *hash;         // digest (caller memory)
+        size_t hashlen;        // digest length (1 to 64 bytes)
+
+    } blake2b_job_t;
+
+    // computes all the digests, same output than libb2 blake2b
+    // returns 0 on success, 1 on failure
+    int blake2b_multi(blake2b_job_t *jobs, size_t count);
+#endif
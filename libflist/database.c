@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+
+//
+// batch operations
+//
+// databases able to send many requests at once (eg: redis pipelining)
+// provide their own batch handlers, otherwise each entry is processed
+// with the single entry handler
+//
+
+int libflist_db_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    if(database->mexists)
+        return database->mexists(database, batch, count);
+
+    for(size_t i = 0; i < count; i++)
+        batch[i].exists = database->exists(database, batch[i].key, batch[i].keylen);
+
+    return 0;
+}
+
+int libflist_db_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    if(database->mset)
+        return database->mset(database, batch, count);
+
+    for(size_t i = 0; i < count; i++)
+        if(database->set(database, batch[i].key, batch[i].keylen, batch[i].data, batch[i].datalen))
+            return 1;
+
+    return 0;
+}
+
+int libflist_db_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    if(database->mget)
+        return database->mget(database, batch, count);
+
+    for(size_t i = 0; i < count; i++) {
+        batch[i].value = database->get(database, batch[i].key, batch[i].keylen);
+
+        // keep the batch semantic: value is only set when found
+        if(batch[i].value && !batch[i].value->data) {
+            database->clean(batch[i].value);
+            batch[i].value = NULL;
+        }
+    }
+
+    return 0;
+}
+
+// existence with server-side integrity verification, databases
+// not able to verify payloads only report existence
+int libflist_db_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    if(database->mcheck)
+        return database->mcheck(database, batch, count);
+
+    return libflist_db_mexists(database, batch, count);
+}
+
+// release values fetched by libflist_db_mget
+void libflist_db_batch_clean(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    for(size_t i = 0; i < count; i++) {
+        if(!batch[i].value)
+            continue;
+
+        database->clean(batch[i].value);
+        batch[i].value = NULL;
+    }
+}
+
+//
+// asynchronous operations
+//
+// databases without event loop complete the operation
+// immediately, callback is called before returning
+//
+int libflist_db_get_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    int status;
+
+    if(database->get_async)
+        return database->get_async(database, entry, callback, userptr);
+
+    status = libflist_db_mget(database, entry, 1);
+    callback(database, entry, status, userptr);
+
+    return 0;
+}
+
+int libflist_db_set_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    int status;
+
+    if(database->set_async)
+        return database->set_async(database, entry, callback, userptr);
+
+    status = database->set(database, entry->key, entry->keylen, entry->data, entry->datalen);
+    callback(database, entry, status, userptr);
+
+    return 0;
+}
+
+int libflist_db_exists_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    if(database->exists_async)
+        return database->exists_async(database, entry, callback, userptr);
+
+    entry->exists = database->exists(database, entry->key, entry->keylen);
+    callback(database, entry, 0, userptr);
+
+    return 0;
+}
+
+int libflist_db_wait(flist_db_t *database) {
+    if(database->wait)
+        return database->wait(database);
+
+    return 0;
+}
+
+// list all the keys, only supported by some databases
+int libflist_db_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    if(!database->scan) {
+        libflist_set_error("database (%s) doesn't support keys listing", database->type);
+        return 1;
+    }
+
+    return database->scan(database, callback, userptr);
+}
+
+// list all the metadata keys, only supported by some databases
+int libflist_db_mdscan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    if(!database->mdscan) {
+        libflist_set_error("database (%s) doesn't support metadata listing", database->type);
+        return 1;
+    }
+
+    return database->mdscan(database, callback, userptr);
+}
+
+//
+// bulk copy
+//
+// every entry (directories, acl) and every metadata of a database are
+// copied into another one (eg: publishing an flist database on a zdb,
+// readers fetch directories remotely without the archive), entries are
+// written by batches (pipelined when the target supports it), metadata
+// are copied last, the flist is complete when metadata are there
+//
+static int database_copy_flush(database_copy_t *copy) {
+    flist_db_batch_t writes[DATABASE_COPY_BATCH];
+    flist_db_batch_t *batch = copy->batch;
+    size_t count = 0;
+
+    if(copy->pending == 0)
+        return 0;
+
+    // databases able to fetch many entries at once are read
+    // here, values of the others were duplicated while listing
+    if(copy->source->mget && libflist_db_mget(copy->source, batch, copy->pending))
+        copy->failed = 1;
+
+    for(size_t i = 0; i < copy->pending && !copy->failed; i++) {
+        writes[count] = batch[i];
+
+        if(batch[i].value) {
+            writes[count].data = (uint8_t *) batch[i].value->data;
+            writes[count].datalen = batch[i].value->length;
+        }
+
+        // entry removed meanwhile
+        if(!writes[count].data)
+            continue;
+
+        copy->summary->bytes += writes[count].datalen;
+        count += 1;
+    }
+
+    if(!copy->failed && libflist_db_mset(copy->target, writes, count))
+        copy->failed = 1;
+
+    if(!copy->failed)
+        copy->summary->entries += count;
+
+    if(copy->source->mget)
+        libflist_db_batch_clean(copy->source, batch, copy->pending);
+
+    for(size_t i = 0; i < copy->pending; i++) {
+        if(!copy->source->mget)
+            free(batch[i].data);
+
+        free(batch[i].key);
+    }
+
+    memset(batch, 0, sizeof(flist_db_batch_t) * copy->pending);
+    copy->pending = 0;
+    copy->bytes = 0;
+
+    return copy->failed;
+}
+
+static int database_copy_entry(uint8_t *key, size_t keylen, void *userptr) {
+    database_copy_t *copy = (database_copy_t *) userptr;
+    flist_db_batch_t *entry = &copy->batch[copy->pending];
+
+    if(!(entry->key = (uint8_t *) libflist_bufdup(key, keylen))) {
+        copy->failed = 1;
+        return 1;
+    }
+
+    entry->keylen = keylen;
+    copy->pending += 1;
+
+    // value returned by get is only valid until the
+    // next call, it needs to be kept for the batch
+    if(!copy->source->mget) {
+        value_t *value = copy->source->get(copy->source, key, keylen);
+
+        if(value && value->data) {
+            if(!(entry->data = libflist_bufdup(value->data, value->length)))
+                copy->failed = 1;
+
+            entry->datalen = value->length;
+            copy->bytes += value->length;
+        }
+
+        if(value)
+            copy->source->clean(value);
+
+        if(copy->failed)
+            return 1;
+    }
+
+    if(copy->pending < DATABASE_COPY_BATCH && copy->bytes < DATABASE_COPY_BYTES)
+        return 0;
+
+    return database_copy_flush(copy);
+}
+
+static int database_copy_metadata(uint8_t *key, size_t keylen, void *userptr) {
+    database_copy_t *copy = (database_copy_t *) userptr;
+    char *name, *value;
+
+    if(!(name = strndup((char *) key, keylen))) {
+        copy->failed = 1;
+        return 1;
+    }
+
+    if((value = libflist_metadata_get(copy->source, name))) {
+        if(!libflist_metadata_set(copy->target, name, value))
+            copy->failed = 1;
+        else
+            copy->summary->metadata += 1;
+    }
+
+    free(name);
+
+    return copy->failed;
+}
+
+int libflist_db_copy(flist_db_t *source, flist_db_t *target, flist_db_copy_t *summary) {
+    flist_db_copy_t unused = {0};
+    database_copy_t *copy;
+    int value = 1;
+
+    // metadata are copied after all the entries, failing early
+    // on databases without metadata (replicated, asynchronous)
+    if(!source->mdget || !target->mdset) {
+        flist_db_t *unsupported = source->mdget ? target : source;
+        libflist_set_error("copy: database (%s) doesn't support metadata", unsupported->type);
+        return 1;
+    }
+
+    if(!(copy = calloc(1, sizeof(database_copy_t)))) {
+        libflist_errp("copy: calloc");
+        return 1;
+    }
+
+    copy->source = source;
+    copy->target = target;
+    copy->summary = summary ? summary : &unused;
+
+    debug("[+] libflist: copy: copying entries (%s -> %s)\n", source->type, target->type);
+
+    if(libflist_db_scan(source, database_copy_entry, copy))
+        goto cleanup;
+
+    if(copy->failed || database_copy_flush(copy))
+        goto cleanup;
+
+    debug("[+] libflist: copy: copying metadata\n");
+
+    if(libflist_db_mdscan(source, database_copy_metadata, copy) || copy->failed)
+        goto cleanup;
+
+    debug("[+] libflist: copy: %lu entries (%lu bytes), %lu metadata\n",
+          copy->summary->entries, copy->summary->bytes, copy->summary->metadata);
+
+    value = 0;
+
+cleanup:
+    // entries not written when the listing failed
+    for(size_t i = 0; i < copy->pending; i++) {
+        if(source->mget)
+            libflist_db_batch_clean(source, &copy->batch[i], 1);
+        else
+            free(copy->batch[i].data);
+
+        free(copy->batch[i].key);
+    }
+
+    free(copy);
+
+    return value;
+}
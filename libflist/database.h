@@ -1,5 +1,20 @@
 #ifndef LIBFLIST_DATABASE_H
     #define LIBFLIST_DATABASE_H
 
-    // nothing yet
+    // entries copied by libflist_db_copy are written by batches of
+    // this amount of keys (or this amount of bytes)
+    #define DATABASE_COPY_BATCH  256
+    #define DATABASE_COPY_BYTES  (8 * 1024 * 1024)
+
+    typedef struct database_copy_t {
+        flist_db_t *source;
+        flist_db_t *target;
+        flist_db_copy_t *summary;
+
+        flist_db_batch_t batch[DATABASE_COPY_BATCH];
+        size_t pending;     // entries on the batch
+        size_t bytes;       // payload length on the batch
+        int failed;
+
+    } database_copy_t;
 #endif
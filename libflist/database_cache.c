@@ -0,0 +1,740 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_cache.h"
+
+//
+// tiered cache database
+//
+// this database keeps a content-addressed copy of objects on the local
+// disk, in front of any other database (usually a remote zdb)
+//
+// each object is stored on a file named by the hex representation of
+// it's key, inside a subdirectory named by the two first hex chars:
+//   <root>/ab/abcdef0123...
+//
+// reads are served locally when possible (read-through), writes are sent
+// to the remote and kept locally (write-through). objects are written
+// to a temporary file then renamed, so concurrent readers (another zflist
+// running on the same cache) never see partial objects
+//
+// access time is updated on each hit and the least recently used objects
+// are evicted when the cache grows over it's size limit
+//
+// instead of the directory, objects can be kept on any other local
+// database (eg: pack database), in that case the local database keeps
+// everything, there is no eviction
+//
+
+// when evicting, we drop objects until the cache
+// is under this percent of the maximum size, to avoid
+// evicting again on the next object
+#define CACHE_EVICT_TARGET   75
+
+static char *database_cache_path(database_cache_t *db, uint8_t *key, size_t keylen) {
+    char *hexkey = libflist_hashhex(key, keylen);
+    char *path;
+
+    if(asprintf(&path, "%s/%.2s/%s", db->root, hexkey, hexkey) < 0) {
+        free(hexkey);
+        return libflist_errp("cache: asprintf");
+    }
+
+    free(hexkey);
+
+    return path;
+}
+
+//
+// eviction
+//
+static int database_cache_entries_append(database_cache_entries_t *entries, char *path, struct stat *sb) {
+    if(entries->length == entries->allocated) {
+        entries->allocated += 1024;
+
+        database_cache_entry_t *list;
+        if(!(list = realloc(entries->list, sizeof(database_cache_entry_t) * entries->allocated)))
+            return 1;
+
+        entries->list = list;
+    }
+
+    database_cache_entry_t *entry = &entries->list[entries->length];
+
+    entry->path = path;
+    entry->size = sb->st_size;
+    entry->access = sb->st_atime;
+
+    entries->length += 1;
+
+    return 0;
+}
+
+static void database_cache_entries_free(database_cache_entries_t *entries) {
+    for(size_t i = 0; i < entries->length; i++)
+        free(entries->list[i].path);
+
+    free(entries->list);
+}
+
+// walk over the cache directory and compute it's size
+// if entries is not NULL, each object found is appended to it
+static size_t database_cache_scan(database_cache_t *db, database_cache_entries_t *entries) {
+    struct dirent *subent, *entry;
+    DIR *root, *subdir;
+    size_t total = 0;
+
+    if(!(root = opendir(db->root)))
+        return 0;
+
+    while((subent = readdir(root))) {
+        // objects subdirectories are always two chars long
+        // this skip '.', '..' and temporary files
+        if(strlen(subent->d_name) != 2)
+            continue;
+
+        char *subpath;
+        if(asprintf(&subpath, "%s/%s", db->root, subent->d_name) < 0)
+            break;
+
+        if(!(subdir = opendir(subpath))) {
+            free(subpath);
+            continue;
+        }
+
+        while((entry = readdir(subdir))) {
+            struct stat sb;
+            char *path;
+
+            if(entry->d_name[0] == '.')
+                continue;
+
+            if(asprintf(&path, "%s/%s", subpath, entry->d_name) < 0)
+                break;
+
+            if(stat(path, &sb) < 0 || !S_ISREG(sb.st_mode)) {
+                free(path);
+                continue;
+            }
+
+            total += sb.st_size;
+
+            if(!entries || database_cache_entries_append(entries, path, &sb))
+                free(path);
+        }
+
+        closedir(subdir);
+        free(subpath);
+    }
+
+    closedir(root);
+
+    return total;
+}
+
+static int database_cache_entries_compare(const void *a, const void *b) {
+    const database_cache_entry_t *ea = (const database_cache_entry_t *) a;
+    const database_cache_entry_t *eb = (const database_cache_entry_t *) b;
+
+    if(ea->access < eb->access)
+        return -1;
+
+    return (ea->access > eb->access);
+}
+
+// drop least recently used objects until the cache
+// fits in the target size
+static void database_cache_evict(database_cache_t *db, size_t incoming) {
+    database_cache_entries_t entries = {
+        .list = NULL,
+        .length = 0,
+        .allocated = 0,
+    };
+
+    size_t target = (db->maxsize / 100) * CACHE_EVICT_TARGET;
+
+    // our size estimation is only based on what we know, another
+    // process could have changed the cache in the meantime, let's
+    // compute the real size before evicting anything
+    db->cursize = database_cache_scan(db, &entries);
+
+    debug("[+] libflist: cache: evicting, current size: %lu bytes, target: %lu bytes\n", db->cursize, target);
+
+    qsort(entries.list, entries.length, sizeof(database_cache_entry_t), database_cache_entries_compare);
+
+    for(size_t i = 0; i < entries.length && db->cursize + incoming > target; i++) {
+        if(unlink(entries.list[i].path) < 0)
+            continue;
+
+        db->cursize -= entries.list[i].size;
+    }
+
+    debug("[+] libflist: cache: size after eviction: %lu bytes\n", db->cursize);
+
+    database_cache_entries_free(&entries);
+}
+
+//
+// local objects
+//
+static uint8_t *database_cache_local_read(database_cache_t *db, uint8_t *key, size_t keylen, size_t *length) {
+    struct timespec times[2] = {
+        {.tv_sec = 0, .tv_nsec = UTIME_NOW},   // update access time
+        {.tv_sec = 0, .tv_nsec = UTIME_OMIT},  // keep modification time
+    };
+    uint8_t *payload = NULL;
+    struct stat sb;
+    int fd;
+
+    char *path = database_cache_path(db, key, keylen);
+    if(!path)
+        return NULL;
+
+    if((fd = open(path, O_RDONLY)) < 0) {
+        free(path);
+        return NULL;
+    }
+
+    free(path);
+
+    if(fstat(fd, &sb) < 0)
+        goto cleanup;
+
+    if(!(payload = malloc(sb.st_size + 1)))
+        goto cleanup;
+
+    size_t offset = 0;
+
+    while(offset < (size_t) sb.st_size) {
+        ssize_t rlen = read(fd, payload + offset, sb.st_size - offset);
+
+        if(rlen <= 0) {
+            free(payload);
+            payload = NULL;
+            goto cleanup;
+        }
+
+        offset += rlen;
+    }
+
+    // keep the payload null terminated, like redis replies
+    payload[offset] = '\0';
+    *length = offset;
+
+    // mark the object as recently used, this is done explicitly
+    // to not rely on filesystem atime settings
+    futimens(fd, times);
+
+cleanup:
+    close(fd);
+    return payload;
+}
+
+static int database_cache_local_write(database_cache_t *db, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    char *path, *subdir, *temp;
+    struct stat sb;
+    int fd;
+
+    if(db->local)
+        return db->local->set(db->local, key, keylen, payload, length);
+
+    // object larger than the whole cache, don't even try
+    if(length > db->maxsize)
+        return 1;
+
+    if(db->cursize + length > db->maxsize)
+        database_cache_evict(db, length);
+
+    if(!(path = database_cache_path(db, key, keylen)))
+        return 1;
+
+    if(asprintf(&temp, "%s/.tmp-XXXXXX", db->root) < 0) {
+        free(path);
+        return 1;
+    }
+
+    if((fd = mkstemp(temp)) < 0) {
+        libflist_warnp(temp);
+        free(temp);
+        free(path);
+        return 1;
+    }
+
+    // mkstemp creates the file private (0600)
+    if(fchmod(fd, DATABASE_CACHE_MODE) < 0) {
+        libflist_warnp("cache: fchmod");
+        close(fd);
+        goto failed;
+    }
+
+    size_t offset = 0;
+
+    while(offset < length) {
+        ssize_t wlen = write(fd, payload + offset, length - offset);
+
+        if(wlen < 0) {
+            libflist_warnp("cache: write");
+            close(fd);
+            goto failed;
+        }
+
+        offset += wlen;
+    }
+
+    close(fd);
+
+    // ensure object subdirectory exists
+    subdir = strdup(path);
+    *strrchr(subdir, '/') = '\0';
+
+    if(mkdir(subdir, 0755) < 0 && errno != EEXIST) {
+        libflist_warnp(subdir);
+        free(subdir);
+        goto failed;
+    }
+
+    free(subdir);
+
+    // an overwritten object is not counted twice
+    if(stat(path, &sb) == 0)
+        db->cursize -= (db->cursize > (size_t) sb.st_size) ? (size_t) sb.st_size : db->cursize;
+
+    // atomically move the object to it's final location
+    if(rename(temp, path) < 0) {
+        libflist_warnp("cache: rename");
+        goto failed;
+    }
+
+    db->cursize += length;
+
+    free(temp);
+    free(path);
+
+    return 0;
+
+failed:
+    unlink(temp);
+    free(temp);
+    free(path);
+
+    return 1;
+}
+
+static void database_cache_local_delete(database_cache_t *db, uint8_t *key, size_t keylen) {
+    struct stat sb;
+    char *path;
+
+    if(db->local) {
+        if(db->local->del)
+            db->local->del(db->local, key, keylen);
+
+        return;
+    }
+
+    if(!(path = database_cache_path(db, key, keylen)))
+        return;
+
+    if(stat(path, &sb) == 0 && unlink(path) == 0)
+        db->cursize -= (db->cursize > (size_t) sb.st_size) ? (size_t) sb.st_size : db->cursize;
+
+    free(path);
+}
+
+//
+// database handlers
+//
+static flist_db_t *database_cache_open(flist_db_t *database) {
+    return database;
+}
+
+static void database_cache_close(flist_db_t *database) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    // the cache owns the remote (and local) database
+    db->remote->close(db->remote);
+
+    if(db->local)
+        db->local->close(db->local);
+
+    free(db->root);
+    free(db);
+    free(database);
+}
+
+static value_t *database_cache_value_new(flist_db_t *remote, value_t *rvalue) {
+    database_cache_value_t *cvalue;
+    value_t *value;
+
+    if(!(value = calloc(1, sizeof(value_t))))
+        return libflist_errp("cache: value: calloc");
+
+    if(!(cvalue = calloc(1, sizeof(database_cache_value_t)))) {
+        free(value);
+        return libflist_errp("cache: value: calloc");
+    }
+
+    cvalue->remote = remote;
+    cvalue->value = rvalue;
+    value->handler = cvalue;
+
+    if(rvalue) {
+        value->data = rvalue->data;
+        value->length = rvalue->length;
+    }
+
+    return value;
+}
+
+// returns the object found locally, or NULL
+static value_t *database_cache_local_get(database_cache_t *db, uint8_t *key, size_t keylen) {
+    value_t *value, *lvalue;
+    uint8_t *payload;
+    size_t length;
+
+    if(db->local) {
+        if(!(lvalue = db->local->get(db->local, key, keylen)))
+            return NULL;
+
+        if(!lvalue->data) {
+            db->local->clean(lvalue);
+            return NULL;
+        }
+
+        if(!(value = database_cache_value_new(db->local, lvalue)))
+            db->local->clean(lvalue);
+
+        return value;
+    }
+
+    if(!(payload = database_cache_local_read(db, key, keylen, &length)))
+        return NULL;
+
+    if(!(value = database_cache_value_new(NULL, NULL))) {
+        free(payload);
+        return NULL;
+    }
+
+    value->data = (char *) payload;
+    value->length = length;
+
+    return value;
+}
+
+static value_t *database_cache_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    value_t *value, *rvalue;
+
+    if((value = database_cache_local_get(db, key, keylen))) {
+        debug("[+] libflist: cache: hit (%lu bytes)\n", value->length);
+        return value;
+    }
+
+    debug("[+] libflist: cache: miss, fetching from remote\n");
+
+    if(!(rvalue = db->remote->get(db->remote, key, keylen)))
+        return NULL;
+
+    if(rvalue->data) {
+        if(database_cache_local_write(db, key, keylen, (uint8_t *) rvalue->data, rvalue->length))
+            debug("[-] libflist: cache: could not keep object locally\n");
+    }
+
+    if(!(value = database_cache_value_new(db->remote, rvalue))) {
+        db->remote->clean(rvalue);
+        return NULL;
+    }
+
+    return value;
+}
+
+static value_t *database_cache_sget(flist_db_t *database, char *key) {
+    return database_cache_get(database, (uint8_t *) key, strlen(key));
+}
+
+static void database_cache_clean(value_t *value) {
+    database_cache_value_t *cvalue = (database_cache_value_t *) value->handler;
+
+    if(cvalue->value)
+        cvalue->remote->clean(cvalue->value);
+    else
+        free(value->data);
+
+    free(cvalue);
+    free(value);
+}
+
+static int database_cache_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    // write-through, remote is the source of truth
+    if(db->remote->set(db->remote, key, keylen, payload, length))
+        return 1;
+
+    if(database_cache_local_write(db, key, keylen, payload, length))
+        debug("[-] libflist: cache: could not keep object locally\n");
+
+    return 0;
+}
+
+static int database_cache_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
+    return database_cache_set(database, (uint8_t *) key, strlen(key), payload, length);
+}
+
+// existence is always asked to the remote, a cached object can be
+// missing on it (another remote, deleted, evicted or lost by the server)
+// and uploads rely on this answer to skip chunks
+static int database_cache_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    return db->remote->exists(db->remote, key, keylen);
+}
+
+static int database_cache_sexists(flist_db_t *database, char *key) {
+    return database_cache_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_cache_del(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    database_cache_local_delete(db, key, keylen);
+
+    if(!db->remote->del) {
+        libflist_set_error("cache: remote database doesn't support deletion");
+        return 1;
+    }
+
+    return db->remote->del(db->remote, key, keylen);
+}
+
+static int database_cache_sdel(flist_db_t *database, char *key) {
+    return database_cache_del(database, (uint8_t *) key, strlen(key));
+}
+
+//
+// batch
+//
+// values found locally are served by the cache, only the missing
+// ones are fetched from the remote, in one batch, existence is
+// always checked on the remote (see database_cache_exists)
+//
+static int database_cache_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    return libflist_db_mexists(db->remote, batch, count);
+}
+
+static int database_cache_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    // write-through, remote is the source of truth
+    if(libflist_db_mset(db->remote, batch, count))
+        return 1;
+
+    for(size_t i = 0; i < count; i++)
+        if(database_cache_local_write(db, batch[i].key, batch[i].keylen, batch[i].data, batch[i].datalen))
+            debug("[-] libflist: cache: could not keep object locally\n");
+
+    return 0;
+}
+
+// verification is always done by the remote, a chunk
+// in the cache can be missing or corrupted on the backend
+static int database_cache_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    return libflist_db_mcheck(db->remote, batch, count);
+}
+
+static int database_cache_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    flist_db_batch_t *remote;
+    size_t *index;
+    size_t missing = 0;
+    int failed = 0;
+
+    if(count == 0)
+        return 0;
+
+    if(!(remote = calloc(count, sizeof(flist_db_batch_t))) || !(index = malloc(count * sizeof(size_t)))) {
+        free(remote);
+        libflist_errp("cache: mget: malloc");
+        return 1;
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        if((batch[i].value = database_cache_local_get(db, batch[i].key, batch[i].keylen)))
+            continue;
+
+        remote[missing].key = batch[i].key;
+        remote[missing].keylen = batch[i].keylen;
+        index[missing] = i;
+        missing += 1;
+    }
+
+    debug("[+] libflist: cache: mget: %lu/%lu entries fetched from remote\n", missing, count);
+
+    failed |= libflist_db_mget(db->remote, remote, missing);
+
+    for(size_t i = 0; i < missing; i++) {
+        value_t *rvalue = remote[i].value;
+        flist_db_batch_t *entry = &batch[index[i]];
+
+        if(!rvalue)
+            continue;
+
+        if(database_cache_local_write(db, entry->key, entry->keylen, (uint8_t *) rvalue->data, rvalue->length))
+            debug("[-] libflist: cache: could not keep object locally\n");
+
+        if(!(entry->value = database_cache_value_new(db->remote, rvalue))) {
+            db->remote->clean(rvalue);
+            failed = 1;
+        }
+    }
+
+    free(remote);
+    free(index);
+
+    return failed;
+}
+
+// local objects are a subset of the remote ones
+static int database_cache_keys(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    return libflist_db_scan(db->remote, callback, userptr);
+}
+
+// metadata are not cached
+static value_t *database_cache_mdget(flist_db_t *database, char *key) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+    value_t *rvalue;
+    value_t *value;
+
+    if(!db->remote->mdget)
+        return libflist_set_error("cache: remote database doesn't support metadata");
+
+    if(!(rvalue = db->remote->mdget(db->remote, key)))
+        return NULL;
+
+    if(!(value = database_cache_value_new(db->remote, rvalue))) {
+        db->remote->clean(rvalue);
+        return NULL;
+    }
+
+    return value;
+}
+
+static int database_cache_mdset(flist_db_t *database, char *key, char *payload) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    if(!db->remote->mdset) {
+        libflist_set_error("cache: remote database doesn't support metadata");
+        return 1;
+    }
+
+    return db->remote->mdset(db->remote, key, payload);
+}
+
+static int database_cache_mddel(flist_db_t *database, char *key) {
+    database_cache_t *db = (database_cache_t *) database->handler;
+
+    if(!db->remote->mddel) {
+        libflist_set_error("cache: remote database doesn't support metadata");
+        return 1;
+    }
+
+    return db->remote->mddel(db->remote, key);
+}
+
+static flist_db_t *database_cache_new(flist_db_t *remote) {
+    flist_db_t *db;
+
+    // allocate generic database object
+    if(!(db = calloc(1, sizeof(flist_db_t))))
+        return libflist_errp("cache: calloc");
+
+    // set our custom cache database handler
+    if(!(db->handler = calloc(1, sizeof(database_cache_t)))) {
+        free(db);
+        return libflist_errp("cache: calloc");
+    }
+
+    database_cache_t *handler = (database_cache_t *) db->handler;
+    handler->remote = remote;
+
+    // setting global db
+    db->type = "CACHE";
+
+    // fillin handlers
+    db->open = database_cache_open;
+    db->create = database_cache_open;
+    db->close = database_cache_close;
+    db->get = database_cache_get;
+    db->set = database_cache_set;
+    db->del = database_cache_del;
+    db->exists = database_cache_exists;
+    db->clean = database_cache_clean;
+    db->sget = database_cache_sget;
+    db->sset = database_cache_sset;
+    db->sdel = database_cache_sdel;
+    db->sexists = database_cache_sexists;
+    db->mdget = database_cache_mdget;
+    db->mdset = database_cache_mdset;
+    db->mddel = database_cache_mddel;
+    db->mexists = database_cache_mexists;
+    db->mset = database_cache_mset;
+    db->mget = database_cache_mget;
+    db->mcheck = database_cache_mcheck;
+    db->scan = database_cache_keys;
+
+    return db;
+}
+
+// public cache function initializer
+flist_db_t *libflist_db_cache_init(flist_db_t *remote, char *rootpath, size_t maxsize) {
+    flist_db_t *db;
+
+    if(mkdir(rootpath, 0755) < 0 && errno != EEXIST)
+        return libflist_errp(rootpath);
+
+    if(!(db = database_cache_new(remote)))
+        return NULL;
+
+    database_cache_t *handler = (database_cache_t *) db->handler;
+
+    handler->maxsize = maxsize;
+
+    if(!(handler->root = strdup(rootpath))) {
+        free(db->handler);
+        free(db);
+        return libflist_errp("cache: strdup");
+    }
+
+    handler->cursize = database_cache_scan(handler, NULL);
+    debug("[+] libflist: cache: %s: %lu / %lu bytes used\n", rootpath, handler->cursize, maxsize);
+
+    return db;
+}
+
+// public cache initializer, using another database as local storage
+// the cache owns both databases
+flist_db_t *libflist_db_cache_local_init(flist_db_t *remote, flist_db_t *local) {
+    flist_db_t *db;
+
+    if(!(db = database_cache_new(remote)))
+        return NULL;
+
+    database_cache_t *handler = (database_cache_t *) db->handler;
+    handler->local = local;
+
+    debug("[+] libflist: cache: using %s database as local storage\n", local->type);
+
+    return db;
+}
@@ -0,0 +1,43 @@
+#ifndef LIBFLIST_DATABASE_CACHE_H
+    #define LIBFLIST_DATABASE_CACHE_H
+
+    #include <time.h>
+
+    // objects are shared by all users of the cache directory
+    #define DATABASE_CACHE_MODE  0644
+
+    // one object found on the local cache directory
+    // only used when looking for objects to evict
+    typedef struct database_cache_entry_t {
+        char *path;       // full path of the object
+        size_t size;      // size of the object on disk
+        time_t access;    // last access time
+
+    } database_cache_entry_t;
+
+    typedef struct database_cache_entries_t {
+        database_cache_entry_t *list;
+        size_t length;
+        size_t allocated;
+
+    } database_cache_entries_t;
+
+    typedef struct database_cache_t {
+        flist_db_t *remote;   // backend behind the cache
+        flist_db_t *local;    // local database, replaces the directory (optional)
+        char *root;           // local cache directory
+
+        size_t maxsize;       // maximum cache size allowed (bytes)
+        size_t cursize;       // current (estimated) cache size (bytes)
+
+    } database_cache_t;
+
+    // value returned by the cache, payload can come from
+    // the local cache or from the remote backend
+    typedef struct database_cache_value_t {
+        flist_db_t *remote;   // database which returned the value (remote or local database)
+        value_t *value;       // value returned (not set for local directory objects)
+
+    } database_cache_value_t;
+
+#endif
@@ -0,0 +1,886 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/file.h>
+#include <pthread.h>
+#include <blake2.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_pack.h"
+
+//
+// pack database
+//
+// local key-value store made of large append-only pack files and one
+// hash index, without any server, mostly used for offline builds or as
+// local cache tier in front of a remote backend
+//
+//   <root>/index          open-addressing hash table (mmap'd)
+//   <root>/pack-00000     records: header, key, payload, null byte
+//   <root>/pack-00001     ...
+//
+// writes are always appended to the last pack file, then the index slot
+// is updated, a process crash can leave unreferenced records on a pack but
+// the index never points to data not written, files are only synced when
+// the database is closed: after a system crash or power loss, recent
+// writes can be lost and the index can point to missing data
+//
+// pack files are mapped read-only for DATABASE_PACK_MAXSIZE bytes, even
+// if they are shorter, entries are returned as a private copy (callers can
+// decrypt them in place), metadata point directly to the mapping and stay
+// valid until the database is closed
+//
+// the directory is locked (flock) against other processes, the lock is
+// held by an open file description, so inside one process a directory is
+// only opened once and the handler is shared (refcounted, serialized by
+// a mutex) between all its users, workers threads included
+//
+// keys are never removed from the pack files (deleted or replaced keys
+// only update the index), there is no compaction
+//
+#define PACK_INDEX_HEADER  64
+
+static uint64_t database_pack_fingerprint(uint8_t type, uint8_t *key, size_t keylen) {
+    uint8_t hash[sizeof(uint64_t)];
+    uint64_t value = 0;
+
+    // metadata keys are hashed differently, they can't collide
+    // with entries using the same key
+    if(type == DATABASE_PACK_METADATA)
+        blake2b(hash, key, "metadata", sizeof(hash), keylen, 8);
+    else
+        blake2b(hash, key, "", sizeof(hash), keylen, 0);
+
+    for(size_t i = 0; i < sizeof(hash); i++)
+        value = (value << 8) | hash[i];
+
+    // zero means empty slot
+    return value ? value : 1;
+}
+
+//
+// pack files
+//
+static char *database_pack_filename(database_pack_t *db, uint32_t id) {
+    char *path;
+
+    if(asprintf(&path, "%s/pack-%05u", db->root, id) < 0)
+        return libflist_errp("pack: asprintf");
+
+    return path;
+}
+
+static int database_pack_file_open(database_pack_t *db, uint32_t id, int create) {
+    database_pack_file_t *pack = &db->packs[id];
+    struct stat sb;
+    char *path;
+
+    if(!(path = database_pack_filename(db, id)))
+        return 1;
+
+    if((pack->fd = open(path, O_RDWR | (create ? O_CREAT | O_TRUNC : 0), 0644)) < 0) {
+        libflist_errp(path);
+        free(path);
+        return 1;
+    }
+
+    free(path);
+
+    if(create && write(pack->fd, DATABASE_PACK_MAGIC, 8) != 8) {
+        libflist_errp("pack: write");
+        close(pack->fd);
+        return 1;
+    }
+
+    if(fstat(pack->fd, &sb) < 0) {
+        libflist_errp("pack: fstat");
+        close(pack->fd);
+        return 1;
+    }
+
+    pack->size = sb.st_size;
+
+    // mapping the full pack size, data appended later
+    // are readable without mapping again
+    pack->map = mmap(NULL, DATABASE_PACK_MAXSIZE, PROT_READ, MAP_SHARED, pack->fd, 0);
+    if(pack->map == MAP_FAILED) {
+        libflist_errp("pack: mmap");
+        close(pack->fd);
+        return 1;
+    }
+
+    return 0;
+}
+
+static database_pack_file_t *database_pack_file_new(database_pack_t *db) {
+    uint32_t id = db->index->packs;
+    database_pack_file_t *packs;
+
+    if(!(packs = realloc(db->packs, sizeof(database_pack_file_t) * (id + 1))))
+        return libflist_errp("pack: realloc");
+
+    db->packs = packs;
+
+    if(database_pack_file_open(db, id, 1))
+        return NULL;
+
+    debug("[+] libflist: pack: new pack file: %u\n", id);
+    db->index->packs += 1;
+
+    return &db->packs[id];
+}
+
+// returns the record pointed by a slot, or NULL
+// if the slot points outside the pack files
+static database_pack_record_t *database_pack_record(database_pack_t *db, database_pack_slot_t *slot) {
+    database_pack_file_t *pack;
+    database_pack_record_t *record;
+
+    if(slot->pack >= db->index->packs)
+        return NULL;
+
+    pack = &db->packs[slot->pack];
+
+    if(slot->offset + sizeof(database_pack_record_t) > pack->size)
+        return NULL;
+
+    record = (database_pack_record_t *) (pack->map + slot->offset);
+
+    if(slot->offset + sizeof(database_pack_record_t) + record->keylen + record->length + 1 > pack->size)
+        return NULL;
+
+    return record;
+}
+
+static inline uint8_t *database_pack_record_key(database_pack_record_t *record) {
+    return (uint8_t *) record + sizeof(database_pack_record_t);
+}
+
+static inline uint8_t *database_pack_record_payload(database_pack_record_t *record) {
+    return database_pack_record_key(record) + record->keylen;
+}
+
+// append one record to the last pack file, sets offset
+// and pack id of the record written
+static int database_pack_append(database_pack_t *db, uint8_t type, uint8_t *key, size_t keylen, uint8_t *payload, size_t length, database_pack_slot_t *target) {
+    database_pack_record_t record = {
+        .length = length,
+        .keylen = keylen,
+        .type = type,
+    };
+    size_t total = sizeof(record) + keylen + length + 1;
+    database_pack_file_t *pack = NULL;
+    uint8_t terminator = '\0';
+
+    if(keylen > UINT16_MAX || length > UINT32_MAX || total + 8 > DATABASE_PACK_MAXSIZE) {
+        libflist_set_error("pack: record too large (%lu bytes)", total);
+        return 1;
+    }
+
+    if(db->index->packs > 0)
+        pack = &db->packs[db->index->packs - 1];
+
+    if(!pack || pack->size + total > DATABASE_PACK_MAXSIZE)
+        if(!(pack = database_pack_file_new(db)))
+            return 1;
+
+    struct iovec iov[4] = {
+        {.iov_base = &record, .iov_len = sizeof(record)},
+        {.iov_base = key, .iov_len = keylen},
+        {.iov_base = payload, .iov_len = length},
+        {.iov_base = &terminator, .iov_len = 1},
+    };
+    struct iovec *vec = iov;
+    int count = 4;
+    size_t offset = pack->size;
+
+    while(count > 0) {
+        ssize_t written = pwritev(pack->fd, vec, count, offset);
+
+        if(written < 0) {
+            if(errno == EINTR)
+                continue;
+
+            libflist_errp("pack: pwritev");
+            return 1;
+        }
+
+        offset += written;
+
+        // skip what was fully written, adjust partial one
+        while(count > 0 && (size_t) written >= vec->iov_len) {
+            written -= vec->iov_len;
+            vec++;
+            count--;
+        }
+
+        if(count > 0) {
+            vec->iov_base = (uint8_t *) vec->iov_base + written;
+            vec->iov_len -= written;
+        }
+    }
+
+    target->offset = pack->size;
+    target->pack = pack - db->packs;
+    target->length = length;
+
+    pack->size += total;
+
+    return 0;
+}
+
+//
+// index
+//
+static int database_pack_index_map(database_pack_t *db) {
+    struct stat sb;
+    void *map;
+
+    if(fstat(db->indexfd, &sb) < 0) {
+        libflist_errp("pack: index: fstat");
+        return 1;
+    }
+
+    if((size_t) sb.st_size < PACK_INDEX_HEADER) {
+        libflist_set_error("pack: index: file truncated");
+        return 1;
+    }
+
+    if((map = mmap(NULL, sb.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, db->indexfd, 0)) == MAP_FAILED) {
+        libflist_errp("pack: index: mmap");
+        return 1;
+    }
+
+    db->index = (database_pack_index_t *) map;
+    db->slots = (database_pack_slot_t *) ((uint8_t *) map + PACK_INDEX_HEADER);
+    db->indexsize = sb.st_size;
+
+    if(memcmp(db->index->magic, DATABASE_PACK_INDEX_MAGIC, 8) != 0) {
+        libflist_set_error("pack: index: invalid file");
+        return 1;
+    }
+
+    if(PACK_INDEX_HEADER + (db->index->slots * sizeof(database_pack_slot_t)) > db->indexsize) {
+        libflist_set_error("pack: index: file truncated");
+        return 1;
+    }
+
+    return 0;
+}
+
+// create an empty index file (with it's header)
+static int database_pack_index_create(char *path, uint64_t slots, uint32_t packs) {
+    database_pack_index_t header = {
+        .slots = slots,
+        .packs = packs,
+    };
+    int fd;
+
+    memcpy(header.magic, DATABASE_PACK_INDEX_MAGIC, 8);
+
+    if((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0) {
+        libflist_errp(path);
+        return -1;
+    }
+
+    if(ftruncate(fd, PACK_INDEX_HEADER + (slots * sizeof(database_pack_slot_t))) < 0) {
+        libflist_errp("pack: index: ftruncate");
+        close(fd);
+        return -1;
+    }
+
+    if(pwrite(fd, &header, sizeof(header), 0) != sizeof(header)) {
+        libflist_errp("pack: index: pwrite");
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+// lookup for an existing key, returns it's slot or NULL
+static database_pack_slot_t *database_pack_lookup(database_pack_t *db, uint8_t type, uint8_t *key, size_t keylen) {
+    uint64_t fingerprint = database_pack_fingerprint(type, key, keylen);
+    uint64_t mask = db->index->slots - 1;
+
+    for(uint64_t i = 0; i < db->index->slots; i++) {
+        database_pack_slot_t *slot = &db->slots[(fingerprint + i) & mask];
+        database_pack_record_t *record;
+
+        if(slot->fingerprint == 0)
+            return NULL;
+
+        if(slot->fingerprint != fingerprint || slot->pack == DATABASE_PACK_DELETED)
+            continue;
+
+        // fingerprint match, confirm with the key itself
+        if(!(record = database_pack_record(db, slot)))
+            continue;
+
+        if(record->type == type && record->keylen == keylen && memcmp(database_pack_record_key(record), key, keylen) == 0)
+            return slot;
+    }
+
+    return NULL;
+}
+
+// first free (empty or deleted) slot for a fingerprint
+static database_pack_slot_t *database_pack_free_slot(database_pack_slot_t *slots, uint64_t length, uint64_t fingerprint) {
+    uint64_t mask = length - 1;
+
+    for(uint64_t i = 0; i < length; i++) {
+        database_pack_slot_t *slot = &slots[(fingerprint + i) & mask];
+
+        if(slot->fingerprint == 0 || slot->pack == DATABASE_PACK_DELETED)
+            return slot;
+    }
+
+    return NULL;
+}
+
+// double the amount of slots, deleted keys are dropped, the new
+// index is built aside then moved over the current one
+static int database_pack_index_grow(database_pack_t *db) {
+    uint64_t slots = db->index->slots * 2;
+    database_pack_t grown = *db;
+    char *path, *temp;
+    int fd;
+
+    debug("[+] libflist: pack: growing index to %lu slots\n", slots);
+
+    if(asprintf(&path, "%s/index", db->root) < 0) {
+        libflist_errp("pack: asprintf");
+        return 1;
+    }
+
+    if(asprintf(&temp, "%s/index.tmp", db->root) < 0) {
+        libflist_errp("pack: asprintf");
+        free(path);
+        return 1;
+    }
+
+    if((fd = database_pack_index_create(temp, slots, db->index->packs)) < 0)
+        goto failed;
+
+    grown.indexfd = fd;
+
+    if(database_pack_index_map(&grown)) {
+        close(fd);
+        goto failed;
+    }
+
+    for(uint64_t i = 0; i < db->index->slots; i++) {
+        database_pack_slot_t *slot = &db->slots[i];
+
+        if(slot->fingerprint == 0 || slot->pack == DATABASE_PACK_DELETED)
+            continue;
+
+        *database_pack_free_slot(grown.slots, slots, slot->fingerprint) = *slot;
+        grown.index->used += 1;
+    }
+
+    grown.index->entries = grown.index->used;
+
+    if(rename(temp, path) < 0) {
+        libflist_errp("pack: index: rename");
+        munmap(grown.index, grown.indexsize);
+        close(fd);
+        goto failed;
+    }
+
+    munmap(db->index, db->indexsize);
+    close(db->indexfd);
+
+    db->indexfd = grown.indexfd;
+    db->index = grown.index;
+    db->slots = grown.slots;
+    db->indexsize = grown.indexsize;
+
+    free(temp);
+    free(path);
+
+    return 0;
+
+failed:
+    unlink(temp);
+    free(temp);
+    free(path);
+
+    return 1;
+}
+
+static int database_pack_insert(database_pack_t *db, uint8_t type, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    database_pack_slot_t *slot, written;
+    database_pack_record_t *record;
+
+    if((slot = database_pack_lookup(db, type, key, keylen))) {
+        // entries are content-addressed, same payload is already there
+        if(slot->length == length && (record = database_pack_record(db, slot)))
+            if(memcmp(database_pack_record_payload(record), payload, length) == 0)
+                return 0;
+    }
+
+    if(!slot && (db->index->used + 1) * 100 > db->index->slots * DATABASE_PACK_LOAD)
+        if(database_pack_index_grow(db))
+            return 1;
+
+    if(database_pack_append(db, type, key, keylen, payload, length, &written))
+        return 1;
+
+    db->updated = 1;
+
+    // replacing existing key, only pointing to the new record
+    if(slot) {
+        slot->offset = written.offset;
+        slot->length = written.length;
+        slot->pack = written.pack;
+        return 0;
+    }
+
+    written.fingerprint = database_pack_fingerprint(type, key, keylen);
+    slot = database_pack_free_slot(db->slots, db->index->slots, written.fingerprint);
+
+    if(slot->fingerprint == 0)
+        db->index->used += 1;
+
+    *slot = written;
+    db->index->entries += 1;
+
+    return 0;
+}
+
+static value_t *database_pack_fetch(database_pack_t *db, uint8_t type, uint8_t *key, size_t keylen) {
+    database_pack_slot_t *slot;
+    value_t *value;
+
+    if(!(value = calloc(1, sizeof(value_t))))
+        return libflist_errp("pack: calloc");
+
+    if(!(slot = database_pack_lookup(db, type, key, keylen)))
+        return value;
+
+    // payload is null terminated on the pack file
+    value->data = (char *) database_pack_record_payload(database_pack_record(db, slot));
+    value->length = slot->length;
+
+    return value;
+}
+
+// private copy of a value, the mapping is read-only
+static value_t *database_pack_copy(value_t *value) {
+    char *payload;
+
+    if(!value || !value->data)
+        return value;
+
+    // including the null terminator
+    if(!(payload = malloc(value->length + 1))) {
+        free(value);
+        return libflist_errp("pack: malloc");
+    }
+
+    memcpy(payload, value->data, value->length + 1);
+    value->data = payload;
+    value->handler = payload;
+
+    return value;
+}
+
+static int database_pack_remove(database_pack_t *db, uint8_t type, uint8_t *key, size_t keylen) {
+    database_pack_slot_t *slot;
+
+    if(!(slot = database_pack_lookup(db, type, key, keylen)))
+        return 0;
+
+    // keeping the fingerprint, probing continue after this slot
+    slot->pack = DATABASE_PACK_DELETED;
+    db->index->entries -= 1;
+    db->updated = 1;
+
+    return 0;
+}
+
+//
+// database handlers
+//
+static flist_db_t *database_pack_open(flist_db_t *database) {
+    return database;
+}
+
+static void database_pack_free(database_pack_t *db) {
+    for(uint32_t i = 0; db->index && i < db->index->packs && db->packs; i++) {
+        if(db->packs[i].map && db->packs[i].map != MAP_FAILED)
+            munmap(db->packs[i].map, DATABASE_PACK_MAXSIZE);
+
+        if(db->packs[i].fd > 0)
+            close(db->packs[i].fd);
+    }
+
+    if(db->index)
+        munmap(db->index, db->indexsize);
+
+    if(db->indexfd > 0)
+        close(db->indexfd);
+
+    if(db->lockfd > 0)
+        close(db->lockfd);
+
+    pthread_mutex_destroy(&db->mutex);
+
+    free(db->packs);
+    free(db->root);
+    free(db);
+}
+
+static void database_pack_flush(database_pack_t *db) {
+    if(db->updated) {
+        debug("[+] libflist: pack: flushing %lu entries\n", db->index->entries);
+
+        for(uint32_t i = 0; i < db->index->packs; i++)
+            fdatasync(db->packs[i].fd);
+
+        msync(db->index, db->indexsize, MS_SYNC);
+    }
+}
+
+// entries are copied, callers own the payload
+static value_t *database_pack_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    value_t *value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_copy(database_pack_fetch(db, DATABASE_PACK_ENTRY, key, keylen));
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static value_t *database_pack_sget(flist_db_t *database, char *key) {
+    return database_pack_get(database, (uint8_t *) key, strlen(key));
+}
+
+// handler is the copied payload, metadata
+// payload belongs to the mapping
+static void database_pack_clean(value_t *value) {
+    free(value->handler);
+    free(value);
+}
+
+static int database_pack_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    int value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_insert(db, DATABASE_PACK_ENTRY, key, keylen, payload, length);
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
+    return database_pack_set(database, (uint8_t *) key, strlen(key), payload, length);
+}
+
+static int database_pack_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    int value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = (database_pack_lookup(db, DATABASE_PACK_ENTRY, key, keylen) != NULL);
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_sexists(flist_db_t *database, char *key) {
+    return database_pack_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_pack_del(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    int value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_remove(db, DATABASE_PACK_ENTRY, key, keylen);
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_sdel(flist_db_t *database, char *key) {
+    return database_pack_del(database, (uint8_t *) key, strlen(key));
+}
+
+//
+// metadata
+//
+static value_t *database_pack_mdget(flist_db_t *database, char *key) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    value_t *value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_fetch(db, DATABASE_PACK_METADATA, (uint8_t *) key, strlen(key));
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_mdset(flist_db_t *database, char *key, char *payload) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    int value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_insert(db, DATABASE_PACK_METADATA, (uint8_t *) key, strlen(key), (uint8_t *) payload, strlen(payload));
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_mddel(flist_db_t *database, char *key) {
+    database_pack_t *db = (database_pack_t *) database->handler;
+    int value;
+
+    pthread_mutex_lock(&db->mutex);
+    value = database_pack_remove(db, DATABASE_PACK_METADATA, (uint8_t *) key, strlen(key));
+    pthread_mutex_unlock(&db->mutex);
+
+    return value;
+}
+
+static int database_pack_scan_type(database_pack_t *db, uint8_t type, flist_db_scan_t callback, void *userptr) {
+    int value = 0;
+
+    pthread_mutex_lock(&db->mutex);
+
+    for(uint64_t i = 0; i < db->index->slots && !value; i++) {
+        database_pack_slot_t *slot = &db->slots[i];
+        database_pack_record_t *record;
+
+        if(slot->fingerprint == 0 || slot->pack == DATABASE_PACK_DELETED)
+            continue;
+
+        if(!(record = database_pack_record(db, slot)) || record->type != type)
+            continue;
+
+        value = callback(database_pack_record_key(record), record->keylen, userptr);
+    }
+
+    pthread_mutex_unlock(&db->mutex);
+
+    return (value != 0);
+}
+
+static int database_pack_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    return database_pack_scan_type(database->handler, DATABASE_PACK_ENTRY, callback, userptr);
+}
+
+static int database_pack_mdscan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    return database_pack_scan_type(database->handler, DATABASE_PACK_METADATA, callback, userptr);
+}
+
+static database_pack_t *database_pack_load(char *rootpath) {
+    pthread_mutexattr_t attr;
+    database_pack_t *db;
+    char *path;
+
+    if(!(db = calloc(1, sizeof(database_pack_t))))
+        return libflist_errp("pack: calloc");
+
+    db->lockfd = db->indexfd = -1;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&db->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    if(!(db->root = strdup(rootpath))) {
+        pthread_mutex_destroy(&db->mutex);
+        free(db);
+        return libflist_errp("pack: strdup");
+    }
+
+    // only one process can use the pack directory,
+    // index and pack files are not shared
+    if(asprintf(&path, "%s/lock", rootpath) < 0) {
+        libflist_errp("pack: asprintf");
+        goto failed;
+    }
+
+    if((db->lockfd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+        libflist_errp(path);
+        free(path);
+        goto failed;
+    }
+
+    free(path);
+
+    if(flock(db->lockfd, LOCK_EX | LOCK_NB) < 0) {
+        libflist_set_error("pack: %s: already used by another process", rootpath);
+        goto failed;
+    }
+
+    if(asprintf(&path, "%s/index", rootpath) < 0) {
+        libflist_errp("pack: asprintf");
+        goto failed;
+    }
+
+    if((db->indexfd = open(path, O_RDWR)) < 0) {
+        if(errno != ENOENT) {
+            libflist_errp(path);
+            free(path);
+            goto failed;
+        }
+
+        debug("[+] libflist: pack: creating new index\n");
+        db->indexfd = database_pack_index_create(path, DATABASE_PACK_SLOTS, 0);
+    }
+
+    free(path);
+
+    if(db->indexfd < 0 || database_pack_index_map(db))
+        goto failed;
+
+    if(db->index->packs > 0) {
+        if(!(db->packs = calloc(db->index->packs, sizeof(database_pack_file_t)))) {
+            libflist_errp("pack: calloc");
+            goto failed;
+        }
+
+        for(uint32_t i = 0; i < db->index->packs; i++) {
+            if(database_pack_file_open(db, i, 0)) {
+                db->packs[i].fd = -1;
+                db->packs[i].map = NULL;
+                goto failed;
+            }
+        }
+    }
+
+    return db;
+
+failed:
+    database_pack_free(db);
+    return NULL;
+}
+
+//
+// pack directories opened by this process
+//
+static database_pack_t *database_pack_opened = NULL;
+static pthread_mutex_t database_pack_registry = PTHREAD_MUTEX_INITIALIZER;
+
+// returns the handler of a directory, opening it only
+// if not already opened by this process
+static database_pack_t *database_pack_acquire(char *rootpath) {
+    database_pack_t *db;
+    struct stat sb;
+
+    if(mkdir(rootpath, 0755) < 0 && errno != EEXIST)
+        return libflist_errp(rootpath);
+
+    if(stat(rootpath, &sb) < 0)
+        return libflist_errp(rootpath);
+
+    for(db = database_pack_opened; db; db = db->next) {
+        if(db->device == sb.st_dev && db->inode == sb.st_ino) {
+            debug("[+] libflist: pack: %s: already opened, sharing it\n", rootpath);
+            db->refcount += 1;
+            return db;
+        }
+    }
+
+    if(!(db = database_pack_load(rootpath)))
+        return NULL;
+
+    debug("[+] libflist: pack: %s: %lu entries, %u pack files\n", rootpath, db->index->entries, db->index->packs);
+
+    db->device = sb.st_dev;
+    db->inode = sb.st_ino;
+    db->refcount = 1;
+    db->next = database_pack_opened;
+    database_pack_opened = db;
+
+    return db;
+}
+
+// files are flushed and closed when the last user releases the handler
+static void database_pack_release(database_pack_t *db) {
+    database_pack_t **entry;
+
+    pthread_mutex_lock(&database_pack_registry);
+
+    if(--db->refcount > 0) {
+        pthread_mutex_unlock(&database_pack_registry);
+        return;
+    }
+
+    for(entry = &database_pack_opened; *entry; entry = &(*entry)->next) {
+        if(*entry == db) {
+            *entry = db->next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&database_pack_registry);
+
+    database_pack_flush(db);
+    database_pack_free(db);
+}
+
+static void database_pack_close(flist_db_t *database) {
+    database_pack_release(database->handler);
+    free(database);
+}
+
+// public pack function initializer, initializing the same directory
+// more than once (eg: one database per worker) shares the same files
+flist_db_t *libflist_db_pack_init(char *rootpath) {
+    database_pack_t *handler;
+    flist_db_t *db;
+
+    pthread_mutex_lock(&database_pack_registry);
+    handler = database_pack_acquire(rootpath);
+    pthread_mutex_unlock(&database_pack_registry);
+
+    if(!handler)
+        return NULL;
+
+    // allocate generic database object
+    if(!(db = calloc(1, sizeof(flist_db_t)))) {
+        database_pack_release(handler);
+        return libflist_errp("pack: calloc");
+    }
+
+    db->handler = handler;
+    db->type = "PACK";
+
+    // fillin handlers
+    db->open = database_pack_open;
+    db->create = database_pack_open;
+    db->close = database_pack_close;
+    db->get = database_pack_get;
+    db->set = database_pack_set;
+    db->del = database_pack_del;
+    db->exists = database_pack_exists;
+    db->clean = database_pack_clean;
+    db->sget = database_pack_sget;
+    db->sset = database_pack_sset;
+    db->sdel = database_pack_sdel;
+    db->sexists = database_pack_sexists;
+    db->mdget = database_pack_mdget;
+    db->mdset = database_pack_mdset;
+    db->mddel = database_pack_mddel;
+    db->scan = database_pack_scan;
+    db->mdscan = database_pack_mdscan;
+
+    return db;
+}
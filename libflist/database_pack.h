@@ -0,0 +1,85 @@
+#ifndef LIBFLIST_DATABASE_PACK_H
+    #define LIBFLIST_DATABASE_PACK_H
+
+    #include <sys/types.h>
+    #include <pthread.h>
+
+    #define DATABASE_PACK_MAGIC        "FLPACK01"
+    #define DATABASE_PACK_INDEX_MAGIC  "FLINDX01"
+
+    // pack files are never larger than this size, a new
+    // pack file is started when the current one is full
+    #define DATABASE_PACK_MAXSIZE      (1024UL * 1024 * 1024)
+
+    // initial amount of index slots (power of two), the index
+    // is doubled when more than DATABASE_PACK_LOAD percent are used
+    #define DATABASE_PACK_SLOTS        65536
+    #define DATABASE_PACK_LOAD         70
+
+    // records types, entries and metadata keys are distinct
+    #define DATABASE_PACK_ENTRY        0
+    #define DATABASE_PACK_METADATA     1
+
+    // slot pack id of a deleted key (tombstone)
+    #define DATABASE_PACK_DELETED      UINT32_MAX
+
+    // on disk, in front of each record, followed by
+    // the key, the payload and a null byte
+    typedef struct database_pack_record_t {
+        uint32_t length;        // payload length
+        uint16_t keylen;        // key length
+        uint8_t type;           // entry or metadata
+        uint8_t reserved;
+
+    } database_pack_record_t;
+
+    // on disk, one index slot
+    typedef struct database_pack_slot_t {
+        uint64_t fingerprint;   // key hash, 0 if the slot is empty
+        uint64_t offset;        // record offset on the pack file
+        uint32_t pack;          // pack file id
+        uint32_t length;        // payload length
+
+    } database_pack_slot_t;
+
+    // on disk, index file header, followed by the slots
+    typedef struct database_pack_index_t {
+        char magic[8];
+        uint64_t slots;         // amount of slots
+        uint64_t used;          // slots used (including deleted keys)
+        uint64_t entries;       // keys available
+        uint32_t packs;         // amount of pack files
+        uint32_t reserved;
+
+    } database_pack_index_t;
+
+    typedef struct database_pack_file_t {
+        int fd;
+        uint8_t *map;           // read-only mapping (DATABASE_PACK_MAXSIZE long)
+        size_t size;            // pack file length
+
+    } database_pack_file_t;
+
+    typedef struct database_pack_t {
+        char *root;             // pack directory
+        int lockfd;             // exclusive lock, one process at a time
+
+        // a directory is opened once per process, all
+        // users share the same handler (see libflist_db_pack_init)
+        dev_t device;
+        ino_t inode;
+        size_t refcount;
+        pthread_mutex_t mutex;  // recursive, scan callbacks can use the database
+        struct database_pack_t *next;
+
+        int indexfd;
+        database_pack_index_t *index;
+        database_pack_slot_t *slots;
+        size_t indexsize;       // index file (and mapping) length
+
+        database_pack_file_t *packs;
+        int updated;
+
+    } database_pack_t;
+
+#endif
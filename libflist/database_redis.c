@@ -4,16 +4,26 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <unistd.h>
+#include <errno.h>
+#include <sys/uio.h>
 #include <hiredis/hiredis.h>
 #include "libflist.h"
 #include "verbose.h"
 #include "database.h"
 #include "database_redis.h"
+#include "database_redis_async.h"
 
 static void database_redis_close(flist_db_t *database) {
     database_redis_t *db = (database_redis_t *) database->handler;
     redisFree(db->redis);
 
+    for(size_t i = 0; i < db->pooled; i++) {
+        free(db->pool[i]->value.data);
+        free(db->pool[i]);
+    }
+
+    free(db->metadata);
+    free(db->namespace);
     free(database->handler);
     free(database);
 }
@@ -24,99 +34,441 @@ static flist_db_t *database_redis_dummy(flist_db_t *database) {
 }
 
 //
-// GET
+// commands
 //
-static redisReply *database_redis_get_real(flist_db_t *database, uint8_t *key, size_t keylen) {
-    database_redis_t *db = (database_redis_t *) database->handler;
-    return redisCommand(db->redis, "HGET %s %b", db->namespace, key, keylen);
+static const char *database_redis_commands[][3] = {
+    // zero-db, redis-compatible (plain keys), redis-compatible (namespace hash)
+    [REDIS_COMMAND_GET] = {"GET", "GET", "HGET"},
+    [REDIS_COMMAND_SET] = {"SET", "SET", "HSET"},
+    [REDIS_COMMAND_EXISTS] = {"EXISTS", "EXISTS", "HEXISTS"},
+    [REDIS_COMMAND_DEL] = {"DEL", "DEL", "HDEL"},
+
+    // zero-db verifies the payload checksum, redis only
+    // knows about existence
+    [REDIS_COMMAND_CHECK] = {"CHECK", "EXISTS", "HEXISTS"},
+};
+
+// build command arguments (argv needs room for DATABASE_REDIS_ARGV entries)
+// returns the amount of arguments, payload is only used by set
+int database_redis_argv(database_redis_mode_t mode, char *namespace, database_redis_command_t command, uint8_t *key, size_t keylen, uint8_t *payload, size_t length, const char **argv, size_t *argvlen) {
+    int argc = 0;
+
+    argv[argc] = database_redis_commands[command][mode];
+    argvlen[argc++] = strlen(argv[0]);
+
+    if(mode == REDIS_MODE_HASH) {
+        argv[argc] = namespace;
+        argvlen[argc++] = strlen(namespace);
+    }
+
+    argv[argc] = (const char *) key;
+    argvlen[argc++] = keylen;
+
+    if(payload) {
+        argv[argc] = (const char *) payload;
+        argvlen[argc++] = length;
+    }
+
+    return argc;
 }
 
-static redisReply *database_redis_get_zdb(flist_db_t *database, uint8_t *key, size_t keylen) {
-    database_redis_t *db = (database_redis_t *) database->handler;
-    return redisCommand(db->redis, "GET %b", key, keylen);
+//
+// zero-copy payload transfer
+//
+// large payloads are written straight from the caller buffer with writev
+// (command header, payload, trailer) instead of being copied into hiredis
+// output buffer, values replies (GET) are parsed here and payload are read
+// directly into pooled buffers, instead of being copied by hiredis reader
+// into a new reply object
+//
+// every GET reply is read by this parser and every other reply by hiredis,
+// replies are always fully read before sending another kind of command,
+// so both readers never share bytes of the stream
+//
+static int database_redis_broken(database_redis_t *db, const char *message) {
+    // stream is not synchronized anymore, further
+    // hiredis calls on this connection will fail
+    db->redis->err = REDIS_ERR_PROTOCOL;
+    snprintf(db->redis->errstr, sizeof(db->redis->errstr), "%s", message);
+
+    libflist_set_error("redis: %s", message);
+
+    return 1;
 }
 
-static value_t *database_redis_get(flist_db_t *database, uint8_t *key, size_t keylen) {
-    database_redis_t *db = (database_redis_t *) database->handler;
-    redisReply *reply;
-    value_t *value = NULL;
+// send commands queued on hiredis output buffer
+static int database_redis_flush(database_redis_t *db) {
+    int done = 0;
 
-    if(!(value = calloc(1, sizeof(value_t)))) {
-        diep("malloc");
-        return NULL;
+    while(!done) {
+        if(redisBufferWrite(db->redis, &done) != REDIS_OK) {
+            libflist_set_error("redis: %s", db->redis->errstr);
+            return 1;
+        }
     }
 
-    if(!(reply = db->internal_get(database, key, keylen))) {
-       free(value);
-       return NULL;
+    return 0;
+}
+
+static int database_redis_writev(database_redis_t *db, struct iovec *iov, int iovcnt) {
+    while(iovcnt > 0) {
+        ssize_t sent = writev(db->redis->fd, iov, iovcnt);
+
+        if(sent < 0) {
+            if(errno == EINTR)
+                continue;
+
+            return database_redis_broken(db, strerror(errno));
+        }
+
+        // skip what was fully sent, adjust partially sent vector
+        while(iovcnt > 0 && (size_t) sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov += 1;
+            iovcnt -= 1;
+        }
+
+        if(iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
     }
 
-    if(reply->type != REDIS_REPLY_STRING) {
-        freeReplyObject(reply);
-        return NULL;
+    return 0;
+}
+
+// send a command with it's payload, only arguments
+// are formatted, payload is sent from the caller buffer
+static int database_redis_send_payload(database_redis_t *db, const char **argv, size_t *argvlen, int argc) {
+    char header[512];
+    size_t offset;
+
+    offset = snprintf(header, sizeof(header), "*%d\r\n", argc);
+
+    for(int i = 0; i < argc; i++) {
+        // header doesn't fit, let hiredis format the command
+        if(offset + argvlen[i] + 32 > sizeof(header) && i < argc - 1)
+            return -1;
+
+        offset += snprintf(header + offset, sizeof(header) - offset, "$%lu\r\n", argvlen[i]);
+
+        // payload (last argument) is not copied
+        if(i == argc - 1)
+            break;
+
+        memcpy(header + offset, argv[i], argvlen[i]);
+        memcpy(header + offset + argvlen[i], "\r\n", 2);
+        offset += argvlen[i] + 2;
     }
 
-    value->data = reply->str;
-    value->length = reply->len;
-    value->handler = reply;
+    struct iovec iov[3] = {
+        {.iov_base = header, .iov_len = offset},
+        {.iov_base = (void *) argv[argc - 1], .iov_len = argvlen[argc - 1]},
+        {.iov_base = "\r\n", .iov_len = 2},
+    };
 
-    return value;
+    // commands queued before needs to be sent first
+    if(database_redis_flush(db))
+        return 1;
+
+    return database_redis_writev(db, iov, 3);
 }
 
-static value_t *database_redis_sget(flist_db_t *database, char *key) {
-    return database_redis_get(database, (uint8_t *) key, strlen(key));
+// read more bytes from the server, keeping unread bytes
+static int database_redis_readahead(database_redis_t *db) {
+    ssize_t rlen;
+
+    if(db->rapos > 0) {
+        memmove(db->readahead, db->readahead + db->rapos, db->ralen - db->rapos);
+        db->ralen -= db->rapos;
+        db->rapos = 0;
+    }
+
+    if(db->ralen == sizeof(db->readahead))
+        return database_redis_broken(db, "reply header too long");
+
+    while((rlen = read(db->redis->fd, db->readahead + db->ralen, sizeof(db->readahead) - db->ralen)) < 0)
+        if(errno != EINTR)
+            return database_redis_broken(db, strerror(errno));
+
+    if(rlen == 0)
+        return database_redis_broken(db, "connection closed by server");
+
+    db->ralen += rlen;
+
+    return 0;
+}
+
+// read exactly length bytes, unread bytes first
+static int database_redis_read(database_redis_t *db, char *target, size_t length) {
+    size_t offset = db->ralen - db->rapos;
+
+    if(offset > length)
+        offset = length;
+
+    memcpy(target, db->readahead + db->rapos, offset);
+    db->rapos += offset;
+
+    while(offset < length) {
+        ssize_t rlen = read(db->redis->fd, target + offset, length - offset);
+
+        if(rlen < 0 && errno == EINTR)
+            continue;
+
+        if(rlen < 0)
+            return database_redis_broken(db, strerror(errno));
+
+        if(rlen == 0)
+            return database_redis_broken(db, "connection closed by server");
+
+        offset += rlen;
+    }
+
+    return 0;
+}
+
+// read one reply line, line is valid until next read
+static char *database_redis_line(database_redis_t *db) {
+    char *line, *end;
+
+    while(!(end = memmem(db->readahead + db->rapos, db->ralen - db->rapos, "\r\n", 2)))
+        if(database_redis_readahead(db))
+            return NULL;
+
+    line = db->readahead + db->rapos;
+    *end = '\0';
+    db->rapos = (end + 2) - db->readahead;
+
+    return line;
 }
 
 //
-// SET
+// values buffers pool
 //
-static redisReply *database_redis_set_real(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
-    database_redis_t *db = (database_redis_t *) database->handler;
-    redisReply *reply;
+static database_redis_buffer_t *database_redis_buffer_get(database_redis_t *db, size_t size) {
+    database_redis_buffer_t *buffer;
+    char *data;
 
-    // we are on a real redis backend
-    if(!(reply = redisCommand(db->redis, "HSET %s %b %b", db->namespace, key, keylen, payload, length)))
+    // most recently released buffer first
+    if(db->pooled > 0) {
+        buffer = db->pool[--db->pooled];
+
+    } else {
+        if(!(buffer = calloc(1, sizeof(database_redis_buffer_t))))
+            return libflist_errp("redis: buffer: calloc");
+
+        buffer->db = db;
+        buffer->value.handler = buffer;
+    }
+
+    if(buffer->size < size) {
+        if(!(data = realloc(buffer->value.data, size))) {
+            free(buffer->value.data);
+            free(buffer);
+            return libflist_errp("redis: buffer: realloc");
+        }
+
+        buffer->value.data = data;
+        buffer->size = size;
+    }
+
+    return buffer;
+}
+
+static void database_redis_buffer_release(database_redis_buffer_t *buffer) {
+    database_redis_t *db = buffer->db;
+
+    if(db->pooled < DATABASE_REDIS_POOL && buffer->size <= DATABASE_REDIS_POOL_MAXSIZE) {
+        buffer->value.length = 0;
+        db->pool[db->pooled++] = buffer;
+        return;
+    }
+
+    free(buffer->value.data);
+    free(buffer);
+}
+
+// read one GET reply, an empty value (no data) is
+// returned when the key doesn't exists
+static value_t *database_redis_read_value(database_redis_t *db) {
+    database_redis_buffer_t *buffer;
+    long long length;
+    value_t *value;
+    char *line;
+
+    if(!(line = database_redis_line(db)))
         return NULL;
 
-    if(reply->type == REDIS_REPLY_ERROR) {
-        libflist_set_error("redis: set: %s", reply->str);
-        freeReplyObject(reply);
+    if(line[0] != '$') {
+        if(line[0] != '-') {
+            database_redis_broken(db, "unexpected value reply");
+            return NULL;
+        }
+
+        // error reply (eg: namespace not readable) is
+        // handled like previous versions, as not found
+        debug("[-] libflist: redis: get: %s\n", line + 1);
+        length = -1;
+
+    } else {
+        length = strtoll(line + 1, NULL, 10);
+    }
+
+    // key not found, keep an empty value
+    if(length < 0) {
+        if(!(value = calloc(1, sizeof(value_t))))
+            return libflist_errp("redis: value: calloc");
+
+        return value;
+    }
+
+    // payload trailer is read into the buffer aswell
+    if(!(buffer = database_redis_buffer_get(db, length + 2)))
+        return NULL;
+
+    if(database_redis_read(db, buffer->value.data, length + 2)) {
+        database_redis_buffer_release(buffer);
         return NULL;
     }
 
-    return reply;
+    if(memcmp(buffer->value.data + length, "\r\n", 2)) {
+        database_redis_buffer_release(buffer);
+        database_redis_broken(db, "invalid value trailer");
+        return NULL;
+    }
+
+    // keep the payload null terminated, like hiredis replies
+    buffer->value.data[length] = '\0';
+    buffer->value.length = length;
+
+    return &buffer->value;
 }
 
-static redisReply *database_redis_set_zdb(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
-    database_redis_t *db = (database_redis_t *) database->handler;
+// queue one command on the output buffer, nothing is sent to the
+// server until a reply is requested, except large payload which
+// are sent immediately (after queued commands) without copy
+static int database_redis_append(database_redis_t *db, database_redis_command_t command, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    const char *argv[DATABASE_REDIS_ARGV];
+    size_t argvlen[DATABASE_REDIS_ARGV];
+    int argc, value;
+
+    argc = database_redis_argv(db->mode, db->namespace, command, key, keylen, payload, length, argv, argvlen);
+
+    if(payload && length >= DATABASE_REDIS_ZEROCOPY_MIN)
+        if((value = database_redis_send_payload(db, argv, argvlen, argc)) >= 0)
+            return value;
+
+    if(redisAppendCommandArgv(db->redis, argc, argv, argvlen) != REDIS_OK) {
+        libflist_set_error("redis: %s", db->redis->errstr);
+        return 1;
+    }
+
+    return 0;
+}
+
+static redisReply *database_redis_reply(database_redis_t *db) {
     redisReply *reply;
 
-    // we are on zero-db
-    if(!(reply = redisCommand(db->redis, "SET %b %b", key, keylen, payload, length)))
+    if(redisGetReply(db->redis, (void **) &reply) != REDIS_OK) {
+        libflist_set_error("redis: %s", db->redis->errstr);
         return NULL;
+    }
 
+    return reply;
+}
+
+static redisReply *database_redis_command(database_redis_t *db, database_redis_command_t command, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    if(database_redis_append(db, command, key, keylen, payload, length))
+        return NULL;
+
+    return database_redis_reply(db);
+}
+
+//
+// replies
+//
+int database_redis_reply_set(database_redis_mode_t mode, redisReply *reply, uint8_t *key, size_t keylen) {
+    if(reply->type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: set: %s", reply->str);
+        return 1;
+    }
+
+    // we are on a real redis backend
+    if(mode != REDIS_MODE_ZDB)
+        return 0;
+
+    // we are on zero-db, an empty response means the
+    // key already exists with the same payload
     if(reply->len == 0)
-        return reply;
+        return 0;
 
-    if(memcmp(reply->str, key, keylen)) {
+    if(reply->len != keylen || memcmp(reply->str, key, keylen)) {
         libflist_set_error("set: invalid response: %s", reply->str);
-        freeReplyObject(reply);
-        return NULL;
+        return 1;
     }
 
-    return reply;
+    return 0;
 }
 
+int database_redis_reply_exists(redisReply *reply) {
+    if(reply->type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: exists: %s", reply->str);
+        return -1;
+    }
+
+    return (reply->type == REDIS_REPLY_INTEGER && reply->integer > 0);
+}
+
+// zero-db CHECK replies 1 (valid), 0 (corrupted) or nil (not found)
+static int database_redis_reply_check(database_redis_mode_t mode, redisReply *reply) {
+    if(mode != REDIS_MODE_ZDB)
+        return database_redis_reply_exists(reply);
+
+    if(reply->type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: check: %s", reply->str);
+        return -2;
+    }
+
+    if(reply->type != REDIS_REPLY_INTEGER)
+        return 0;
+
+    return (reply->integer > 0) ? 1 : -1;
+}
+
+//
+// GET
+//
+static value_t *database_redis_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+
+    if(database_redis_append(db, REDIS_COMMAND_GET, key, keylen, NULL, 0))
+        return NULL;
+
+    if(database_redis_flush(db))
+        return NULL;
+
+    return database_redis_read_value(db);
+}
+
+static value_t *database_redis_sget(flist_db_t *database, char *key) {
+    return database_redis_get(database, (uint8_t *) key, strlen(key));
+}
+
+//
+// SET
+//
 static int database_redis_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
     database_redis_t *db = (database_redis_t *) database->handler;
     redisReply *reply;
+    int value;
 
-    if(!(reply = db->internal_set(database, key, keylen, payload, length)))
+    if(!(reply = database_redis_command(db, REDIS_COMMAND_SET, key, keylen, payload, length)))
         return 1;
 
+    value = database_redis_reply_set(db->mode, reply, key, keylen);
     freeReplyObject(reply);
 
-    return 0;
+    return value;
 }
 
 static int database_redis_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
@@ -124,53 +476,459 @@ static int database_redis_sset(flist_db_t *database, char *key, uint8_t *payload
 }
 
 static void database_redis_clean(value_t *value) {
-    freeReplyObject(value->handler);
-    free(value);
-}
+    // empty value (not found) doesn't have any buffer
+    if(!value->handler) {
+        free(value);
+        return;
+    }
 
+    database_redis_buffer_release((database_redis_buffer_t *) value->handler);
+}
 
-// poor implementation of exists
+//
+// EXISTS
+//
 static int database_redis_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
-    int retval = 0;
+    database_redis_t *db = (database_redis_t *) database->handler;
+    redisReply *reply;
+    int value;
 
-    value_t *value = database_redis_get(database, key, keylen);
-    if(!value)
+    if(!(reply = database_redis_command(db, REDIS_COMMAND_EXISTS, key, keylen, NULL, 0)))
         return 0;
 
-    if(value->data)
-        retval = 1;
+    value = database_redis_reply_exists(reply);
+    freeReplyObject(reply);
 
-    database_redis_clean(value);
-    return retval;
+    return (value > 0);
 }
 
 static int database_redis_sexists(flist_db_t *database, char *key) {
     return database_redis_exists(database, (uint8_t *) key, strlen(key));
 }
 
+//
+// DEL
+//
+static int database_redis_del(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_redis_t *db = (database_redis_t *) database->handler;
+    redisReply *reply;
+    int value = 0;
+
+    if(!(reply = database_redis_command(db, REDIS_COMMAND_DEL, key, keylen, NULL, 0)))
+        return 1;
+
+    if(reply->type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: del: %s", reply->str);
+        value = 1;
+    }
+
+    freeReplyObject(reply);
+
+    return value;
+}
+
+static int database_redis_sdel(flist_db_t *database, char *key) {
+    return database_redis_del(database, (uint8_t *) key, strlen(key));
+}
+
+//
+// batch (pipelined)
+//
+// commands are queued on the output buffer by windows, the first reply
+// request flush the whole window to the server, then each reply
+// is read in order, replies are always all read, even after an error,
+// to keep the connection synchronized
+//
+static int database_redis_pipeline(database_redis_t *db, database_redis_command_t command, flist_db_batch_t *batch, size_t count) {
+    int failed = 0;
+
+    for(size_t start = 0; start < count; ) {
+        size_t pending = 0;
+        size_t bytes = 0;
+
+        while(start + pending < count && pending < DATABASE_REDIS_PIPELINE_COMMANDS) {
+            flist_db_batch_t *entry = &batch[start + pending];
+            uint8_t *payload = (command == REDIS_COMMAND_SET) ? entry->data : NULL;
+
+            // always send at least one command per window
+            if(pending && payload && bytes + entry->datalen > DATABASE_REDIS_PIPELINE_BYTES)
+                break;
+
+            if(database_redis_append(db, command, entry->key, entry->keylen, payload, entry->datalen))
+                return 1;
+
+            bytes += payload ? entry->datalen : 0;
+            pending += 1;
+        }
+
+        debug("[+] libflist: redis: pipeline: %lu commands (%.2f KB)\n", pending, bytes / 1024.0);
+
+        // values replies are read without hiredis
+        if(command == REDIS_COMMAND_GET && database_redis_flush(db))
+            return 1;
+
+        for(size_t i = start; i < start + pending; i++) {
+            flist_db_batch_t *entry = &batch[i];
+            redisReply *reply;
+
+            if(command == REDIS_COMMAND_GET) {
+                // connection broken, nothing more can be read
+                if(!(entry->value = database_redis_read_value(db)))
+                    return 1;
+
+                // batch value is only set when found
+                if(!entry->value->data) {
+                    free(entry->value);
+                    entry->value = NULL;
+                }
+
+                continue;
+            }
+
+            // connection broken, nothing more can be read
+            if(!(reply = database_redis_reply(db)))
+                return 1;
+
+            switch(command) {
+                case REDIS_COMMAND_EXISTS:
+                    if((entry->exists = database_redis_reply_exists(reply)) < 0) {
+                        entry->exists = 0;
+                        failed = 1;
+                    }
+
+                    freeReplyObject(reply);
+                    break;
+
+                case REDIS_COMMAND_CHECK:
+                    if((entry->exists = database_redis_reply_check(db->mode, reply)) < -1) {
+                        entry->exists = 0;
+                        failed = 1;
+                    }
+
+                    freeReplyObject(reply);
+                    break;
+
+                case REDIS_COMMAND_SET:
+                    failed |= database_redis_reply_set(db->mode, reply, entry->key, entry->keylen);
+                    freeReplyObject(reply);
+                    break;
+
+                default:
+                    // values are read above
+                    freeReplyObject(reply);
+                    break;
+            }
+        }
+
+        start += pending;
+    }
+
+    return failed;
+}
+
+static int database_redis_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_redis_pipeline(database->handler, REDIS_COMMAND_EXISTS, batch, count);
+}
+
+static int database_redis_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_redis_pipeline(database->handler, REDIS_COMMAND_CHECK, batch, count);
+}
+
+static int database_redis_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_redis_pipeline(database->handler, REDIS_COMMAND_SET, batch, count);
+}
+
+static int database_redis_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    for(size_t i = 0; i < count; i++)
+        batch[i].value = NULL;
+
+    return database_redis_pipeline(database->handler, REDIS_COMMAND_GET, batch, count);
+}
+
+//
+// SCAN
+//
+// zero-db returns keys by small groups, each iteration starts after
+// the previous returned cursor, until "No more data" error, redis-compatible
+// servers iterate over the keys (or the namespace hash fields)
+//
+// a callback returning non-zero stops the listing and fails the scan
+//
+static int database_redis_scan_zdb(database_redis_t *db, flist_db_scan_t callback, void *userptr) {
+    redisReply *reply, *cursor = NULL;
+    int value = 0;
+
+    while(1) {
+        if(cursor)
+            reply = redisCommand(db->redis, "SCAN %b", cursor->str, cursor->len);
+        else
+            reply = redisCommand(db->redis, "SCAN");
+
+        freeReplyObject(cursor);
+        cursor = NULL;
+
+        if(!reply) {
+            libflist_set_error("redis: scan: %s", db->redis->errstr);
+            return 1;
+        }
+
+        if(reply->type == REDIS_REPLY_ERROR) {
+            // end of the namespace reached
+            if(!strstr(reply->str, "No more data")) {
+                libflist_set_error("redis: scan: %s", reply->str);
+                value = 1;
+            }
+
+            freeReplyObject(reply);
+            return value;
+        }
+
+        if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 2 || reply->element[1]->type != REDIS_REPLY_ARRAY) {
+            libflist_set_error("redis: scan: unexpected reply");
+            freeReplyObject(reply);
+            return 1;
+        }
+
+        redisReply *entries = reply->element[1];
+
+        // each entry is [key, size, timestamp]
+        for(size_t i = 0; i < entries->elements && !value; i++) {
+            redisReply *entry = entries->element[i];
+
+            if(entry->type == REDIS_REPLY_ARRAY && entry->elements > 0)
+                value = callback((uint8_t *) entry->element[0]->str, entry->element[0]->len, userptr);
+        }
+
+        // keep the cursor reply to continue, it's the
+        // only thing we need from this reply
+        cursor = reply->element[0];
+        reply->element[0] = NULL;
+        freeReplyObject(reply);
+
+        // callback stopped the listing, error is set by the callback
+        if(value) {
+            freeReplyObject(cursor);
+            return 1;
+        }
+    }
+}
+
+static int database_redis_scan_fields(redisReply *fields, flist_db_scan_t callback, void *userptr) {
+    for(size_t i = 0; i < fields->elements; i++)
+        if(callback((uint8_t *) fields->element[i]->str, fields->element[i]->len, userptr))
+            return 1;
+
+    return 0;
+}
+
+static int database_redis_scan_keys(database_redis_t *db, flist_db_scan_t callback, void *userptr) {
+    redisReply *reply;
+
+    if(!(reply = redisCommand(db->redis, "HKEYS %s", db->namespace))) {
+        libflist_set_error("redis: scan: %s", db->redis->errstr);
+        return 1;
+    }
+
+    if(reply->type != REDIS_REPLY_ARRAY) {
+        libflist_set_error("redis: scan: %s", reply->type == REDIS_REPLY_ERROR ? reply->str : "unexpected reply");
+        freeReplyObject(reply);
+        return 1;
+    }
+
+    int value = database_redis_scan_fields(reply, callback, userptr);
+    freeReplyObject(reply);
+
+    return value;
+}
+
+static int database_redis_scan_hash(database_redis_t *db, flist_db_scan_t callback, void *userptr) {
+    redisReply *reply;
+    char cursor[32] = "0";
+    int value = 0;
+
+    do {
+        // only fields are needed, values are chunks payload
+        if(!(reply = redisCommand(db->redis, "HSCAN %s %s COUNT %d NOVALUES", db->namespace, cursor, DATABASE_REDIS_SCAN_COUNT))) {
+            libflist_set_error("redis: scan: %s", db->redis->errstr);
+            return 1;
+        }
+
+        // server doesn't support scanning without values (redis < 7.4)
+        // fetching all the fields at once is better than fetching values
+        if(reply->type == REDIS_REPLY_ERROR) {
+            debug("[-] libflist: redis: scan: %s, fetching all keys\n", reply->str);
+            freeReplyObject(reply);
+            return database_redis_scan_keys(db, callback, userptr);
+        }
+
+        if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 2 || reply->element[1]->type != REDIS_REPLY_ARRAY) {
+            libflist_set_error("redis: scan: unexpected reply");
+            freeReplyObject(reply);
+            return 1;
+        }
+
+        snprintf(cursor, sizeof(cursor), "%s", reply->element[0]->str);
+        value = database_redis_scan_fields(reply->element[1], callback, userptr);
+
+        freeReplyObject(reply);
+
+    } while(!value && strcmp(cursor, "0"));
+
+    return value;
+}
+
+static int database_redis_scan_plain(database_redis_t *db, flist_db_scan_t callback, void *userptr) {
+    redisReply *reply;
+    char cursor[32] = "0";
+    int value = 0;
+
+    do {
+        if(!(reply = redisCommand(db->redis, "SCAN %s COUNT %d", cursor, DATABASE_REDIS_SCAN_COUNT))) {
+            libflist_set_error("redis: scan: %s", db->redis->errstr);
+            return 1;
+        }
+
+        if(reply->type != REDIS_REPLY_ARRAY || reply->elements != 2 || reply->element[1]->type != REDIS_REPLY_ARRAY) {
+            libflist_set_error("redis: scan: %s", reply->type == REDIS_REPLY_ERROR ? reply->str : "unexpected reply");
+            freeReplyObject(reply);
+            return 1;
+        }
+
+        snprintf(cursor, sizeof(cursor), "%s", reply->element[0]->str);
+        value = database_redis_scan_fields(reply->element[1], callback, userptr);
+
+        freeReplyObject(reply);
+
+    } while(!value && strcmp(cursor, "0"));
+
+    return value;
+}
+
+static int database_redis_scan_all(database_redis_t *db, flist_db_scan_t callback, void *userptr) {
+    if(db->mode == REDIS_MODE_ZDB)
+        return database_redis_scan_zdb(db, callback, userptr);
+
+    if(db->mode == REDIS_MODE_KEYS)
+        return database_redis_scan_plain(db, callback, userptr);
+
+    return database_redis_scan_hash(db, callback, userptr);
+}
+
+// entries and metadata keys are on the same namespace,
+// listing is filtered on the metadata prefix
+typedef struct database_redis_filter_t {
+    flist_db_scan_t callback;
+    void *userptr;
+
+} database_redis_filter_t;
+
+static int database_redis_is_metadata(uint8_t *key, size_t keylen) {
+    size_t prefix = strlen(DATABASE_REDIS_METADATA);
+    return (keylen >= prefix && memcmp(key, DATABASE_REDIS_METADATA, prefix) == 0);
+}
+
+static int database_redis_scan_entry(uint8_t *key, size_t keylen, void *userptr) {
+    database_redis_filter_t *filter = (database_redis_filter_t *) userptr;
+
+    if(database_redis_is_metadata(key, keylen))
+        return 0;
+
+    return filter->callback(key, keylen, filter->userptr);
+}
+
+static int database_redis_scan_metadata(uint8_t *key, size_t keylen, void *userptr) {
+    database_redis_filter_t *filter = (database_redis_filter_t *) userptr;
+    size_t prefix = strlen(DATABASE_REDIS_METADATA);
+
+    if(!database_redis_is_metadata(key, keylen))
+        return 0;
+
+    return filter->callback(key + prefix, keylen - prefix, filter->userptr);
+}
+
+static int database_redis_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_redis_filter_t filter = {.callback = callback, .userptr = userptr};
+    return database_redis_scan_all(database->handler, database_redis_scan_entry, &filter);
+}
+
+static int database_redis_mdscan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_redis_filter_t filter = {.callback = callback, .userptr = userptr};
+    return database_redis_scan_all(database->handler, database_redis_scan_metadata, &filter);
+}
+
+//
+// metadata
+//
+static char *database_redis_metadata_key(char *key) {
+    char *mdkey;
+
+    if(asprintf(&mdkey, "%s%s", DATABASE_REDIS_METADATA, key) < 0) {
+        libflist_errp("asprintf");
+        return NULL;
+    }
+
+    return mdkey;
+}
+
+// value is kept on the database (like sqlite column),
+// valid until the next metadata request
 static value_t *database_redis_mdget(flist_db_t *database, char *key) {
-    (void) database;
-    (void) key;
+    database_redis_t *db = (database_redis_t *) database->handler;
+    value_t *value, *found = NULL;
+    char *mdkey;
+
+    if(!(value = calloc(1, sizeof(value_t)))) {
+        libflist_errp("calloc");
+        return NULL;
+    }
+
+    if((mdkey = database_redis_metadata_key(key))) {
+        found = database_redis_get(database, (uint8_t *) mdkey, strlen(mdkey));
+        free(mdkey);
+    }
+
+    if(found && found->data) {
+        free(db->metadata);
 
-    debug("[-] libflist: database_redis_mdget: not implemented\n");
-    return NULL;
+        if((db->metadata = malloc(found->length + 1))) {
+            memcpy(db->metadata, found->data, found->length);
+            db->metadata[found->length] = '\0';
+
+            value->data = db->metadata;
+            value->length = found->length;
+        }
+    }
+
+    if(found)
+        database_redis_clean(found);
+
+    return value;
 }
 
 static int database_redis_mdset(flist_db_t *database, char *key, char *payload) {
-    (void) database;
-    (void) key;
-    (void) payload;
+    char *mdkey;
+    int value;
 
-    debug("[-] libflist: database_redis_mdset: not implemented\n");
-    return 1;
+    if(!(mdkey = database_redis_metadata_key(key)))
+        return 1;
+
+    value = database_redis_set(database, (uint8_t *) mdkey, strlen(mdkey), (uint8_t *) payload, strlen(payload));
+    free(mdkey);
+
+    return value;
 }
 
 static int database_redis_mddel(flist_db_t *database, char *key) {
-    (void) database;
-    (void) key;
+    char *mdkey;
+    int value;
 
-    debug("[-] libflist: database_redis_mddel: not implemented\n");
-    return 1;
+    if(!(mdkey = database_redis_metadata_key(key)))
+        return 1;
+
+    value = database_redis_del(database, (uint8_t *) mdkey, strlen(mdkey));
+    free(mdkey);
+
+    return value;
 }
 
 static flist_db_t *database_redis_init_global(flist_db_t *db) {
@@ -184,13 +942,21 @@ static flist_db_t *database_redis_init_global(flist_db_t *db) {
     db->get = database_redis_get;
     db->set = database_redis_set;
     db->exists = database_redis_exists;
+    db->del = database_redis_del;
     db->clean = database_redis_clean;
     db->sget = database_redis_sget;
     db->sset = database_redis_sset;
     db->sexists = database_redis_sexists;
+    db->sdel = database_redis_sdel;
     db->mdget = database_redis_mdget;
     db->mdset = database_redis_mdset;
     db->mddel = database_redis_mddel;
+    db->mexists = database_redis_mexists;
+    db->mset = database_redis_mset;
+    db->mget = database_redis_mget;
+    db->mcheck = database_redis_mcheck;
+    db->scan = database_redis_scan;
+    db->mdscan = database_redis_mdscan;
 
     return db;
 }
@@ -200,11 +966,12 @@ static flist_db_t *database_redis_init() {
     flist_db_t *db;
 
     // allocate generic database object
-    if(!(db = malloc(sizeof(flist_db_t))))
+    // unsupported handlers (like del) are kept NULL
+    if(!(db = calloc(1, sizeof(flist_db_t))))
         return NULL;
 
     // set our custom redis database handler
-    if(!(db->handler = malloc(sizeof(database_redis_t)))) {
+    if(!(db->handler = calloc(1, sizeof(database_redis_t)))) {
         free(db);
         return NULL;
     }
@@ -212,6 +979,11 @@ static flist_db_t *database_redis_init() {
     return database_redis_init_global(db);
 }
 
+// detect zero-db from the INFO reply, shared by the drivers
+int database_redis_is_zdb(redisReply *info) {
+    return (strstr(info->str, "0-db") != NULL);
+}
+
 static int database_redis_set_namespace(database_redis_t *db, char *namespace, char *password, char *token) {
     redisReply *reply;
 
@@ -221,14 +993,13 @@ static int database_redis_set_namespace(database_redis_t *db, char *namespace, c
     if(reply->len == 0)
         return 1;
 
-    if(strstr("0-db (zdb)", reply->str) == 0) {
+    if(database_redis_is_zdb(reply)) {
         // this is a zero-db server
         freeReplyObject(reply);
 
         // linking to zdb settings
         db->namespace = NULL;
-        db->internal_get = database_redis_get_zdb;
-        db->internal_set = database_redis_set_zdb;
+        db->mode = REDIS_MODE_ZDB;
 
         // fallback to default namespace
         if(namespace == NULL)
@@ -270,10 +1041,15 @@ static int database_redis_set_namespace(database_redis_t *db, char *namespace, c
         // this is a redis-compatible server
         debug("[+] database: redis compatible detected\n");
 
-        // linking to redis settings
-        db->namespace = namespace;
-        db->internal_get = database_redis_get_real;
-        db->internal_set = database_redis_set_real;
+        // linking to redis settings, plain keys, the namespace
+        // is only used when keys are requested inside its hash
+        if(!(db->namespace = strdup(namespace ? namespace : "default"))) {
+            libflist_errp("redis: strdup");
+            freeReplyObject(reply);
+            return 1;
+        }
+
+        db->mode = REDIS_MODE_KEYS;
     }
 
     freeReplyObject(reply);
@@ -324,3 +1100,28 @@ flist_db_t *libflist_db_redis_init_unix(char *socket, char *namespace, char *pas
 
     return db;
 }
+
+// store keys inside the namespace hash (HSET, HGET, ...) instead of plain
+// keys, only supported by redis-compatible servers, zero-db namespaces
+// are selected on the server
+int libflist_db_redis_hash(flist_db_t *database) {
+    if(strcmp(database->type, "REDIS_ASYNC") == 0)
+        return database_redis_async_hash(database);
+
+    if(strcmp(database->type, "REDIS")) {
+        libflist_set_error("hash: %s: only supported by redis databases", database->type);
+        return 1;
+    }
+
+    database_redis_t *db = (database_redis_t *) database->handler;
+
+    if(db->mode == REDIS_MODE_ZDB) {
+        libflist_set_error("hash: not supported by zero-db, namespaces are used");
+        return 1;
+    }
+
+    debug("[+] database: redis: keys stored inside hash: %s\n", db->namespace);
+    db->mode = REDIS_MODE_HASH;
+
+    return 0;
+}
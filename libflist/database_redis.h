@@ -3,13 +3,80 @@
 
     #include <hiredis/hiredis.h>
 
+    // keys addressing, zero-db uses plain keys inside the selected namespace,
+    // a redis-compatible server uses plain keys too, unless keys are explicitly
+    // requested inside the namespace hash (libflist_db_redis_hash)
+    typedef enum database_redis_mode_t {
+        REDIS_MODE_ZDB,
+        REDIS_MODE_KEYS,
+        REDIS_MODE_HASH,
+
+    } database_redis_mode_t;
+
+    // commands sent to the server, depending on the keys addressing
+    typedef enum database_redis_command_t {
+        REDIS_COMMAND_GET,
+        REDIS_COMMAND_SET,
+        REDIS_COMMAND_EXISTS,
+        REDIS_COMMAND_DEL,
+        REDIS_COMMAND_CHECK,
+
+    } database_redis_command_t;
+
+    // pipelined commands are sent by windows, replies are
+    // read before sending the next window, to keep memory bounded
+    #define DATABASE_REDIS_PIPELINE_COMMANDS  256
+    #define DATABASE_REDIS_PIPELINE_BYTES     (16 * 1024 * 1024)
+
+    // metadata are stored next to entries, with this key prefix
+    #define DATABASE_REDIS_METADATA  "metadata:"
+
+    // amount of keys requested per scan iteration (redis-compatible)
+    #define DATABASE_REDIS_SCAN_COUNT  1000
+
+    // payload larger than this are written from the caller buffer (writev)
+    // instead of being copied into hiredis output buffer
+    #define DATABASE_REDIS_ZEROCOPY_MIN  (16 * 1024)
+
+    // values replies headers are read by blocks, payload are read directly
+    // into pooled buffers, released buffers are kept for the next values
+    #define DATABASE_REDIS_READAHEAD     4096
+    #define DATABASE_REDIS_POOL          4
+    #define DATABASE_REDIS_POOL_MAXSIZE  (4 * 1024 * 1024)
+
+    struct database_redis_t;
+
+    // value returned by get, backed by a pooled buffer
+    typedef struct database_redis_buffer_t {
+        value_t value;                  // value given to the caller
+        struct database_redis_t *db;    // connection owning the pool
+        size_t size;                    // allocated size
+
+    } database_redis_buffer_t;
+
     typedef struct database_redis_t {
         redisContext *redis;
         char *namespace;
+        database_redis_mode_t mode;
 
-        redisReply* (*internal_get)(flist_db_t *database, uint8_t *key, size_t keylen);
-        redisReply* (*internal_set)(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length);
+        // bytes read from the server, not consumed yet
+        char readahead[DATABASE_REDIS_READAHEAD];
+        size_t rapos;
+        size_t ralen;
+
+        database_redis_buffer_t *pool[DATABASE_REDIS_POOL];
+        size_t pooled;
+
+        char *metadata;     // last metadata value (valid until the next one)
 
     } database_redis_t;
 
+    // helpers shared by the synchronous and asynchronous drivers
+    #define DATABASE_REDIS_ARGV  4
+
+    int database_redis_argv(database_redis_mode_t mode, char *namespace, database_redis_command_t command, uint8_t *key, size_t keylen, uint8_t *payload, size_t length, const char **argv, size_t *argvlen);
+    int database_redis_reply_set(database_redis_mode_t mode, redisReply *reply, uint8_t *key, size_t keylen);
+    int database_redis_reply_exists(redisReply *reply);
+    int database_redis_is_zdb(redisReply *info);
+
 #endif
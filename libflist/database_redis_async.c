@@ -0,0 +1,712 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/epoll.h>
+#include <hiredis/hiredis.h>
+#include <hiredis/async.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_redis.h"
+#include "database_redis_async.h"
+
+//
+// asynchronous redis database
+//
+// commands are sent with hiredis async api, the connection is driven
+// by a small epoll loop owned by the database, the loop only runs when
+// libflist is called (submitting a new operation or waiting), there is
+// no background thread, completion callbacks are called from that loop
+//
+// submitting an operation when the window is full runs the loop until
+// a reply frees a slot, so memory and server load stays bounded while
+// one single thread keeps the connection busy
+//
+
+//
+// event loop (hiredis adapter)
+//
+static void database_redis_async_watch(database_redis_async_t *db, uint32_t events) {
+    struct epoll_event event = {
+        .events = events,
+        .data.ptr = db,
+    };
+
+    if(events == db->events)
+        return;
+
+    if(epoll_ctl(db->epoll, EPOLL_CTL_MOD, db->fd, &event) < 0)
+        libflist_warnp("redis: async: epoll_ctl");
+
+    db->events = events;
+}
+
+static void database_redis_async_add_read(void *privdata) {
+    database_redis_async_t *db = (database_redis_async_t *) privdata;
+    database_redis_async_watch(db, db->events | EPOLLIN);
+}
+
+static void database_redis_async_del_read(void *privdata) {
+    database_redis_async_t *db = (database_redis_async_t *) privdata;
+    database_redis_async_watch(db, db->events & ~EPOLLIN);
+}
+
+static void database_redis_async_add_write(void *privdata) {
+    database_redis_async_t *db = (database_redis_async_t *) privdata;
+    database_redis_async_watch(db, db->events | EPOLLOUT);
+}
+
+static void database_redis_async_del_write(void *privdata) {
+    database_redis_async_t *db = (database_redis_async_t *) privdata;
+    database_redis_async_watch(db, db->events & ~EPOLLOUT);
+}
+
+// hiredis is releasing the connection
+static void database_redis_async_cleanup(void *privdata) {
+    database_redis_async_t *db = (database_redis_async_t *) privdata;
+
+    epoll_ctl(db->epoll, EPOLL_CTL_DEL, db->fd, NULL);
+
+    db->events = 0;
+    db->async = NULL;
+}
+
+static int database_redis_async_attach(database_redis_async_t *db) {
+    redisAsyncContext *ac = db->async;
+    struct epoll_event event = {
+        .events = 0,
+        .data.ptr = db,
+    };
+
+    db->fd = ac->c.fd;
+
+    if(epoll_ctl(db->epoll, EPOLL_CTL_ADD, db->fd, &event) < 0) {
+        libflist_errp("redis: async: epoll_ctl");
+        return 1;
+    }
+
+    ac->ev.data = db;
+    ac->ev.addRead = database_redis_async_add_read;
+    ac->ev.delRead = database_redis_async_del_read;
+    ac->ev.addWrite = database_redis_async_add_write;
+    ac->ev.delWrite = database_redis_async_del_write;
+    ac->ev.cleanup = database_redis_async_cleanup;
+
+    return 0;
+}
+
+// connection lost or closed, pending callbacks were
+// called with an empty reply by hiredis
+static void database_redis_async_disconnected(const redisAsyncContext *ac, int status) {
+    database_redis_async_t *db = (database_redis_async_t *) ac->data;
+
+    if(status != REDIS_OK)
+        libflist_set_error("redis: async: disconnected: %s", ac->errstr);
+
+    db->async = NULL;
+}
+
+static void database_redis_async_connected(const redisAsyncContext *ac, int status) {
+    database_redis_async_t *db = (database_redis_async_t *) ac->data;
+
+    if(status == REDIS_OK)
+        return;
+
+    // hiredis releases the context after a failed connection
+    libflist_set_error("redis: async: connect: %s", ac->errstr);
+    db->async = NULL;
+}
+
+// drop the connection, hiredis calls all pending callbacks
+// with an empty reply, nothing is in flight afterward
+static void database_redis_async_abort(database_redis_async_t *db) {
+    if(!db->async)
+        return;
+
+    redisAsyncFree(db->async);
+    db->async = NULL;
+}
+
+// run one iteration of the loop, waiting at most timeout milliseconds
+static int database_redis_async_poll(database_redis_async_t *db, int timeout) {
+    struct epoll_event event;
+    int ready;
+
+    if(!db->async) {
+        libflist_set_error("redis: async: not connected");
+        return 1;
+    }
+
+    if((ready = epoll_wait(db->epoll, &event, 1, timeout)) < 0) {
+        if(errno == EINTR)
+            return 0;
+
+        libflist_errp("redis: async: epoll_wait");
+        return 1;
+    }
+
+    if(ready == 0) {
+        if(timeout == 0)
+            return 0;
+
+        // server doesn't answer anymore, dropping the connection
+        // calls all pending callbacks with an error
+        libflist_set_error("redis: async: timeout, %lu operations lost", db->inflight);
+        database_redis_async_abort(db);
+
+        return 1;
+    }
+
+    db->looping = 1;
+
+    if((event.events & (EPOLLIN | EPOLLERR | EPOLLHUP)) && (db->events & EPOLLIN))
+        redisAsyncHandleRead(db->async);
+
+    if(db->async && (event.events & (EPOLLOUT | EPOLLERR | EPOLLHUP)) && (db->events & EPOLLOUT))
+        redisAsyncHandleWrite(db->async);
+
+    db->looping = 0;
+
+    return 0;
+}
+
+// run the loop until at most pending operations are in flight
+static int database_redis_async_drain(database_redis_async_t *db, size_t pending, int timeout) {
+    // the loop can't be entered again from a callback
+    if(db->looping) {
+        libflist_set_error("redis: async: can't wait from a completion callback");
+        return 1;
+    }
+
+    while(db->inflight > pending) {
+        if(database_redis_async_poll(db, timeout))
+            return 1;
+    }
+
+    return 0;
+}
+
+static int database_redis_async_connect(database_redis_async_t *db);
+
+//
+// operations
+//
+static value_t *database_redis_async_value(redisReply *reply) {
+    value_t *value;
+
+    if(!(value = calloc(1, sizeof(value_t))))
+        return libflist_errp("redis: async: value: calloc");
+
+    if(reply->type != REDIS_REPLY_STRING)
+        return value;
+
+    // hiredis releases the reply after the callback, the
+    // payload is copied to outlive it
+    if(!(value->data = malloc(reply->len + 1))) {
+        free(value);
+        return libflist_errp("redis: async: value: malloc");
+    }
+
+    memcpy(value->data, reply->str, reply->len);
+    value->data[reply->len] = '\0';
+    value->length = reply->len;
+
+    return value;
+}
+
+static void database_redis_async_clean(value_t *value) {
+    free(value->data);
+    free(value);
+}
+
+static void database_redis_async_reply(redisAsyncContext *ac, void *data, void *privdata) {
+    database_redis_async_request_t *request = (database_redis_async_request_t *) privdata;
+    database_redis_async_t *db = (database_redis_async_t *) request->database->handler;
+    flist_db_batch_t *entry = request->entry;
+    redisReply *reply = (redisReply *) data;
+    int status = 0;
+
+    db->inflight -= 1;
+
+    if(!reply) {
+        libflist_set_error("redis: async: %s", ac->errstr ? ac->errstr : "connection lost");
+        status = 1;
+
+    } else switch(request->command) {
+        case REDIS_COMMAND_EXISTS:
+            if((entry->exists = database_redis_reply_exists(reply)) < 0) {
+                entry->exists = 0;
+                status = 1;
+            }
+
+            break;
+
+        case REDIS_COMMAND_SET:
+            status = database_redis_reply_set(db->mode, reply, entry->key, entry->keylen);
+            break;
+
+        case REDIS_COMMAND_GET:
+            if(!(entry->value = database_redis_async_value(reply))) {
+                status = 1;
+                break;
+            }
+
+            // value is only set when found
+            if(!entry->value->data) {
+                free(entry->value);
+                entry->value = NULL;
+            }
+
+            break;
+
+        default:
+            // other commands are not sent asynchronously
+            break;
+    }
+
+    request->callback(request->database, entry, status, request->userptr);
+    free(request);
+}
+
+static int database_redis_async_submit(flist_db_t *database, database_redis_command_t command, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+    database_redis_async_request_t *request;
+    const char *argv[DATABASE_REDIS_ARGV];
+    size_t argvlen[DATABASE_REDIS_ARGV];
+    uint8_t *payload = (command == REDIS_COMMAND_SET) ? entry->data : NULL;
+    int argc;
+
+    // window full, waiting for a free slot, operations submitted
+    // from a completion callback are only queued (the loop is busy)
+    if(!db->looping && database_redis_async_drain(db, db->window - 1, DATABASE_REDIS_ASYNC_TIMEOUT))
+        return 1;
+
+    // connection lost, established again (not from a callback)
+    if(!db->async && !db->looping && database_redis_async_connect(db))
+        return 1;
+
+    if(!db->async) {
+        libflist_set_error("redis: async: not connected");
+        return 1;
+    }
+
+    if(!(request = malloc(sizeof(database_redis_async_request_t)))) {
+        libflist_errp("redis: async: request: malloc");
+        return 1;
+    }
+
+    request->database = database;
+    request->command = command;
+    request->entry = entry;
+    request->callback = callback;
+    request->userptr = userptr;
+
+    if(command == REDIS_COMMAND_GET)
+        entry->value = NULL;
+
+    // command is serialized right now, payload
+    // doesn't need to outlive this call
+    argc = database_redis_argv(db->mode, db->namespace, command, entry->key, entry->keylen, payload, entry->datalen, argv, argvlen);
+
+    if(redisAsyncCommandArgv(db->async, database_redis_async_reply, request, argc, argv, argvlen) != REDIS_OK) {
+        libflist_set_error("redis: async: %s", db->async->errstr ? db->async->errstr : "command failed");
+        free(request);
+        return 1;
+    }
+
+    db->inflight += 1;
+
+    // the request is queued, from now on its callback reports
+    // the outcome, even if the loop fails right away
+    if(!db->looping && database_redis_async_poll(db, 0))
+        debug("[-] redis: async: %s\n", libflist_strerror());
+
+    return 0;
+}
+
+static int database_redis_async_get_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    return database_redis_async_submit(database, REDIS_COMMAND_GET, entry, callback, userptr);
+}
+
+static int database_redis_async_set_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    return database_redis_async_submit(database, REDIS_COMMAND_SET, entry, callback, userptr);
+}
+
+static int database_redis_async_exists_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr) {
+    return database_redis_async_submit(database, REDIS_COMMAND_EXISTS, entry, callback, userptr);
+}
+
+static int database_redis_async_wait(flist_db_t *database) {
+    return database_redis_async_drain(database->handler, 0, DATABASE_REDIS_ASYNC_TIMEOUT);
+}
+
+// event loop file descriptor, readable when events are waiting
+static int database_redis_async_loopfd(flist_db_t *database) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+    return db->epoll;
+}
+
+// process events already waiting, never blocks
+static int database_redis_async_process(flist_db_t *database) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+
+    if(db->looping) {
+        libflist_set_error("redis: async: can't process events from a completion callback");
+        return 1;
+    }
+
+    return database_redis_async_poll(db, 0);
+}
+
+//
+// synchronous and batch operations, on top of the asynchronous ones
+//
+static void database_redis_async_status(flist_db_t *database, flist_db_batch_t *entry, int status, void *userptr) {
+    (void) database;
+    (void) entry;
+
+    *((int *) userptr) |= status;
+}
+
+static int database_redis_async_batch(flist_db_t *database, database_redis_command_t command, flist_db_batch_t *batch, size_t count) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+    int failed = 0;
+    size_t i;
+
+    // completions can't be waited for from a callback
+    if(db->looping) {
+        libflist_set_error("redis: async: can't wait from a completion callback");
+        return 1;
+    }
+
+    for(i = 0; i < count; i++)
+        if(database_redis_async_submit(database, command, &batch[i], database_redis_async_status, &failed))
+            break;
+
+    // submitted requests refer to the batch and to this stack frame,
+    // they always complete before returning, even on failure
+    if(database_redis_async_wait(database)) {
+        database_redis_async_abort(db);
+        return 1;
+    }
+
+    return (failed || i < count);
+}
+
+static int database_redis_async_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_redis_async_batch(database, REDIS_COMMAND_EXISTS, batch, count);
+}
+
+static int database_redis_async_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_redis_async_batch(database, REDIS_COMMAND_SET, batch, count);
+}
+
+static int database_redis_async_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    for(size_t i = 0; i < count; i++)
+        batch[i].value = NULL;
+
+    return database_redis_async_batch(database, REDIS_COMMAND_GET, batch, count);
+}
+
+static value_t *database_redis_async_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_batch_t entry = {.key = key, .keylen = keylen};
+    value_t *value;
+
+    if(database_redis_async_batch(database, REDIS_COMMAND_GET, &entry, 1))
+        return NULL;
+
+    if(entry.value)
+        return entry.value;
+
+    // key not found, keep an empty value
+    if(!(value = calloc(1, sizeof(value_t))))
+        return libflist_errp("redis: async: value: calloc");
+
+    return value;
+}
+
+static value_t *database_redis_async_sget(flist_db_t *database, char *key) {
+    return database_redis_async_get(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_redis_async_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    flist_db_batch_t entry = {.key = key, .keylen = keylen, .data = payload, .datalen = length};
+    return database_redis_async_batch(database, REDIS_COMMAND_SET, &entry, 1);
+}
+
+static int database_redis_async_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
+    return database_redis_async_set(database, (uint8_t *) key, strlen(key), payload, length);
+}
+
+static int database_redis_async_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_batch_t entry = {.key = key, .keylen = keylen};
+
+    if(database_redis_async_batch(database, REDIS_COMMAND_EXISTS, &entry, 1))
+        return 0;
+
+    return entry.exists;
+}
+
+static int database_redis_async_sexists(flist_db_t *database, char *key) {
+    return database_redis_async_exists(database, (uint8_t *) key, strlen(key));
+}
+
+//
+// connection
+//
+typedef struct database_redis_async_handshake_t {
+    int done;
+    int type;      // reply type (0 when connection lost)
+    char *str;     // reply string (copy)
+
+} database_redis_async_handshake_t;
+
+static void database_redis_async_handshake_reply(redisAsyncContext *ac, void *data, void *privdata) {
+    database_redis_async_handshake_t *handshake = (database_redis_async_handshake_t *) privdata;
+    database_redis_async_t *db = (database_redis_async_t *) ac->data;
+    redisReply *reply = (redisReply *) data;
+
+    db->inflight -= 1;
+    handshake->done = 1;
+
+    if(!reply)
+        return;
+
+    handshake->type = reply->type;
+    handshake->str = reply->str ? strdup(reply->str) : NULL;
+}
+
+// send one setup command and wait for the reply
+// returns the reply string, NULL on error
+static char *database_redis_async_handshake(database_redis_async_t *db, int argc, const char **argv) {
+    database_redis_async_handshake_t handshake = {0};
+
+    if(redisAsyncCommandArgv(db->async, database_redis_async_handshake_reply, &handshake, argc, argv, NULL) != REDIS_OK) {
+        libflist_set_error("redis: async: %s: could not send command", argv[0]);
+        return NULL;
+    }
+
+    db->inflight += 1;
+
+    if(database_redis_async_drain(db, 0, DATABASE_REDIS_ASYNC_CONNECT_TIMEOUT))
+        return NULL;
+
+    if(handshake.type == 0 || !handshake.str) {
+        // connection errors are already set
+        if(db->async)
+            libflist_set_error("redis: async: %s: no reply", argv[0]);
+
+        free(handshake.str);
+        return NULL;
+    }
+
+    if(handshake.type == REDIS_REPLY_ERROR) {
+        libflist_set_error("redis: async: %s: %s", argv[0], handshake.str);
+        free(handshake.str);
+        return NULL;
+    }
+
+    return handshake.str;
+}
+
+static int database_redis_async_set_namespace(database_redis_async_t *db, char *namespace, char *password, char *token) {
+    const char *info[] = {"INFO"};
+    redisReply inforeply = {0};
+    char *value;
+
+    if(!(value = database_redis_async_handshake(db, 1, info)))
+        return 1;
+
+    inforeply.str = value;
+    inforeply.len = strlen(value);
+    int zdb = database_redis_is_zdb(&inforeply);
+    free(value);
+
+    if(!zdb) {
+        // redis-compatible, plain keys unless keys are
+        // explicitly requested inside the namespace hash
+        debug("[+] database: async: redis compatible detected\n");
+        db->namespace = namespace ? namespace : "default";
+        db->mode = db->settings.hash ? REDIS_MODE_HASH : REDIS_MODE_KEYS;
+        return 0;
+    }
+
+    if(db->settings.hash) {
+        libflist_set_error("redis: async: hash: not supported by zero-db, namespaces are used");
+        return 1;
+    }
+
+    debug("[+] database: async: zero-db detected, selecting namespace\n");
+    db->namespace = NULL;
+    db->mode = REDIS_MODE_ZDB;
+
+    if(token) {
+        const char *auth[] = {"AUTH", token};
+
+        if(!(value = database_redis_async_handshake(db, 2, auth)))
+            return 1;
+
+        free(value);
+    }
+
+    const char *select[] = {"SELECT", namespace ? namespace : "default", password};
+
+    if(!(value = database_redis_async_handshake(db, password ? 3 : 2, select)))
+        return 1;
+
+    free(value);
+
+    return 0;
+}
+
+static void database_redis_async_close(flist_db_t *database) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+
+    // flush what's still in flight, then disconnect cleanly
+    if(db->async) {
+        database_redis_async_drain(db, 0, DATABASE_REDIS_ASYNC_TIMEOUT);
+
+        if(db->async)
+            redisAsyncFree(db->async);
+    }
+
+    close(db->epoll);
+
+    free(db->settings.host);
+    free(db->settings.namespace);
+    free(db->settings.password);
+    free(db->settings.token);
+    free(database->handler);
+    free(database);
+}
+
+static flist_db_t *database_redis_async_dummy(flist_db_t *database) {
+    (void) database;
+    return 0;
+}
+
+// (re)connect to the server and select the namespace
+static int database_redis_async_connect(database_redis_async_t *db) {
+    database_redis_async_settings_t *settings = &db->settings;
+
+    debug("[+] database: async: connecting (%s, %d), window: %lu\n", settings->host, settings->port, db->window);
+
+    if(!(db->async = redisAsyncConnect(settings->host, settings->port))) {
+        libflist_set_error("redis: async: connect: cannot allocate memory");
+        return 1;
+    }
+
+    if(db->async->err) {
+        libflist_set_error("redis: async: connect: %s", db->async->errstr);
+        redisAsyncFree(db->async);
+        db->async = NULL;
+        return 1;
+    }
+
+    db->async->data = db;
+
+    redisAsyncSetConnectCallback(db->async, database_redis_async_connected);
+    redisAsyncSetDisconnectCallback(db->async, database_redis_async_disconnected);
+
+    if(database_redis_async_attach(db) || database_redis_async_set_namespace(db, settings->namespace, settings->password, settings->token)) {
+        // error should have been set
+        if(db->async) {
+            redisAsyncFree(db->async);
+            db->async = NULL;
+        }
+
+        return 1;
+    }
+
+    return 0;
+}
+
+// keys inside the namespace hash (see libflist_db_redis_hash), kept
+// in the settings to be applied again when reconnecting
+int database_redis_async_hash(flist_db_t *database) {
+    database_redis_async_t *db = (database_redis_async_t *) database->handler;
+
+    if(db->mode == REDIS_MODE_ZDB) {
+        libflist_set_error("hash: not supported by zero-db, namespaces are used");
+        return 1;
+    }
+
+    debug("[+] database: async: keys stored inside hash: %s\n", db->namespace);
+    db->settings.hash = 1;
+    db->mode = REDIS_MODE_HASH;
+
+    return 0;
+}
+
+static char *database_redis_async_strdup(char *source) {
+    return source ? strdup(source) : NULL;
+}
+
+flist_db_t *libflist_db_redis_async_init_tcp(char *host, int port, char *namespace, char *password, char *token, size_t window) {
+    database_redis_async_t *handler;
+    flist_db_t *db;
+
+    if(!(db = calloc(1, sizeof(flist_db_t))))
+        return libflist_errp("redis: async: calloc");
+
+    if(!(db->handler = handler = calloc(1, sizeof(database_redis_async_t)))) {
+        free(db);
+        return libflist_errp("redis: async: calloc");
+    }
+
+    handler->window = window ? window : DATABASE_REDIS_ASYNC_WINDOW;
+
+    if((handler->epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+        libflist_errp("redis: async: epoll_create1");
+        free(handler);
+        free(db);
+        return NULL;
+    }
+
+    // fillin handlers, unsupported handlers (metadata and
+    // deletion) are kept NULL
+    db->type = "REDIS_ASYNC";
+    db->open = database_redis_async_dummy;
+    db->create = database_redis_async_dummy;
+    db->close = database_redis_async_close;
+    db->get = database_redis_async_get;
+    db->set = database_redis_async_set;
+    db->exists = database_redis_async_exists;
+    db->clean = database_redis_async_clean;
+    db->sget = database_redis_async_sget;
+    db->sset = database_redis_async_sset;
+    db->sexists = database_redis_async_sexists;
+    db->mexists = database_redis_async_mexists;
+    db->mset = database_redis_async_mset;
+    db->mget = database_redis_async_mget;
+    db->get_async = database_redis_async_get_async;
+    db->set_async = database_redis_async_set_async;
+    db->exists_async = database_redis_async_exists_async;
+    db->wait = database_redis_async_wait;
+    db->loopfd = database_redis_async_loopfd;
+    db->process = database_redis_async_process;
+
+    // settings are copied, the connection can be
+    // established again later with them
+    handler->settings.host = database_redis_async_strdup(host);
+    handler->settings.port = port;
+    handler->settings.namespace = database_redis_async_strdup(namespace);
+    handler->settings.password = database_redis_async_strdup(password);
+    handler->settings.token = database_redis_async_strdup(token);
+
+    if(!handler->settings.host) {
+        database_redis_async_close(db);
+        return libflist_set_error("redis: async: host missing");
+    }
+
+    if(database_redis_async_connect(handler)) {
+        database_redis_async_close(db);
+        return NULL;
+    }
+
+    return db;
+}
@@ -0,0 +1,57 @@
+#ifndef LIBFLIST_DATABASE_REDIS_ASYNC_H
+    #define LIBFLIST_DATABASE_REDIS_ASYNC_H
+
+    #include <hiredis/hiredis.h>
+    #include <hiredis/async.h>
+
+    // default amount of operations in flight
+    #define DATABASE_REDIS_ASYNC_WINDOW   256
+
+    // maximum time waiting for the server without any event (ms)
+    #define DATABASE_REDIS_ASYNC_TIMEOUT  30000
+
+    // maximum time waiting for the server while connecting (ms), a lost
+    // connection is established again by the next operation
+    #define DATABASE_REDIS_ASYNC_CONNECT_TIMEOUT  2000
+
+    // connection settings, kept to reconnect
+    typedef struct database_redis_async_settings_t {
+        char *host;
+        int port;
+        char *namespace;
+        char *password;
+        char *token;
+        int hash;           // keys inside the namespace hash (redis-compatible)
+
+    } database_redis_async_settings_t;
+
+    typedef struct database_redis_async_t {
+        redisAsyncContext *async;   // hiredis context (NULL when disconnected)
+        int epoll;                  // event loop
+        int fd;                     // connection watched by the event loop
+        uint32_t events;            // epoll events currently watched
+
+        char *namespace;            // hash name on a redis-compatible server
+        database_redis_mode_t mode; // keys addressing
+        database_redis_async_settings_t settings;
+
+        size_t inflight;            // operations sent, waiting for a reply
+        size_t window;              // maximum operations in flight
+        int looping;                // callbacks are being dispatched
+
+    } database_redis_async_t;
+
+    // one operation in flight
+    typedef struct database_redis_async_request_t {
+        flist_db_t *database;
+        database_redis_command_t command;
+        flist_db_batch_t *entry;
+
+        flist_db_callback_t callback;
+        void *userptr;
+
+    } database_redis_async_request_t;
+
+    int database_redis_async_hash(flist_db_t *database);
+
+#endif
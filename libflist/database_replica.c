@@ -0,0 +1,624 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_replica.h"
+
+//
+// replicated database
+//
+// the same keys are available on many databases (usually the same
+// namespace on many zdb), reads are sent to the replica answering the
+// fastest (smoothed latency), when no reply came after the usual delay
+// of that replica (latency percentile), the read is sent again to the
+// next replica (hedged) and the first value received is used
+//
+// replicas are asynchronous databases, all of them are driven from the
+// caller thread by waiting on their event loop at once, a reply coming
+// after the read is done is dropped when it arrives
+//
+// failed replicas are not used during a backoff (doubled on each failure)
+// then tried again, writes are sent to all the replicas
+//
+
+static uint64_t database_replica_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+}
+
+//
+// replicas health
+//
+
+// smoothed latency, halved for each stale period without update
+static uint64_t database_replica_latency(database_replica_node_t *node, uint64_t now) {
+    uint64_t periods = (now - node->measured) / DATABASE_REPLICA_STALE;
+
+    if(node->measured == 0)
+        return node->ewma;
+
+    return (periods >= 64) ? 0 : node->ewma >> periods;
+}
+
+static void database_replica_sample(database_replica_node_t *node, uint64_t latency) {
+    node->samples[node->sampled % DATABASE_REPLICA_SAMPLES] = (latency > UINT32_MAX) ? UINT32_MAX : latency;
+    node->sampled += 1;
+
+    // smoothed latency (1/8 weight), like tcp round-trip, a stale
+    // latency is first aged (replica not used for a while)
+    node->ewma = database_replica_latency(node, database_replica_now());
+
+    if(node->ewma == 0)
+        node->ewma = latency;
+    else
+        node->ewma = node->ewma - (node->ewma / 8) + (latency / 8);
+
+    node->measured = database_replica_now();
+    node->backoff = 0;
+}
+
+// attempt still without reply when another replica answered, the
+// time already spent is the lowest latency possible for this one
+static void database_replica_lagging(database_replica_node_t *node, uint64_t elapsed) {
+    node->ewma = database_replica_latency(node, database_replica_now());
+    node->measured = database_replica_now();
+
+    if(elapsed > node->ewma)
+        node->ewma = node->ewma - (node->ewma / 8) + (elapsed / 8);
+}
+
+static void database_replica_failed(database_replica_node_t *node) {
+    uint64_t now = database_replica_now();
+
+    node->failures += 1;
+
+    // already down, the other requests in flight failing
+    // with it are the same failure
+    if(node->downuntil > now)
+        return;
+
+    if(node->backoff == 0)
+        node->backoff = DATABASE_REPLICA_BACKOFF;
+    else if(node->backoff < DATABASE_REPLICA_BACKOFF_MAX)
+        node->backoff *= 2;
+
+    node->downuntil = now + node->backoff;
+
+    debug("[-] libflist: replica: %s: marked down for %lu ms\n", node->name, node->backoff / 1000);
+}
+
+static int database_replica_compare(const void *a, const void *b) {
+    uint32_t va = *((const uint32_t *) a);
+    uint32_t vb = *((const uint32_t *) b);
+
+    return (va > vb) - (va < vb);
+}
+
+// time to wait for a reply before hedging the read (us)
+static uint64_t database_replica_deadline(database_replica_node_t *node) {
+    uint32_t sorted[DATABASE_REPLICA_SAMPLES];
+    size_t length = node->sampled;
+    uint64_t deadline;
+
+    if(length < DATABASE_REPLICA_MINSAMPLES)
+        return DATABASE_REPLICA_HEDGE;
+
+    if(length > DATABASE_REPLICA_SAMPLES)
+        length = DATABASE_REPLICA_SAMPLES;
+
+    memcpy(sorted, node->samples, length * sizeof(uint32_t));
+    qsort(sorted, length, sizeof(uint32_t), database_replica_compare);
+
+    deadline = sorted[(length * DATABASE_REPLICA_PERCENTILE) / 100];
+
+    return (deadline < DATABASE_REPLICA_HEDGE_MIN) ? DATABASE_REPLICA_HEDGE_MIN : deadline;
+}
+
+// fastest replica not asked yet, down replicas are only used
+// when nothing else is left (the one coming back first)
+static database_replica_node_t *database_replica_pick(database_replica_t *db, database_replica_read_t *read, int anyway) {
+    database_replica_node_t *best = NULL, *fallback = NULL;
+    uint64_t now = database_replica_now();
+
+    for(size_t i = 0; i < db->count; i++) {
+        database_replica_node_t *node = &db->replicas[i];
+
+        if(read->attempts[i])
+            continue;
+
+        if(node->downuntil > now) {
+            if(!fallback || node->downuntil < fallback->downuntil)
+                fallback = node;
+
+            continue;
+        }
+
+        if(!best || database_replica_latency(node, now) < database_replica_latency(best, now))
+            best = node;
+    }
+
+    if(best)
+        return best;
+
+    return anyway ? fallback : NULL;
+}
+
+//
+// reads
+//
+static void database_replica_release(database_replica_attempt_t *attempt) {
+    free(attempt->entry.key);
+    free(attempt);
+}
+
+static void database_replica_complete(flist_db_t *database, flist_db_batch_t *entry, int status, void *userptr) {
+    database_replica_attempt_t *attempt = (database_replica_attempt_t *) userptr;
+    database_replica_node_t *node = &attempt->db->replicas[attempt->replica];
+    database_replica_read_t *read = attempt->read;
+
+    if(status)
+        database_replica_failed(node);
+    else
+        database_replica_sample(node, database_replica_now() - attempt->started);
+
+    // read already done, late reply
+    if(!read) {
+        if(entry->value)
+            database->clean(entry->value);
+
+        database_replica_release(attempt);
+        return;
+    }
+
+    attempt->done = 1;
+    read->inflight -= 1;
+
+    if(status) {
+        read->failed += 1;
+        return;
+    }
+
+    if(!entry->value)
+        return;
+
+    // first value wins, the other ones are dropped
+    if(read->value) {
+        database->clean(entry->value);
+        entry->value = NULL;
+        return;
+    }
+
+    read->value = entry->value;
+    read->winner = attempt->replica;
+    entry->value = NULL;
+}
+
+// send the read to one more replica, returns the replica
+// used or NULL when no replica is left
+static database_replica_node_t *database_replica_submit(database_replica_t *db, database_replica_read_t *read, uint8_t *key, size_t keylen, int anyway) {
+    database_replica_node_t *node;
+
+    while((node = database_replica_pick(db, read, anyway))) {
+        database_replica_attempt_t *attempt;
+        size_t index = node - db->replicas;
+
+        if(!(attempt = calloc(1, sizeof(database_replica_attempt_t))))
+            return libflist_errp("replica: calloc");
+
+        if(!(attempt->entry.key = libflist_bufdup(key, keylen))) {
+            free(attempt);
+            return libflist_errp("replica: malloc");
+        }
+
+        attempt->entry.keylen = keylen;
+        attempt->read = read;
+        attempt->db = db;
+        attempt->replica = index;
+        attempt->started = database_replica_now();
+
+        read->attempts[index] = attempt;
+        read->asked += 1;
+        read->inflight += 1;
+        node->reads += 1;
+
+        if(libflist_db_get_async(node->db, &attempt->entry, database_replica_complete, attempt) == 0)
+            return node;
+
+        // not sent, trying the next one
+        debug("[-] libflist: replica: %s: %s\n", node->name, libflist_strerror());
+
+        attempt->done = 1;
+        read->inflight -= 1;
+        read->failed += 1;
+        database_replica_failed(node);
+    }
+
+    return NULL;
+}
+
+// wait (at most timeout us) for events on replicas with attempts in flight
+static void database_replica_wait(database_replica_t *db, database_replica_read_t *read, uint64_t timeout) {
+    struct pollfd fds[db->count];
+    size_t owner[db->count];
+    struct timespec ts = {
+        .tv_sec = timeout / 1000000,
+        .tv_nsec = (timeout % 1000000) * 1000,
+    };
+    size_t length = 0;
+
+    for(size_t i = 0; i < db->count; i++) {
+        database_replica_attempt_t *attempt = read->attempts[i];
+
+        if(!attempt || attempt->done)
+            continue;
+
+        fds[length].fd = db->replicas[i].db->loopfd(db->replicas[i].db);
+        fds[length].events = POLLIN;
+        owner[length] = i;
+        length += 1;
+    }
+
+    if(ppoll(fds, length, &ts, NULL) <= 0)
+        return;
+
+    for(size_t i = 0; i < length; i++) {
+        flist_db_t *replica = db->replicas[owner[i]].db;
+
+        if(fds[i].revents)
+            replica->process(replica);
+    }
+}
+
+static value_t *database_replica_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+    database_replica_read_t read = {0};
+    database_replica_node_t *node;
+    uint64_t started, timeout, deadline, now;
+    value_t *value = NULL;
+    int hedged = 0;
+
+    if(!(read.attempts = calloc(db->count, sizeof(database_replica_attempt_t *))))
+        return libflist_errp("replica: calloc");
+
+    db->reads += 1;
+    started = database_replica_now();
+    timeout = started + DATABASE_REPLICA_TIMEOUT;
+
+    if(!(node = database_replica_submit(db, &read, key, keylen, 1))) {
+        libflist_set_error("replica: no replica available");
+        goto cleanup;
+    }
+
+    deadline = started + database_replica_deadline(node);
+
+    while(!read.value) {
+        now = database_replica_now();
+
+        // every replica asked answered (not found or failed),
+        // the next one is asked, even if it's down
+        if(read.inflight == 0) {
+            if(!(node = database_replica_submit(db, &read, key, keylen, 1)))
+                break;
+
+            deadline = now + database_replica_deadline(node);
+            continue;
+        }
+
+        if(now >= timeout) {
+            libflist_set_error("replica: timeout, no reply from %lu replicas", read.inflight);
+
+            for(size_t i = 0; i < db->count; i++)
+                if(read.attempts[i] && !read.attempts[i]->done)
+                    database_replica_failed(&db->replicas[i]);
+
+            break;
+        }
+
+        // no reply in time, hedging to the next replica
+        if(now >= deadline) {
+            if((node = database_replica_submit(db, &read, key, keylen, 0))) {
+                deadline = now + database_replica_deadline(node);
+
+                if(!hedged)
+                    db->hedged += 1;
+
+                hedged = 1;
+
+            } else {
+                deadline = timeout;
+            }
+        }
+
+        if(deadline > timeout)
+            deadline = timeout;
+
+        database_replica_wait(db, &read, (deadline > now) ? deadline - now : 0);
+    }
+
+    if(read.value) {
+        db->replicas[read.winner].wins += 1;
+        value = read.value;
+
+    } else if(read.failed < read.asked) {
+        // not found on any replica answering
+        if(!(value = calloc(1, sizeof(value_t))))
+            libflist_errp("replica: calloc");
+    }
+
+cleanup:
+    for(size_t i = 0; i < db->count; i++) {
+        database_replica_attempt_t *attempt = read.attempts[i];
+
+        if(!attempt)
+            continue;
+
+        // still in flight, released by the late reply
+        if(!attempt->done) {
+            if(value && value->data)
+                database_replica_lagging(&db->replicas[i], database_replica_now() - attempt->started);
+
+            attempt->read = NULL;
+            continue;
+        }
+
+        database_replica_release(attempt);
+    }
+
+    free(read.attempts);
+
+    return value;
+}
+
+static value_t *database_replica_sget(flist_db_t *database, char *key) {
+    return database_replica_get(database, (uint8_t *) key, strlen(key));
+}
+
+// batch reads are sent at once to the fastest replica (not hedged),
+// entries not received are read one by one from the other replicas
+static int database_replica_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+    database_replica_read_t read = {0};
+    database_replica_node_t *node;
+    database_replica_attempt_t *none[db->count];
+    int failed = 0;
+
+    memset(none, 0, sizeof(none));
+    read.attempts = none;
+
+    for(size_t i = 0; i < count; i++)
+        batch[i].value = NULL;
+
+    // pipelined latency is not comparable with single
+    // reads latency, only failures are recorded
+    if((node = database_replica_pick(db, &read, 1)) && libflist_db_mget(node->db, batch, count)) {
+        database_replica_failed(node);
+        libflist_db_batch_clean(node->db, batch, count);
+    }
+
+    for(size_t i = 0; i < count; i++) {
+        value_t *value;
+
+        if(batch[i].value)
+            continue;
+
+        if(!(value = database_replica_get(database, batch[i].key, batch[i].keylen))) {
+            failed = 1;
+            continue;
+        }
+
+        // keep the batch semantic: value is only set when found
+        if(!value->data) {
+            database->clean(value);
+            continue;
+        }
+
+        batch[i].value = value;
+    }
+
+    return failed;
+}
+
+// existence and batch existence are asked to the fastest replica
+static flist_db_t *database_replica_fastest(database_replica_t *db) {
+    database_replica_attempt_t *none[db->count];
+    database_replica_read_t read = {.attempts = none};
+
+    memset(none, 0, sizeof(none));
+
+    return database_replica_pick(db, &read, 1)->db;
+}
+
+static int database_replica_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_t *replica = database_replica_fastest(database->handler);
+    return replica->exists(replica, key, keylen);
+}
+
+static int database_replica_sexists(flist_db_t *database, char *key) {
+    return database_replica_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_replica_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return libflist_db_mexists(database_replica_fastest(database->handler), batch, count);
+}
+
+// each replica holds its own copy, all of them are verified, an
+// entry is valid only when valid everywhere
+static int database_replica_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+    flist_db_batch_t *replica;
+    int failed = 0;
+
+    if(!(replica = calloc(count, sizeof(flist_db_batch_t)))) {
+        libflist_errp("replica: mcheck: calloc");
+        return 1;
+    }
+
+    for(size_t i = 0; i < count; i++)
+        batch[i].exists = 1;
+
+    for(size_t r = 0; r < db->count && !failed; r++) {
+        for(size_t i = 0; i < count; i++)
+            replica[i] = (flist_db_batch_t) {.key = batch[i].key, .keylen = batch[i].keylen};
+
+        if((failed = libflist_db_mcheck(db->replicas[r].db, replica, count)))
+            break;
+
+        for(size_t i = 0; i < count; i++)
+            if(replica[i].exists < batch[i].exists)
+                batch[i].exists = replica[i].exists;
+    }
+
+    free(replica);
+
+    return failed;
+}
+
+//
+// writes, sent to every replica
+//
+static int database_replica_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+    int failed = 0;
+
+    for(size_t i = 0; i < db->count; i++) {
+        flist_db_t *replica = db->replicas[i].db;
+
+        if(replica->set(replica, key, keylen, payload, length)) {
+            database_replica_failed(&db->replicas[i]);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+static int database_replica_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
+    return database_replica_set(database, (uint8_t *) key, strlen(key), payload, length);
+}
+
+static int database_replica_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+    int failed = 0;
+
+    for(size_t i = 0; i < db->count; i++) {
+        if(libflist_db_mset(db->replicas[i].db, batch, count)) {
+            database_replica_failed(&db->replicas[i]);
+            failed = 1;
+        }
+    }
+
+    return failed;
+}
+
+//
+// database handlers
+//
+static flist_db_t *database_replica_open(flist_db_t *database) {
+    return database;
+}
+
+static void database_replica_free(database_replica_t *db) {
+    for(size_t i = 0; i < db->count; i++)
+        free(db->replicas[i].name);
+
+    free(db->replicas);
+    free(db);
+}
+
+static void database_replica_close(flist_db_t *database) {
+    database_replica_t *db = (database_replica_t *) database->handler;
+
+    debug("[+] libflist: replica: %lu reads, %lu hedged\n", db->reads, db->hedged);
+
+    // replicas are owned by the replicated database, late
+    // replies still in flight are released while closing
+    for(size_t i = 0; i < db->count; i++) {
+        database_replica_node_t *node = &db->replicas[i];
+
+        debug("[+] libflist: replica: %s: %lu reads, %lu first, %lu failed, %lu us latency\n",
+              node->name, node->reads, node->wins, node->failures, node->ewma);
+
+        node->db->close(node->db);
+    }
+
+    database_replica_free(db);
+    free(database);
+}
+
+// public replicated database initializer, names are copied but
+// the replicated database owns the replicas (closed with it)
+flist_db_t *libflist_db_replica_init(flist_db_t **replicas, char **names, size_t count) {
+    database_replica_t *handler;
+    flist_db_t *db;
+
+    if(count == 0)
+        return libflist_set_error("replica: no replicas provided");
+
+    for(size_t i = 0; i < count; i++) {
+        // replicas are driven together, from their event loop
+        if(!replicas[i]->get_async || !replicas[i]->loopfd || !replicas[i]->process)
+            return libflist_set_error("replica: %s: asynchronous database required", names[i]);
+
+        // values are released by the replicated database, this
+        // only works if all replicas release them the same way
+        if(replicas[i]->clean != replicas[0]->clean)
+            return libflist_set_error("replica: all replicas need to use the same database type");
+    }
+
+    if(!(handler = calloc(1, sizeof(database_replica_t))))
+        return libflist_errp("replica: calloc");
+
+    if(!(handler->replicas = calloc(count, sizeof(database_replica_node_t)))) {
+        free(handler);
+        return libflist_errp("replica: calloc");
+    }
+
+    handler->count = count;
+
+    for(size_t i = 0; i < count; i++) {
+        handler->replicas[i].db = replicas[i];
+
+        if(!(handler->replicas[i].name = strdup(names[i]))) {
+            database_replica_free(handler);
+            return libflist_errp("replica: strdup");
+        }
+    }
+
+    debug("[+] libflist: replica: %lu replicas\n", handler->count);
+
+    // allocate generic database object
+    if(!(db = calloc(1, sizeof(flist_db_t)))) {
+        database_replica_free(handler);
+        return libflist_errp("replica: calloc");
+    }
+
+    db->handler = handler;
+    db->type = "REPLICA";
+
+    // fillin handlers, metadata and deletion are
+    // not supported by asynchronous databases
+    db->open = database_replica_open;
+    db->create = database_replica_open;
+    db->close = database_replica_close;
+    db->get = database_replica_get;
+    db->set = database_replica_set;
+    db->exists = database_replica_exists;
+    db->clean = replicas[0]->clean;
+    db->sget = database_replica_sget;
+    db->sset = database_replica_sset;
+    db->sexists = database_replica_sexists;
+    db->mexists = database_replica_mexists;
+    db->mset = database_replica_mset;
+    db->mget = database_replica_mget;
+    db->mcheck = database_replica_mcheck;
+
+    return db;
+}
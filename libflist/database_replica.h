@@ -0,0 +1,80 @@
+#ifndef LIBFLIST_DATABASE_REPLICA_H
+    #define LIBFLIST_DATABASE_REPLICA_H
+
+    // latencies kept per replica, a read is hedged (sent to the next
+    // replica) when no reply came after this percentile of the samples
+    #define DATABASE_REPLICA_SAMPLES     64
+    #define DATABASE_REPLICA_PERCENTILE  95
+    #define DATABASE_REPLICA_MINSAMPLES  8
+
+    // hedge deadline without enough samples, and lowest deadline (us)
+    #define DATABASE_REPLICA_HEDGE       20000
+    #define DATABASE_REPLICA_HEDGE_MIN   500
+
+    // read given up after this time, replicas still
+    // not answering are marked down (us)
+    #define DATABASE_REPLICA_TIMEOUT     (10 * 1000 * 1000)
+
+    // smoothed latency not updated since this time is halved on each
+    // period, a replica slow in the past is tried again later (us)
+    #define DATABASE_REPLICA_STALE       (5 * 1000 * 1000)
+
+    // a failed replica is not used during the backoff, doubled
+    // on each failure, reset on success (us)
+    #define DATABASE_REPLICA_BACKOFF     (1000 * 1000)
+    #define DATABASE_REPLICA_BACKOFF_MAX (60 * 1000 * 1000)
+
+    typedef struct database_replica_node_t {
+        flist_db_t *db;         // asynchronous database (connection)
+        char *name;             // replica identifier (logs)
+
+        uint64_t ewma;          // smoothed latency (us), 0 until measured
+        uint32_t samples[DATABASE_REPLICA_SAMPLES];
+        size_t sampled;         // amount of samples recorded
+        uint64_t measured;      // last latency update (us)
+
+        uint64_t downuntil;     // replica not used before this time (us)
+        uint64_t backoff;       // current backoff (us), 0 when healthy
+
+        size_t reads;           // reads sent
+        size_t wins;            // reads answered first
+        size_t failures;        // reads failed
+
+    } database_replica_node_t;
+
+    typedef struct database_replica_t {
+        database_replica_node_t *replicas;
+        size_t count;
+
+        size_t reads;           // reads requested
+        size_t hedged;          // reads sent to more than one replica
+
+    } database_replica_t;
+
+    struct database_replica_read_t;
+
+    // one read sent to one replica, an attempt still in flight when
+    // the read is done is abandoned, the late reply releases it
+    typedef struct database_replica_attempt_t {
+        struct database_replica_read_t *read;   // NULL when abandoned
+        database_replica_t *db;
+        size_t replica;
+
+        flist_db_batch_t entry;
+        uint64_t started;       // submission time (us)
+        int done;
+
+    } database_replica_attempt_t;
+
+    typedef struct database_replica_read_t {
+        database_replica_attempt_t **attempts;  // per replica, NULL when not asked
+        size_t asked;           // replicas asked
+        size_t inflight;        // attempts without reply
+        size_t failed;          // attempts failed
+
+        value_t *value;         // first value found
+        size_t winner;          // replica which sent it
+
+    } database_replica_read_t;
+
+#endif
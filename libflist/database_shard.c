@@ -0,0 +1,378 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <blake2.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "database.h"
+#include "database_shard.h"
+
+//
+// sharded database
+//
+// keys (chunks id) are spread over many databases (usually many zdb)
+// using consistent hashing: each shard owns DATABASE_SHARD_VNODES points
+// on a 64 bits ring, placed by hashing the shard identifier, a key belongs
+// to the shard owning the first point after the key hash
+//
+// placement only depends on the key and on the shards identifiers (not
+// on their order), any reader with the same list finds the same shard
+// and adding a shard only moves the keys landing on the new points
+//
+
+// 64 bits position on the ring, read as big endian
+// to keep placement independent of the architecture
+static uint64_t database_shard_hash(const void *buffer, size_t length) {
+    uint8_t hash[sizeof(uint64_t)];
+    uint64_t value = 0;
+
+    blake2b(hash, buffer, "", sizeof(hash), length, 0);
+
+    for(size_t i = 0; i < sizeof(hash); i++)
+        value = (value << 8) | hash[i];
+
+    return value;
+}
+
+static int database_shard_compare(const void *a, const void *b, void *userptr) {
+    database_shard_t *db = (database_shard_t *) userptr;
+    const database_shard_point_t *pa = (const database_shard_point_t *) a;
+    const database_shard_point_t *pb = (const database_shard_point_t *) b;
+
+    if(pa->point != pb->point)
+        return (pa->point < pb->point) ? -1 : 1;
+
+    // collision, keep the order stable using the identifiers
+    return strcmp(db->names[pa->shard], db->names[pb->shard]);
+}
+
+static int database_shard_ring(database_shard_t *db) {
+    db->points = db->count * DATABASE_SHARD_VNODES;
+
+    if(!(db->ring = malloc(sizeof(database_shard_point_t) * db->points))) {
+        libflist_errp("shard: ring: malloc");
+        return 1;
+    }
+
+    for(size_t shard = 0; shard < db->count; shard++) {
+        for(size_t vnode = 0; vnode < DATABASE_SHARD_VNODES; vnode++) {
+            database_shard_point_t *point = &db->ring[(shard * DATABASE_SHARD_VNODES) + vnode];
+            char *label;
+
+            if(asprintf(&label, "%s#%lu", db->names[shard], vnode) < 0) {
+                libflist_errp("shard: asprintf");
+                return 1;
+            }
+
+            point->point = database_shard_hash(label, strlen(label));
+            point->shard = shard;
+
+            free(label);
+        }
+    }
+
+    qsort_r(db->ring, db->points, sizeof(database_shard_point_t), database_shard_compare, db);
+
+    return 0;
+}
+
+static size_t database_shard_index(database_shard_t *db, uint8_t *key, size_t keylen) {
+    uint64_t hash = database_shard_hash(key, keylen);
+    size_t low = 0, high = db->points;
+
+    // first point greater or equal than the key hash
+    while(low < high) {
+        size_t middle = low + ((high - low) / 2);
+
+        if(db->ring[middle].point < hash)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+
+    // wrap around the ring
+    if(low == db->points)
+        low = 0;
+
+    return db->ring[low].shard;
+}
+
+static flist_db_t *database_shard_route(flist_db_t *database, uint8_t *key, size_t keylen) {
+    database_shard_t *db = (database_shard_t *) database->handler;
+    return db->shards[database_shard_index(db, key, keylen)];
+}
+
+//
+// database handlers
+//
+static flist_db_t *database_shard_open(flist_db_t *database) {
+    return database;
+}
+
+static void database_shard_free(database_shard_t *db) {
+    for(size_t i = 0; i < db->count; i++)
+        free(db->names[i]);
+
+    free(db->names);
+    free(db->shards);
+    free(db->ring);
+    free(db);
+}
+
+static void database_shard_close(flist_db_t *database) {
+    database_shard_t *db = (database_shard_t *) database->handler;
+
+    // shards are owned by the sharded database
+    for(size_t i = 0; i < db->count; i++)
+        db->shards[i]->close(db->shards[i]);
+
+    database_shard_free(db);
+    free(database);
+}
+
+static value_t *database_shard_get(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_t *shard = database_shard_route(database, key, keylen);
+    return shard->get(shard, key, keylen);
+}
+
+static int database_shard_set(flist_db_t *database, uint8_t *key, size_t keylen, uint8_t *payload, size_t length) {
+    flist_db_t *shard = database_shard_route(database, key, keylen);
+    return shard->set(shard, key, keylen, payload, length);
+}
+
+static int database_shard_exists(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_t *shard = database_shard_route(database, key, keylen);
+    return shard->exists(shard, key, keylen);
+}
+
+static int database_shard_del(flist_db_t *database, uint8_t *key, size_t keylen) {
+    flist_db_t *shard = database_shard_route(database, key, keylen);
+
+    if(!shard->del) {
+        libflist_set_error("shard: database doesn't support deletion");
+        return 1;
+    }
+
+    return shard->del(shard, key, keylen);
+}
+
+static value_t *database_shard_sget(flist_db_t *database, char *key) {
+    return database_shard_get(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_shard_sset(flist_db_t *database, char *key, uint8_t *payload, size_t length) {
+    return database_shard_set(database, (uint8_t *) key, strlen(key), payload, length);
+}
+
+static int database_shard_sexists(flist_db_t *database, char *key) {
+    return database_shard_exists(database, (uint8_t *) key, strlen(key));
+}
+
+static int database_shard_sdel(flist_db_t *database, char *key) {
+    return database_shard_del(database, (uint8_t *) key, strlen(key));
+}
+
+// metadata are placed like any other key
+static value_t *database_shard_mdget(flist_db_t *database, char *key) {
+    flist_db_t *shard = database_shard_route(database, (uint8_t *) key, strlen(key));
+
+    if(!shard->mdget)
+        return libflist_set_error("shard: database doesn't support metadata");
+
+    return shard->mdget(shard, key);
+}
+
+static int database_shard_mdset(flist_db_t *database, char *key, char *payload) {
+    flist_db_t *shard = database_shard_route(database, (uint8_t *) key, strlen(key));
+
+    if(!shard->mdset) {
+        libflist_set_error("shard: database doesn't support metadata");
+        return 1;
+    }
+
+    return shard->mdset(shard, key, payload);
+}
+
+static int database_shard_mddel(flist_db_t *database, char *key) {
+    flist_db_t *shard = database_shard_route(database, (uint8_t *) key, strlen(key));
+
+    if(!shard->mddel) {
+        libflist_set_error("shard: database doesn't support metadata");
+        return 1;
+    }
+
+    return shard->mddel(shard, key);
+}
+
+//
+// batch
+//
+// the batch is split per shard, each shard receives one batch
+// with only it's own entries, results are copied back in place
+//
+typedef int (*database_shard_batch_t)(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+
+static int database_shard_batch(flist_db_t *database, flist_db_batch_t *batch, size_t count, database_shard_batch_t handler) {
+    database_shard_t *db = (database_shard_t *) database->handler;
+    flist_db_batch_t *subset = NULL;
+    size_t *owner = NULL, *index = NULL;
+    int failed = 0;
+
+    if(count == 0)
+        return 0;
+
+    if(!(subset = malloc(count * sizeof(flist_db_batch_t))))
+        goto allocation;
+
+    if(!(owner = malloc(count * sizeof(size_t))) || !(index = malloc(count * sizeof(size_t))))
+        goto allocation;
+
+    for(size_t i = 0; i < count; i++)
+        owner[i] = database_shard_index(db, batch[i].key, batch[i].keylen);
+
+    for(size_t shard = 0; shard < db->count; shard++) {
+        size_t length = 0;
+
+        for(size_t i = 0; i < count; i++) {
+            if(owner[i] != shard)
+                continue;
+
+            subset[length] = batch[i];
+            index[length] = i;
+            length += 1;
+        }
+
+        if(length == 0)
+            continue;
+
+        debug("[+] libflist: shard: %s: %lu/%lu entries\n", db->names[shard], length, count);
+
+        failed |= handler(db->shards[shard], subset, length);
+
+        for(size_t i = 0; i < length; i++)
+            batch[index[i]] = subset[i];
+    }
+
+    free(subset);
+    free(owner);
+    free(index);
+
+    return failed;
+
+allocation:
+    libflist_errp("shard: batch: malloc");
+    free(subset);
+    free(owner);
+    free(index);
+
+    return 1;
+}
+
+static int database_shard_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_shard_batch(database, batch, count, libflist_db_mexists);
+}
+
+static int database_shard_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_shard_batch(database, batch, count, libflist_db_mset);
+}
+
+static int database_shard_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_shard_batch(database, batch, count, libflist_db_mget);
+}
+
+static int database_shard_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count) {
+    return database_shard_batch(database, batch, count, libflist_db_mcheck);
+}
+
+// each shard only contains it's own keys
+static int database_shard_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_shard_t *db = (database_shard_t *) database->handler;
+
+    for(size_t i = 0; i < db->count; i++)
+        if(libflist_db_scan(db->shards[i], callback, userptr))
+            return 1;
+
+    return 0;
+}
+
+// public sharded database initializer, shards and names are copied
+// but the sharded database owns the shards (closed with it)
+flist_db_t *libflist_db_shard_init(flist_db_t **shards, char **names, size_t count) {
+    database_shard_t *handler;
+    flist_db_t *db;
+
+    if(count == 0)
+        return libflist_set_error("shard: no shards provided");
+
+    for(size_t i = 0; i < count; i++) {
+        // values are released by the shard which fetched them,
+        // this only works if all shards release them the same way
+        if(shards[i]->clean != shards[0]->clean)
+            return libflist_set_error("shard: all shards need to use the same database type");
+
+        for(size_t j = 0; j < i; j++)
+            if(strcmp(names[i], names[j]) == 0)
+                return libflist_set_error("shard: duplicated shard: %s", names[i]);
+    }
+
+    if(!(handler = calloc(1, sizeof(database_shard_t))))
+        return libflist_errp("shard: calloc");
+
+    if(!(handler->shards = calloc(count, sizeof(flist_db_t *))) || !(handler->names = calloc(count, sizeof(char *)))) {
+        database_shard_free(handler);
+        return libflist_errp("shard: calloc");
+    }
+
+    handler->count = count;
+
+    for(size_t i = 0; i < count; i++) {
+        handler->shards[i] = shards[i];
+
+        if(!(handler->names[i] = strdup(names[i]))) {
+            database_shard_free(handler);
+            return libflist_errp("shard: strdup");
+        }
+    }
+
+    if(database_shard_ring(handler)) {
+        database_shard_free(handler);
+        return NULL;
+    }
+
+    debug("[+] libflist: shard: %lu shards, %lu points on the ring\n", handler->count, handler->points);
+
+    // allocate generic database object
+    if(!(db = calloc(1, sizeof(flist_db_t)))) {
+        database_shard_free(handler);
+        return libflist_errp("shard: calloc");
+    }
+
+    db->handler = handler;
+    db->type = "SHARD";
+
+    // fillin handlers
+    db->open = database_shard_open;
+    db->create = database_shard_open;
+    db->close = database_shard_close;
+    db->get = database_shard_get;
+    db->set = database_shard_set;
+    db->del = database_shard_del;
+    db->exists = database_shard_exists;
+    db->clean = shards[0]->clean;
+    db->sget = database_shard_sget;
+    db->sset = database_shard_sset;
+    db->sdel = database_shard_sdel;
+    db->sexists = database_shard_sexists;
+    db->mdget = database_shard_mdget;
+    db->mdset = database_shard_mdset;
+    db->mddel = database_shard_mddel;
+    db->mexists = database_shard_mexists;
+    db->mset = database_shard_mset;
+    db->mget = database_shard_mget;
+    db->mcheck = database_shard_mcheck;
+    db->scan = database_shard_scan;
+
+    return db;
+}
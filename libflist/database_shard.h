@@ -0,0 +1,25 @@
+#ifndef LIBFLIST_DATABASE_SHARD_H
+    #define LIBFLIST_DATABASE_SHARD_H
+
+    // amount of points each shard owns on the ring, more points
+    // spread keys more evenly between shards
+    #define DATABASE_SHARD_VNODES  128
+
+    // one point on the hash ring
+    typedef struct database_shard_point_t {
+        uint64_t point;     // position on the ring
+        size_t shard;       // shard owning keys up to this position
+
+    } database_shard_point_t;
+
+    typedef struct database_shard_t {
+        flist_db_t **shards;          // one database (connection) per shard
+        char **names;                 // shard identifier (placement on the ring)
+        size_t count;                 // amount of shards
+
+        database_shard_point_t *ring; // sorted ring points
+        size_t points;                // amount of points on the ring
+
+    } database_shard_t;
+
+#endif
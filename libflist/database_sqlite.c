@@ -10,12 +10,221 @@
 #include "database.h"
 #include "database_sqlite.h"
 
+//
+// profiles
+//
+// the default profile keeps sqlite defaults (rollback journal, full
+// sync) and the whole session in one transaction, the ingest profile
+// trades durability for speed while filling the workspace (a crash
+// loses the workspace anyway): no journal and no sync, large page
+// cache and mmap, and a commit every few writes to flush dirty pages
+// instead of keeping them all in memory, the read profile only
+// enlarges caches
+//
+static const char *database_sqlite_profiles[] = {
+    [FLIST_DB_PROFILE_DEFAULT] = "default",
+    [FLIST_DB_PROFILE_INGEST] = "ingest",
+    [FLIST_DB_PROFILE_READ] = "read",
+};
+
+const char *libflist_db_profile_name(flist_db_profile_t profile) {
+    return database_sqlite_profiles[profile];
+}
+
+int libflist_db_profile_parse(flist_db_profile_t *profile, const char *value) {
+    for(size_t i = 0; i < sizeof(database_sqlite_profiles) / sizeof(char *); i++) {
+        if(strcmp(database_sqlite_profiles[i], value))
+            continue;
+
+        *profile = (flist_db_profile_t) i;
+        return 0;
+    }
+
+    libflist_set_error("unknown database profile: %s", value);
+    return 1;
+}
+
+static void database_sqlite_pragma(database_sqlite_t *db, char *pragma) {
+    char *error = NULL;
+
+    debug("[+] libflist: sqlite: %s\n", pragma);
+
+    if(sqlite3_exec(db->db, pragma, NULL, NULL, &error) != SQLITE_OK) {
+        debug("[-] libflist: sqlite: %s: %s\n", pragma, error);
+        sqlite3_free(error);
+    }
+}
+
+// needs to be applied outside of any transaction (journal mode)
+static void database_sqlite_profile_apply(database_sqlite_t *db) {
+    char pragma[128];
+
+    // while opened for changes, the journal is a wal (except when
+    // ingesting), readers are not blocked and see the last commit
+    if(!db->readonly && db->profile != FLIST_DB_PROFILE_INGEST)
+        database_sqlite_pragma(db, "PRAGMA journal_mode = WAL;");
+
+    if(db->profile == FLIST_DB_PROFILE_DEFAULT)
+        return;
+
+    debug("[+] libflist: sqlite: using %s profile\n", libflist_db_profile_name(db->profile));
+
+    if(db->profile == FLIST_DB_PROFILE_INGEST) {
+        database_sqlite_pragma(db, "PRAGMA journal_mode = OFF;");
+        database_sqlite_pragma(db, "PRAGMA synchronous = OFF;");
+
+        snprintf(pragma, sizeof(pragma), "PRAGMA cache_size = -%d;", DATABASE_SQLITE_INGEST_CACHE);
+        database_sqlite_pragma(db, pragma);
+
+        snprintf(pragma, sizeof(pragma), "PRAGMA mmap_size = %lld;", DATABASE_SQLITE_INGEST_MMAP);
+        database_sqlite_pragma(db, pragma);
+    }
+
+    if(db->profile == FLIST_DB_PROFILE_READ) {
+        snprintf(pragma, sizeof(pragma), "PRAGMA cache_size = -%d;", DATABASE_SQLITE_READ_CACHE);
+        database_sqlite_pragma(db, pragma);
+
+        snprintf(pragma, sizeof(pragma), "PRAGMA mmap_size = %lld;", DATABASE_SQLITE_READ_MMAP);
+        database_sqlite_pragma(db, pragma);
+    }
+
+    database_sqlite_pragma(db, "PRAGMA temp_store = MEMORY;");
+}
+
+// called after each write, with the ingest profile the session
+// transaction is committed from time to time (dirty pages flushed)
+static void database_sqlite_written(database_sqlite_t *db) {
+    db->updated = 1;
+
+    if(db->profile != FLIST_DB_PROFILE_INGEST)
+        return;
+
+    if(++db->writes < DATABASE_SQLITE_INGEST_COMMIT)
+        return;
+
+    debug("[+] libflist: sqlite: ingest: committing %lu writes\n", db->writes);
+
+    sqlite3_exec(db->db, "COMMIT;", NULL, NULL, NULL);
+    sqlite3_exec(db->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+
+    db->writes = 0;
+}
+
+// first column of the first row of a query, as integer
+static int database_sqlite_integer(database_sqlite_t *db, char *query, int *value) {
+    sqlite3_stmt *stmt;
+
+    if(sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL) != SQLITE_OK) {
+        libflist_set_error("sqlite3_prepare_v2: %s: %s", query, sqlite3_errmsg(db->db));
+        return 1;
+    }
+
+    *value = (sqlite3_step(stmt) == SQLITE_ROW) ? sqlite3_column_int(stmt, 0) : 0;
+    sqlite3_finalize(stmt);
+
+    return 0;
+}
+
+//
+// schema
+//
+// v1 entries table is a rowid table with hex keys (text), v2 is a table
+// without rowid (lookup on one b-tree) where hash keys (lowercase hex)
+// are stored binary, half the size, any other key is kept as text (a
+// blob never equals a text), v2 databases have user_version set to 2
+//
+static int database_sqlite_schema_load(database_sqlite_t *db) {
+    int tables, version;
+
+    if(database_sqlite_integer(db, "SELECT count(*) FROM sqlite_master WHERE type = 'table' AND name = 'entries';", &tables))
+        return 1;
+
+    if(database_sqlite_integer(db, "PRAGMA user_version;", &version))
+        return 1;
+
+    db->schema = 0;
+
+    if(tables)
+        db->schema = (version == DATABASE_SQLITE_SCHEMA_V2) ? DATABASE_SQLITE_SCHEMA_V2 : DATABASE_SQLITE_SCHEMA_V1;
+
+    debug("[+] libflist: sqlite: entries schema: v%d\n", db->schema);
+
+    return 0;
+}
+
+static int database_sqlite_hexvalue(uint8_t c) {
+    if(c >= '0' && c <= '9')
+        return c - '0';
+
+    if(c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+
+    return -1;
+}
+
+// binary length of the key, 0 when the key is not a hash (kept as text)
+static size_t database_sqlite_key_encode(uint8_t *key, size_t keylen, uint8_t *buffer) {
+    if(keylen == 0 || keylen % 2 || keylen > DATABASE_SQLITE_KEY_MAX * 2)
+        return 0;
+
+    for(size_t i = 0; i < keylen; i += 2) {
+        int high = database_sqlite_hexvalue(key[i]);
+        int low = database_sqlite_hexvalue(key[i + 1]);
+
+        if(high < 0 || low < 0)
+            return 0;
+
+        buffer[i / 2] = (high << 4) | low;
+    }
+
+    return keylen / 2;
+}
+
+static void database_sqlite_bind_key(database_sqlite_t *db, sqlite3_stmt *stmt, uint8_t *key, size_t keylen) {
+    uint8_t binary[DATABASE_SQLITE_KEY_MAX];
+    size_t length;
+
+    if(db->schema == DATABASE_SQLITE_SCHEMA_V2 && (length = database_sqlite_key_encode(key, keylen, binary))) {
+        sqlite3_bind_blob(stmt, 1, binary, length, SQLITE_TRANSIENT);
+        return;
+    }
+
+    sqlite3_bind_text(stmt, 1, (char *) key, keylen, SQLITE_STATIC);
+}
+
+// sql function used to convert v1 keys
+static void database_sqlite_key_function(sqlite3_context *context, int argc, sqlite3_value **argv) {
+    uint8_t *key = (uint8_t *) sqlite3_value_text(argv[0]);
+    size_t keylen = sqlite3_value_bytes(argv[0]);
+    uint8_t binary[DATABASE_SQLITE_KEY_MAX];
+    size_t length;
+
+    (void) argc;
+
+    if((length = database_sqlite_key_encode(key, keylen, binary))) {
+        sqlite3_result_blob(context, binary, length, SQLITE_TRANSIENT);
+        return;
+    }
+
+    sqlite3_result_text(context, (char *) key, keylen, SQLITE_TRANSIENT);
+}
+
 static int database_sqlite_build(database_sqlite_t *db) {
+    char *entries[] = {
+        [DATABASE_SQLITE_SCHEMA_V1] = "CREATE TABLE IF NOT EXISTS entries (key VARCHAR(64) PRIMARY KEY, value BLOB);",
+        [DATABASE_SQLITE_SCHEMA_V2] = "CREATE TABLE IF NOT EXISTS entries (key BLOB PRIMARY KEY, value BLOB) WITHOUT ROWID;",
+    };
+
     char *queries[] = {
-        "CREATE TABLE IF NOT EXISTS entries (key VARCHAR(64) PRIMARY KEY, value BLOB);",
+        // new databases uses the selected schema (v2 by default), existing
+        // ones are kept as they are until converted (see upgrade)
+        entries[db->newschema],
         "CREATE TABLE IF NOT EXISTS metadata (key VARCHAR(64) PRIMARY KEY, value TEXT);",
     };
 
+    if(database_sqlite_schema_load(db))
+        return 1;
+
     //
     // entries table
     //
@@ -35,6 +244,15 @@ static int database_sqlite_build(database_sqlite_t *db) {
         sqlite3_finalize(value.handler);
     }
 
+    if(db->schema == 0) {
+        debug("[+] libflist: sqlite: new database, using schema v%d\n", db->newschema);
+
+        if(db->newschema == DATABASE_SQLITE_SCHEMA_V2)
+            sqlite3_exec(db->db, "PRAGMA user_version = 2;", NULL, NULL, NULL);
+
+        db->schema = db->newschema;
+    }
+
     // if the database is opened in creation mode
     // it's probably to do motification
     //
@@ -63,7 +281,7 @@ static int database_sqlite_optimize(flist_db_t *database) {
     // and memory usage
     struct __stmtop stmts[] = {
         {.target = &db->select, .query = "SELECT value FROM entries WHERE key = ?1"},
-        {.target = &db->insert, .query = "INSERT INTO entries (key, value) VALUES (?1, ?2)"},
+        {.target = &db->insert, .query = "REPLACE INTO entries (key, value) VALUES (?1, ?2)"},
         {.target = &db->delete, .query = "DELETE FROM entries WHERE key = ?1"},
         {.target = &db->mdget,  .query = "SELECT value FROM metadata WHERE key = ?1"},
         {.target = &db->mdset,  .query = "REPLACE INTO metadata (key, value) VALUES (?1, ?2)"},
@@ -82,20 +300,89 @@ static int database_sqlite_optimize(flist_db_t *database) {
     return 0;
 }
 
+// uri of the database file, special characters of
+// the path needs to be escaped (percent-encoding)
+static char *database_sqlite_uri(database_sqlite_t *db) {
+    char *options = (db->readonly == DATABASE_SQLITE_IMMUTABLE) ? "immutable=1" : "mode=ro";
+    char *uri, *writer;
+
+    if(!(uri = malloc(strlen(db->filename) * 3 + strlen(options) + 8)))
+        return libflist_errp("malloc");
+
+    writer = uri + sprintf(uri, "file:");
+
+    for(char *source = db->filename; *source; source++) {
+        if(*source == '%' || *source == '?' || *source == '#') {
+            writer += sprintf(writer, "%%%02X", (unsigned char) *source);
+            continue;
+        }
+
+        *writer++ = *source;
+    }
+
+    sprintf(writer, "?%s", options);
+
+    return uri;
+}
+
 static database_sqlite_t *database_sqlite_root_init(flist_db_t *database) {
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    char *uri;
+    int value;
 
-    if(sqlite3_open(db->filename, &db->db)) {
-        libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(db->db));
-        return NULL;
+    if(!db->readonly) {
+        if(sqlite3_open(db->filename, &db->db)) {
+            libflist_set_error("sqlite3_open: %s", sqlite3_errmsg(db->db));
+            return NULL;
+        }
+
+    } else {
+        if(!(uri = database_sqlite_uri(db)))
+            return NULL;
+
+        debug("[+] libflist: sqlite: opening read-only: %s\n", uri);
+
+        value = sqlite3_open_v2(uri, &db->db, SQLITE_OPEN_READONLY | SQLITE_OPEN_URI, NULL);
+        free(uri);
+
+        if(value != SQLITE_OK) {
+            libflist_set_error("sqlite3_open_v2: %s: %s", db->filename, sqlite3_errmsg(db->db));
+            return NULL;
+        }
     }
 
+    // readers wait for a writer committing (or switching journal)
+    // instead of failing, and the other way around
+    sqlite3_busy_timeout(db->db, DATABASE_SQLITE_BUSY_TIMEOUT);
+
+    // only applied on new databases (existing ones are converted by
+    // their next full vacuum), allows incremental compaction, needs
+    // to be set before anything is written (journal mode included)
+    if(!db->readonly)
+        database_sqlite_pragma(db, "PRAGMA auto_vacuum = INCREMENTAL;");
+
+    database_sqlite_profile_apply(db);
+
     return db;
 }
 
 static flist_db_t *database_sqlite_create(flist_db_t *database) {
-    database->handler = database_sqlite_root_init(database);
-    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    database_sqlite_t *db;
+
+    if(!(db = database_sqlite_root_init(database)))
+        return NULL;
+
+    // read-only databases are not changed at all (no schema
+    // nor session transaction), tables needs to exists
+    if(db->readonly) {
+        if(database_sqlite_schema_load(db))
+            return NULL;
+
+        if(db->select == NULL && database_sqlite_optimize(database))
+            return NULL;
+
+        return database;
+    }
 
     if(database_sqlite_build(db))
         return NULL;
@@ -114,18 +401,35 @@ static flist_db_t *database_sqlite_open(flist_db_t *database) {
 static void database_sqlite_close(flist_db_t *database) {
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
 
-    if(db->updated) {
-        debug("[+] libflist: sqlite: committing and compacting\n");
-
-        sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL);
-        sqlite3_exec(db->db, "VACUUM;", NULL, NULL, NULL);
-    }
-
     sqlite3_stmt *stmts[] = {
         db->select, db->insert, db->delete,
         db->mdget, db->mdset, db->mddel,
     };
 
+    // a statement not reset keeps a read transaction opened
+    for(size_t i = 0; i < sizeof(stmts) / sizeof(sqlite3_stmt *); i++)
+        sqlite3_reset(stmts[i]);
+
+    // any transaction still opened (session, ingest, compact or
+    // upgrade) needs to be committed, the journal can't be
+    // changed inside a transaction
+    if(!db->readonly && db->db && !sqlite3_get_autocommit(db->db)) {
+        debug("[+] libflist: sqlite: committing\n");
+        sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL);
+    }
+
+    // wal (or no journal) is only used while opened for changes, the
+    // database is left with the default journal (packed into the flist),
+    // this fails without waiting when readers are still there, the
+    // wal is then kept and switched back by the next writer
+    if(!db->readonly && db->db) {
+        sqlite3_busy_timeout(db->db, 0);
+        database_sqlite_pragma(db, "PRAGMA journal_mode = DELETE;");
+    }
+
+    // compaction is not done here (rewriting the whole database on each
+    // change is too slow), but once on commit, see libflist_db_sqlite_compact
+
     debug("[+] libflist: sqlite: cleaning context\n");
 
     for(size_t i = 0; i < sizeof(stmts) / sizeof(sqlite3_stmt *); i++)
@@ -152,7 +456,7 @@ static value_t *database_sqlite_get(flist_db_t *database, uint8_t *key, size_t k
     }
 
     sqlite3_reset(db->select);
-    sqlite3_bind_text(db->select, 1, (char *) key, keylen, SQLITE_STATIC);
+    database_sqlite_bind_key(db, db->select, key, keylen);
 
     int data = sqlite3_step(db->select);
 
@@ -184,7 +488,7 @@ static int database_sqlite_set(flist_db_t *database, uint8_t *key, size_t keylen
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
 
     sqlite3_reset(db->insert);
-    sqlite3_bind_text(db->insert, 1, (char *) key, keylen, SQLITE_STATIC);
+    database_sqlite_bind_key(db, db->insert, key, keylen);
     sqlite3_bind_blob(db->insert, 2, payload, length, SQLITE_STATIC);
 
     if(sqlite3_step(db->insert) != SQLITE_DONE) {
@@ -192,7 +496,7 @@ static int database_sqlite_set(flist_db_t *database, uint8_t *key, size_t keylen
         return 1;
     }
 
-    db->updated = 1;
+    database_sqlite_written(db);
 
     return 0;
 }
@@ -205,14 +509,14 @@ static int database_sqlite_del(flist_db_t *database, uint8_t *key, size_t keylen
     database_sqlite_t *db = (database_sqlite_t *) database->handler;
 
     sqlite3_reset(db->delete);
-    sqlite3_bind_text(db->delete, 1, (char *) key, keylen, SQLITE_STATIC);
+    database_sqlite_bind_key(db, db->delete, key, keylen);
 
     if(sqlite3_step(db->delete) != SQLITE_DONE) {
         libflist_set_error("del: sqlite3_step: %s", sqlite3_errmsg(db->db));
         return 1;
     }
 
-    db->updated = 1;
+    database_sqlite_written(db);
 
     return 0;
 }
@@ -267,7 +571,7 @@ static int database_sqlite_mdset(flist_db_t *database, char *key, char *payload)
         return 1;
     }
 
-    db->updated = 1;
+    database_sqlite_written(db);
 
     return 0;
 }
@@ -285,7 +589,7 @@ static int database_sqlite_mddel(flist_db_t *database, char *key) {
         return 1;
     }
 
-    db->updated = 1;
+    database_sqlite_written(db);
 
     return 0;
 }
@@ -308,16 +612,65 @@ static int database_sqlite_sexists(flist_db_t *database, char *key) {
     return database_sqlite_exists(database, (uint8_t *) key, strlen(key));
 }
 
+//
+// keys listing
+//
+static int database_sqlite_scan_query(database_sqlite_t *db, char *query, flist_db_scan_t callback, void *userptr) {
+    sqlite3_stmt *stmt;
+    int data, stopped = 0;
+
+    if(sqlite3_prepare_v2(db->db, query, -1, &stmt, NULL) != SQLITE_OK) {
+        libflist_set_error("scan: sqlite3_prepare_v2: %s: %s", query, sqlite3_errmsg(db->db));
+        return 1;
+    }
+
+    while((data = sqlite3_step(stmt)) == SQLITE_ROW) {
+        int type = sqlite3_column_type(stmt, 0);
+        uint8_t *key = (uint8_t *) sqlite3_column_text(stmt, 0);
+        size_t keylen = sqlite3_column_bytes(stmt, 0);
+        char hexkey[DATABASE_SQLITE_KEY_MAX * 2 + 1];
+
+        // binary keys (v2 schema) are listed as hex, like any database
+        if(type == SQLITE_BLOB && keylen <= DATABASE_SQLITE_KEY_MAX) {
+            libflist_hashhex_buffer(key, keylen, hexkey);
+            key = (uint8_t *) hexkey;
+            keylen *= 2;
+        }
+
+        // callback stopped the listing, error is set by the callback
+        if((stopped = callback(key, keylen, userptr)))
+            break;
+    }
+
+    if(!stopped && data != SQLITE_DONE)
+        libflist_set_error("scan: sqlite3_step: %s", sqlite3_errmsg(db->db));
+
+    sqlite3_finalize(stmt);
+
+    return (stopped || data != SQLITE_DONE);
+}
+
+static int database_sqlite_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    return database_sqlite_scan_query(db, "SELECT key FROM entries", callback, userptr);
+}
+
+static int database_sqlite_mdscan(flist_db_t *database, flist_db_scan_t callback, void *userptr) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+    return database_sqlite_scan_query(db, "SELECT key FROM metadata", callback, userptr);
+}
+
 // public sqlite function initializer
 flist_db_t *libflist_db_sqlite_init(char *rootpath) {
     flist_db_t *db;
 
     // allocate generic database object
-    if(!(db = malloc(sizeof(flist_db_t))))
+    // unsupported handlers (like batch) are kept NULL
+    if(!(db = calloc(1, sizeof(flist_db_t))))
         return NULL;
 
     // set our custom sqlite database handler
-    if(!(db->handler = malloc(sizeof(database_sqlite_t)))) {
+    if(!(db->handler = calloc(1, sizeof(database_sqlite_t)))) {
         free(db);
         return NULL;
     }
@@ -326,6 +679,12 @@ flist_db_t *libflist_db_sqlite_init(char *rootpath) {
 
     // setting the sqlite handler
     handler->root = rootpath;
+    handler->db = NULL;
+    handler->profile = FLIST_DB_PROFILE_DEFAULT;
+    handler->readonly = 0;
+    handler->schema = 0;
+    handler->newschema = DATABASE_SQLITE_SCHEMA_V2;
+    handler->writes = 0;
     handler->updated = 0;
 
     // database not optimized yet
@@ -358,6 +717,203 @@ flist_db_t *libflist_db_sqlite_init(char *rootpath) {
     db->mdget = database_sqlite_mdget;
     db->mdset = database_sqlite_mdset;
     db->mddel = database_sqlite_mddel;
+    db->scan = database_sqlite_scan;
+    db->mdscan = database_sqlite_mdscan;
 
     return db;
 }
+
+// select the database profile, before opening the database
+int libflist_db_sqlite_profile(flist_db_t *database, flist_db_profile_t profile) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+
+    if(strcmp(database->type, "SQLITE3")) {
+        libflist_set_error("profile: %s: only supported by sqlite databases", database->type);
+        return 1;
+    }
+
+    if(db->db) {
+        libflist_set_error("profile: database already opened");
+        return 1;
+    }
+
+    db->profile = profile;
+
+    return 0;
+}
+
+// open the database read-only, before opening it, the database is
+// never changed, with immutable, the file is not locked at all (no
+// one can change it, eg: extracted flist), otherwise concurrent
+// readers and writer (workspace) are fine
+int libflist_db_sqlite_readonly(flist_db_t *database, int immutable) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+
+    if(strcmp(database->type, "SQLITE3")) {
+        libflist_set_error("readonly: %s: only supported by sqlite databases", database->type);
+        return 1;
+    }
+
+    if(db->db) {
+        libflist_set_error("readonly: database already opened");
+        return 1;
+    }
+
+    db->readonly = immutable ? DATABASE_SQLITE_IMMUTABLE : DATABASE_SQLITE_READONLY;
+
+    return 0;
+}
+
+// select the entries schema (1 or 2) used if the database is created,
+// before opening it, existing databases keep their schema
+int libflist_db_sqlite_schema(flist_db_t *database, int version) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+
+    if(strcmp(database->type, "SQLITE3")) {
+        libflist_set_error("schema: %s: only supported by sqlite databases", database->type);
+        return 1;
+    }
+
+    if(db->db) {
+        libflist_set_error("schema: database already opened");
+        return 1;
+    }
+
+    if(version != DATABASE_SQLITE_SCHEMA_V1 && version != DATABASE_SQLITE_SCHEMA_V2) {
+        libflist_set_error("schema: unknown schema version: %d", version);
+        return 1;
+    }
+
+    db->newschema = version;
+
+    return 0;
+}
+
+// opened sqlite database which can be changed, statements still running
+// are reset (values previously fetched are not valid anymore)
+static database_sqlite_t *database_sqlite_writable(flist_db_t *database, char *action) {
+    database_sqlite_t *db = (database_sqlite_t *) database->handler;
+
+    if(strcmp(database->type, "SQLITE3")) {
+        libflist_set_error("%s: %s: only supported by sqlite databases", action, database->type);
+        return NULL;
+    }
+
+    if(!db->db) {
+        libflist_set_error("%s: database not opened", action);
+        return NULL;
+    }
+
+    if(db->readonly) {
+        libflist_set_error("%s: database opened read-only", action);
+        return NULL;
+    }
+
+    sqlite3_stmt *stmts[] = {
+        db->select, db->insert, db->delete,
+        db->mdget, db->mdset, db->mddel,
+    };
+
+    for(size_t i = 0; i < sizeof(stmts) / sizeof(sqlite3_stmt *); i++)
+        sqlite3_reset(stmts[i]);
+
+    return db;
+}
+
+// compact an opened database, a full vacuum rewrites it (smallest file),
+// an incremental vacuum only releases free pages (faster), when the
+// database supports it (auto_vacuum), a full vacuum is done otherwise
+int libflist_db_sqlite_compact(flist_db_t *database, int incremental) {
+    database_sqlite_t *db;
+    char *query = "VACUUM;";
+    char *error = NULL;
+    int intransaction;
+    int autovacuum;
+    int value = 0;
+
+    if(!(db = database_sqlite_writable(database, "compact")))
+        return 1;
+
+    if(incremental) {
+        if(database_sqlite_integer(db, "PRAGMA auto_vacuum;", &autovacuum))
+            return 1;
+
+        // 2: incremental
+        if(autovacuum == 2)
+            query = "PRAGMA incremental_vacuum;";
+    }
+
+    // vacuum can't run inside the session transaction
+    if((intransaction = !sqlite3_get_autocommit(db->db)))
+        sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL);
+
+    debug("[+] libflist: sqlite: compacting: %s\n", query);
+
+    if(sqlite3_exec(db->db, query, NULL, NULL, &error) != SQLITE_OK) {
+        libflist_set_error("compact: %s: %s", query, error);
+        sqlite3_free(error);
+        value = 1;
+    }
+
+    if(intransaction)
+        sqlite3_exec(db->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+
+    return value;
+}
+
+// convert the entries table of an opened database to the v2 schema,
+// the table is copied (keys converted) in one transaction, nothing
+// is done on a v2 database
+int libflist_db_sqlite_upgrade(flist_db_t *database) {
+    database_sqlite_t *db;
+    char *error = NULL;
+    int intransaction;
+    int value = 0;
+
+    char *queries[] = {
+        "CREATE TABLE entries_v2 (key BLOB PRIMARY KEY, value BLOB) WITHOUT ROWID;",
+        "INSERT INTO entries_v2 (key, value) SELECT flist_key(key), value FROM entries;",
+        "DROP TABLE entries;",
+        "ALTER TABLE entries_v2 RENAME TO entries;",
+        "PRAGMA user_version = 2;",
+    };
+
+    if(!(db = database_sqlite_writable(database, "upgrade")))
+        return 1;
+
+    if(db->schema == DATABASE_SQLITE_SCHEMA_V2)
+        return 0;
+
+    debug("[+] libflist: sqlite: converting entries to schema v2\n");
+
+    if(sqlite3_create_function(db->db, "flist_key", 1, SQLITE_UTF8 | SQLITE_DETERMINISTIC, NULL, database_sqlite_key_function, NULL, NULL) != SQLITE_OK) {
+        libflist_set_error("upgrade: sqlite3_create_function: %s", sqlite3_errmsg(db->db));
+        return 1;
+    }
+
+    // session changes are committed first, a failed
+    // conversion only rollback the conversion
+    if((intransaction = !sqlite3_get_autocommit(db->db)))
+        sqlite3_exec(db->db, "END TRANSACTION;", NULL, NULL, NULL);
+
+    sqlite3_exec(db->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+
+    for(size_t i = 0; i < sizeof(queries) / sizeof(char *); i++) {
+        if(sqlite3_exec(db->db, queries[i], NULL, NULL, &error) != SQLITE_OK) {
+            libflist_set_error("upgrade: %s: %s", queries[i], error);
+            sqlite3_free(error);
+            value = 1;
+            break;
+        }
+    }
+
+    sqlite3_exec(db->db, value ? "ROLLBACK;" : "COMMIT;", NULL, NULL, NULL);
+
+    if(!value)
+        db->schema = DATABASE_SQLITE_SCHEMA_V2;
+
+    if(intransaction)
+        sqlite3_exec(db->db, "BEGIN TRANSACTION;", NULL, NULL, NULL);
+
+    return value;
+}
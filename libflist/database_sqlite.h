@@ -3,11 +3,40 @@
 
     #include <sqlite3.h>
 
+    // ingest profile settings: page cache (KiB), memory mapped size
+    // and writes done before committing (flushes dirty pages)
+    #define DATABASE_SQLITE_INGEST_CACHE   (256 * 1024)
+    #define DATABASE_SQLITE_INGEST_MMAP    (1024 * 1024 * 1024LL)
+    #define DATABASE_SQLITE_INGEST_COMMIT  50000
+
+    // read profile settings
+    #define DATABASE_SQLITE_READ_CACHE     (64 * 1024)
+    #define DATABASE_SQLITE_READ_MMAP      (1024 * 1024 * 1024LL)
+
+    // time waiting for a locked database (ms)
+    #define DATABASE_SQLITE_BUSY_TIMEOUT   10000
+
+    // entries table schema (see database_sqlite.c), and
+    // largest key stored binary (v2)
+    #define DATABASE_SQLITE_SCHEMA_V1      1
+    #define DATABASE_SQLITE_SCHEMA_V2      2
+    #define DATABASE_SQLITE_KEY_MAX        32
+
+    // read-only access modes
+    #define DATABASE_SQLITE_READONLY       1
+    #define DATABASE_SQLITE_IMMUTABLE      2
+
     typedef struct database_sqlite_t {
         char *root;
         char *filename;
         sqlite3 *db;
 
+        flist_db_profile_t profile;
+        int readonly;       // read-only mode, 0 when opened for changes
+        int schema;         // entries schema, 0 until loaded
+        int newschema;      // entries schema of a new database
+        size_t writes;      // writes since last commit
+
         int updated;
         sqlite3_stmt *select;
         sqlite3_stmt *insert;
@@ -0,0 +1,189 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fts.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <zdict.h>
+#include "libflist.h"
+#include "verbose.h"
+#include "zero_chunk.h"
+
+#define DICTIONARY_CAPACITY      (110 * 1024)                 // zstd default dictionary size
+#define DICTIONARY_SAMPLES_SIZE  (100 * DICTIONARY_CAPACITY)  // samples budget (zstd advise ~100x)
+#define DICTIONARY_SAMPLES_MIN   16                           // not enough samples to train
+
+typedef struct dictionary_samples_t {
+    uint8_t *buffer;     // samples, concatenated
+    size_t *sizes;       // size of each sample
+    size_t count;        // amount of samples
+    size_t length;       // total samples length
+
+} dictionary_samples_t;
+
+flist_dictionary_t *libflist_dictionary_new(uint8_t *data, size_t length) {
+    flist_dictionary_t *dictionary;
+    uint8_t *hash;
+
+    if(!(dictionary = calloc(sizeof(flist_dictionary_t), 1)))
+        return libflist_errp("dictionary: calloc");
+
+    if(!(dictionary->data = libflist_bufdup(data, length))) {
+        free(dictionary);
+        return libflist_errp("dictionary: malloc");
+    }
+
+    dictionary->length = length;
+
+    // dictionary is saved into the flist database
+    // under the hash of it's contents
+    if(!(hash = libflist_chunk_hash(data, length))) {
+        libflist_dictionary_free(dictionary);
+        return NULL;
+    }
+
+    dictionary->key = libflist_hashhex(hash, ZEROCHUNK_HASH_LENGTH);
+    free(hash);
+
+    return dictionary;
+}
+
+void libflist_dictionary_free(flist_dictionary_t *dictionary) {
+    if(!dictionary)
+        return;
+
+    free(dictionary->data);
+    free(dictionary->key);
+    free(dictionary);
+}
+
+// walk over small regular files of a local directory, calling the callback
+// for each of them, returns the amount of files and their total size
+static size_t dictionary_walk(char *localdir, size_t *total, void (*callback)(FTSENT *, size_t, void *), void *userptr) {
+    char *ftsargv[2] = {localdir, NULL};
+    FTSENT *fentry = NULL;
+    size_t files = 0;
+    FTS *fs;
+
+    *total = 0;
+
+    if(!(fs = fts_open(ftsargv, FTS_NOCHDIR | FTS_PHYSICAL, NULL))) {
+        libflist_warnp(localdir);
+        return 0;
+    }
+
+    while((fentry = fts_read(fs))) {
+        if(fentry->fts_info != FTS_F)
+            continue;
+
+        if(fentry->fts_statp->st_size == 0 || fentry->fts_statp->st_size > FLIST_DICTIONARY_CHUNK_MAX)
+            continue;
+
+        if(callback)
+            callback(fentry, files, userptr);
+
+        files += 1;
+        *total += fentry->fts_statp->st_size;
+    }
+
+    fts_close(fs);
+
+    return files;
+}
+
+typedef struct dictionary_walker_t {
+    dictionary_samples_t *samples;
+    size_t stride;       // one file sampled every stride files
+    size_t budget;       // samples buffer allocated size
+    size_t capacity;     // samples sizes allocated
+
+} dictionary_walker_t;
+
+static void dictionary_sample(FTSENT *fentry, size_t index, void *userptr) {
+    dictionary_walker_t *walker = (dictionary_walker_t *) userptr;
+    dictionary_samples_t *samples = walker->samples;
+    size_t size = fentry->fts_statp->st_size;
+    FILE *fp;
+
+    if(index % walker->stride)
+        return;
+
+    if(samples->length + size > walker->budget || samples->count == walker->capacity)
+        return;
+
+    if(!(fp = fopen(fentry->fts_path, "r"))) {
+        libflist_warnp(fentry->fts_path);
+        return;
+    }
+
+    if(fread(samples->buffer + samples->length, size, 1, fp) == 1) {
+        samples->sizes[samples->count] = size;
+        samples->length += size;
+        samples->count += 1;
+    }
+
+    fclose(fp);
+}
+
+// train a zstd dictionary from a sample of the small files
+// of a local directory, files are spread evenly over the tree
+flist_dictionary_t *libflist_dictionary_train(char *localdir) {
+    flist_dictionary_t *dictionary = NULL;
+    dictionary_samples_t samples = {0};
+    dictionary_walker_t walker = {0};
+    uint8_t *trained = NULL;
+    size_t files, total, length;
+
+    debug("[+] libflist: dictionary: looking for samples in <%s>\n", localdir);
+
+    if((files = dictionary_walk(localdir, &total, NULL, NULL)) < DICTIONARY_SAMPLES_MIN) {
+        libflist_set_error("not enough small files to train a dictionary (%lu)", files);
+        return NULL;
+    }
+
+    // sampling one file every stride files keeps
+    // samples around the samples budget
+    walker.samples = &samples;
+    walker.budget = DICTIONARY_SAMPLES_SIZE;
+    walker.stride = (total / DICTIONARY_SAMPLES_SIZE) + 1;
+    walker.capacity = files;
+
+    if(!(samples.buffer = malloc(walker.budget)) || !(samples.sizes = malloc(sizeof(size_t) * files))) {
+        libflist_errp("dictionary: samples: malloc");
+        goto cleanup;
+    }
+
+    dictionary_walk(localdir, &total, dictionary_sample, &walker);
+
+    debug("[+] libflist: dictionary: training with %lu samples (%lu bytes, on %lu files)\n", samples.count, samples.length, files);
+
+    if(samples.count < DICTIONARY_SAMPLES_MIN) {
+        libflist_set_error("not enough samples to train a dictionary (%lu)", samples.count);
+        goto cleanup;
+    }
+
+    if(!(trained = malloc(DICTIONARY_CAPACITY))) {
+        libflist_errp("dictionary: malloc");
+        goto cleanup;
+    }
+
+    length = ZDICT_trainFromBuffer(trained, DICTIONARY_CAPACITY, samples.buffer, samples.sizes, samples.count);
+
+    if(ZDICT_isError(length)) {
+        libflist_set_error("dictionary training failed: %s", ZDICT_getErrorName(length));
+        goto cleanup;
+    }
+
+    debug("[+] libflist: dictionary: %lu bytes trained\n", length);
+
+    dictionary = libflist_dictionary_new(trained, length);
+
+cleanup:
+    free(trained);
+    free(samples.buffer);
+    free(samples.sizes);
+
+    return dictionary;
+}
@@ -272,6 +272,34 @@ dirnode_t *flist_dirnode_get_recursive(flist_db_t *database, char *path) {
     return root;
 }
 
+// walk over all the files below a directory (one directory loaded
+// at a time) and call the callback for each chunk of each file,
+// walking stops as soon as the callback returns non-zero
+int flist_dirnode_chunks_walk(flist_db_t *database, char *path, flist_chunk_walk_t callback, void *userptr) {
+    dirnode_t *root;
+    int value = 0;
+
+    if(!(root = flist_dirnode_get(database, path)))
+        return 1;
+
+    for(inode_t *inode = root->inode_list; inode && !value; inode = inode->next) {
+        if(inode->type == INODE_DIRECTORY) {
+            value = flist_dirnode_chunks_walk(database, inode->fullpath, callback, userptr);
+            continue;
+        }
+
+        if(inode->type != INODE_FILE || !inode->chunks)
+            continue;
+
+        for(size_t i = 0; i < inode->chunks->size && !value; i++)
+            value = callback(inode, &inode->chunks->list[i], userptr);
+    }
+
+    flist_dirnode_free(root);
+
+    return value;
+}
+
 dirnode_t *flist_dirnode_get_parent(flist_db_t *database, dirnode_t *root) {
     discard char *copypath = strdup(root->fullpath);
     char *parent = dirname(copypath);
@@ -320,3 +348,7 @@ dirnode_t *libflist_dirnode_appends_inode(dirnode_t *root, inode_t *inode) {
 dirnode_t *libflist_dirnode_get_parent(flist_db_t *database, dirnode_t *root) {
     return flist_dirnode_get_parent(database, root);
 }
+
+int libflist_dirnode_chunks_walk(flist_db_t *database, char *path, flist_chunk_walk_t callback, void *userptr) {
+    return flist_dirnode_chunks_walk(database, path, callback, userptr);
+}
@@ -14,6 +14,7 @@
     dirnode_t *flist_dirnode_from_inode(inode_t *inode);
     dirnode_t *flist_dirnode_search(dirnode_t *root, char *dirname);
     dirnode_t *flist_dirnode_get(flist_db_t *database, char *path);
+    int flist_dirnode_chunks_walk(flist_db_t *database, char *path, flist_chunk_walk_t callback, void *userptr);
     dirnode_t *flist_dirnode_get_recursive(flist_db_t *database, char *path);
     dirnode_t *flist_dirnode_get_parent(flist_db_t *database, dirnode_t *root);
 
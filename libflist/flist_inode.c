@@ -290,6 +290,29 @@ static int fts_compare(const FTSENT **one, const FTSENT **two) {
     return (strcmp((*one)->fts_name, (*two)->fts_name));
 }
 
+// train the flist compression dictionary on the directory contents
+// when dictionary compression is requested and none exists yet, without
+// dictionary, chunks are compressed with plain zstd
+static void flist_localdir_dictionary(char *localdir, flist_ctx_t *ctx) {
+    flist_dictionary_t *dictionary;
+
+    if(ctx->compressor.type != FLIST_COMPRESSION_ZSTD_DICT || ctx->compressor.dictionary)
+        return;
+
+    if(!(dictionary = libflist_dictionary_train(localdir))) {
+        debug("[-] libflist: localdir: dictionary: %s\n", libflist_strerror());
+        return;
+    }
+
+    if(!libflist_metadata_dictionary_set(ctx->db, dictionary)) {
+        debug("[-] libflist: localdir: dictionary could not be saved\n");
+        libflist_dictionary_free(dictionary);
+        return;
+    }
+
+    ctx->compressor.dictionary = dictionary;
+}
+
 inode_t *flist_inode_from_localdir(char *localreldir, dirnode_t *parent, flist_ctx_t *ctx) {
     discard char *localdir = NULL;
     struct stat sb;
@@ -312,6 +335,8 @@ inode_t *flist_inode_from_localdir(char *localreldir, dirnode_t *parent, flist_c
         return NULL;
     }
 
+    flist_localdir_dictionary(localdir, ctx);
+
     // recursively add file and directories
     FTS* fs = NULL;
     FTSENT *fentry = NULL;
@@ -44,6 +44,17 @@ char *flist_clean_path(char *path) {
     return strndup(path + offset, length);
 }
 
+// downloaded chunks are verified and uncompressed with the flist
+// settings (hash, dictionary) loaded into the context compressor
+flist_ctx_t *flist_context_set_backend(flist_ctx_t *ctx, flist_backend_t *backend) {
+    ctx->backend = backend;
+
+    if(backend)
+        backend->compressor = &ctx->compressor;
+
+    return ctx;
+}
+
 flist_ctx_t *flist_context_create(flist_db_t *db, flist_backend_t *backend) {
     flist_ctx_t *ctx;
 
@@ -51,11 +62,15 @@ flist_ctx_t *flist_context_create(flist_db_t *db, flist_backend_t *backend) {
         diep("malloc");
 
     ctx->db = db;
-    ctx->backend = backend;
 
     // init stats to zero
     memset(&ctx->stats, 0x00, sizeof(flist_stats_t));
 
+    // default chunks compression (snappy)
+    memset(&ctx->compressor, 0x00, sizeof(flist_compressor_t));
+
+    flist_context_set_backend(ctx, backend);
+
     // disable progression report
     ctx->userptr = NULL;
     ctx->progress_cb = NULL;
@@ -71,6 +86,7 @@ flist_ctx_t *flist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*c
 }
 
 void flist_context_free(flist_ctx_t *ctx) {
+    libflist_dictionary_free(ctx->compressor.dictionary);
     free(ctx);
 }
 
@@ -110,6 +126,10 @@ void libflist_context_free(flist_ctx_t *ctx) {
     flist_context_free(ctx);
 }
 
+flist_ctx_t *libflist_context_set_backend(flist_ctx_t *ctx, flist_backend_t *backend) {
+    return flist_context_set_backend(ctx, backend);
+}
+
 flist_ctx_t *libflist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*cb)(void *, flist_progress_t *)) {
     return flist_context_set_progress(ctx, userptr, cb);
 }
@@ -0,0 +1,219 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <blake2.h>
+#include "libflist.h"
+#include "verbose.h"
+
+//
+// backend inventory
+//
+// keys found on a database are listed once and kept in a bloom filter,
+// sized for INVENTORY_BITS_PER_KEY bits per key (~1% false positive with
+// INVENTORY_HASHES hashes), with some room for keys added later (uploaded
+// chunks), a key not found is certainly not on the database, a key found
+// needs to be confirmed by the database
+//
+// keys are hashed to a 64 bits fingerprint, bits positions are derived
+// from the fingerprint (double hashing), while listing the database,
+// only fingerprints are collected, the filter is built when the amount
+// of keys is known
+//
+// the same filter is used to keep the set of chunks referenced by many
+// flists (garbage collection), with a fixed memory size: a chunk not
+// in the set is certainly not referenced, false positives only keep
+// some garbage on the backend
+//
+#define INVENTORY_BITS_PER_KEY  10
+#define INVENTORY_HASHES        7
+#define INVENTORY_ROOM          65536   // minimum amount of keys which can be added
+
+typedef struct inventory_collect_t {
+    uint64_t *fingerprints;
+    size_t length;
+    size_t allocated;
+
+} inventory_collect_t;
+
+static uint64_t inventory_fingerprint(uint8_t *key, size_t keylen) {
+    uint8_t hash[sizeof(uint64_t)];
+    uint64_t value = 0;
+
+    blake2b(hash, key, "", sizeof(hash), keylen, 0);
+
+    for(size_t i = 0; i < sizeof(hash); i++)
+        value = (value << 8) | hash[i];
+
+    return value;
+}
+
+// second hash derived from the fingerprint (splitmix64 finalizer)
+// forced odd to visit different bits on each round
+static uint64_t inventory_step(uint64_t fingerprint) {
+    fingerprint ^= fingerprint >> 30;
+    fingerprint *= 0xbf58476d1ce4e5b9ULL;
+    fingerprint ^= fingerprint >> 27;
+    fingerprint *= 0x94d049bb133111ebULL;
+    fingerprint ^= fingerprint >> 31;
+
+    return fingerprint | 1;
+}
+
+static void inventory_insert(flist_inventory_t *inventory, uint64_t fingerprint) {
+    uint64_t step = inventory_step(fingerprint);
+
+    for(int i = 0; i < inventory->hashes; i++) {
+        uint64_t bit = (fingerprint + (i * step)) % inventory->length;
+        inventory->bits[bit / 8] |= (1 << (bit % 8));
+    }
+
+    inventory->keys += 1;
+}
+
+static int inventory_lookup(flist_inventory_t *inventory, uint64_t fingerprint) {
+    uint64_t step = inventory_step(fingerprint);
+
+    for(int i = 0; i < inventory->hashes; i++) {
+        uint64_t bit = (fingerprint + (i * step)) % inventory->length;
+
+        if(!(inventory->bits[bit / 8] & (1 << (bit % 8))))
+            return 0;
+    }
+
+    return 1;
+}
+
+static int inventory_collect(uint8_t *key, size_t keylen, void *userptr) {
+    inventory_collect_t *collect = (inventory_collect_t *) userptr;
+
+    if(collect->length == collect->allocated) {
+        uint64_t *fingerprints;
+        size_t allocated = collect->allocated ? collect->allocated * 2 : INVENTORY_ROOM;
+
+        if(!(fingerprints = realloc(collect->fingerprints, sizeof(uint64_t) * allocated))) {
+            libflist_errp("inventory: realloc");
+            return 1;
+        }
+
+        collect->fingerprints = fingerprints;
+        collect->allocated = allocated;
+    }
+
+    collect->fingerprints[collect->length++] = inventory_fingerprint(key, keylen);
+
+    return 0;
+}
+
+static flist_inventory_t *inventory_alloc(size_t length) {
+    flist_inventory_t *inventory;
+
+    if(!(inventory = calloc(1, sizeof(flist_inventory_t))))
+        return libflist_errp("inventory: calloc");
+
+    inventory->length = length;
+    inventory->hashes = INVENTORY_HASHES;
+
+    if(!(inventory->bits = calloc((inventory->length / 8) + 1, 1))) {
+        free(inventory);
+        return libflist_errp("inventory: calloc");
+    }
+
+    return inventory;
+}
+
+flist_inventory_t *libflist_inventory_snapshot(flist_db_t *database) {
+    inventory_collect_t collect = {0};
+    flist_inventory_t *inventory;
+    size_t capacity;
+
+    debug("[+] libflist: inventory: listing database keys\n");
+
+    if(libflist_db_scan(database, inventory_collect, &collect)) {
+        free(collect.fingerprints);
+        return NULL;
+    }
+
+    // room for half more keys (chunks uploaded afterward)
+    capacity = collect.length + (collect.length / 2) + INVENTORY_ROOM;
+
+    if(!(inventory = inventory_alloc(capacity * INVENTORY_BITS_PER_KEY))) {
+        free(collect.fingerprints);
+        return NULL;
+    }
+
+    for(size_t i = 0; i < collect.length; i++)
+        inventory_insert(inventory, collect.fingerprints[i]);
+
+    free(collect.fingerprints);
+
+    debug("[+] libflist: inventory: %lu keys, %.2f MB filter\n", inventory->keys, inventory->length / 8 / (1024.0 * 1024.0));
+
+    return inventory;
+}
+
+int libflist_inventory_contains(flist_inventory_t *inventory, uint8_t *key, size_t keylen) {
+    return inventory_lookup(inventory, inventory_fingerprint(key, keylen));
+}
+
+void libflist_inventory_add(flist_inventory_t *inventory, uint8_t *key, size_t keylen) {
+    inventory_insert(inventory, inventory_fingerprint(key, keylen));
+}
+
+// empty inventory using a fixed amount of memory (bytes), keys are
+// added later, the false positive rate grows with the amount of keys
+flist_inventory_t *libflist_inventory_new(size_t memory) {
+    if(memory == 0)
+        return libflist_set_error("inventory: memory size needs to be positive");
+
+    debug("[+] libflist: inventory: %.2f MB filter, ~%lu keys at 1%% false positive\n",
+          memory / (1024.0 * 1024.0), (memory * 8) / INVENTORY_BITS_PER_KEY);
+
+    return inventory_alloc(memory * 8);
+}
+
+// false positive rate, from the ratio of bits set
+double libflist_inventory_error_rate(flist_inventory_t *inventory) {
+    size_t bytes = (inventory->length / 8) + 1;
+    size_t set = 0;
+    double filled, rate = 1.0;
+
+    for(size_t i = 0; i < bytes; i++)
+        set += __builtin_popcount(inventory->bits[i]);
+
+    filled = (double) set / inventory->length;
+
+    for(int i = 0; i < inventory->hashes; i++)
+        rate *= filled;
+
+    return rate;
+}
+
+static int inventory_reference(inode_t *inode, inode_chunk_t *chunk, void *userptr) {
+    (void) inode;
+
+    libflist_inventory_add((flist_inventory_t *) userptr, chunk->entryid, chunk->entrylen);
+
+    return 0;
+}
+
+// add every chunk referenced by an flist (files blocks) to the inventory,
+// only one directory of the flist is loaded at a time
+int libflist_inventory_flist(flist_inventory_t *inventory, flist_db_t *database) {
+    size_t before = inventory->keys;
+
+    if(libflist_dirnode_chunks_walk(database, "/", inventory_reference, inventory))
+        return 1;
+
+    debug("[+] libflist: inventory: %lu chunks referenced by the flist\n", inventory->keys - before);
+
+    return 0;
+}
+
+void libflist_inventory_free(flist_inventory_t *inventory) {
+    if(!inventory)
+        return;
+
+    free(inventory->bits);
+    free(inventory);
+}
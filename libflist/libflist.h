@@ -100,6 +100,10 @@
 
     } dirnode_t;
 
+    // called for each chunk of each file when walking an flist,
+    // returning non-zero stops the walk
+    typedef int (*flist_chunk_walk_t)(inode_t *inode, inode_chunk_t *chunk, void *userptr);
+
 
 
     typedef struct flist_db_value_t {
@@ -110,6 +114,27 @@
 
     } value_t;
 
+    // one entry of a batch operation (mexists, mset, mget)
+    typedef struct flist_db_batch_t {
+        uint8_t *key;       // entry key
+        size_t keylen;      // entry key length
+        uint8_t *data;      // payload to set (mset)
+        size_t datalen;     // payload length (mset)
+
+        int exists;         // entry found (mexists), -1 when corrupted (mcheck)
+        value_t *value;     // entry fetched, NULL if not found (mget)
+
+    } flist_db_batch_t;
+
+    // completion of an asynchronous operation, entry results (exists,
+    // value) are filled like for batch operations, status is 0 on success
+    struct flist_db_t;
+    typedef void (*flist_db_callback_t)(struct flist_db_t *db, flist_db_batch_t *entry, int status, void *userptr);
+
+    // called for each key found when listing a database, returning
+    // non-zero stops the listing and makes it fail (error set by the callback)
+    typedef int (*flist_db_scan_t)(uint8_t *key, size_t keylen, void *userptr);
+
     typedef struct flist_db_t {
         void *handler;
         char *type;
@@ -132,20 +157,89 @@
         int (*mdset)(struct flist_db_t *db, char *key, char *data);
         int (*mddel)(struct flist_db_t *db, char *key);
 
+        // batch operations, entries are sent together (pipelined
+        // when the database supports it), unsupported handlers are NULL
+        // and libflist_db_* falls back to one call per entry
+        int (*mexists)(struct flist_db_t *db, flist_db_batch_t *batch, size_t count);
+        int (*mset)(struct flist_db_t *db, flist_db_batch_t *batch, size_t count);
+        int (*mget)(struct flist_db_t *db, flist_db_batch_t *batch, size_t count);
+
+        // batch verification, like mexists but the server also checks
+        // the payload integrity when it can (zdb CHECK), without
+        // moving the payload, NULL falls back to mexists
+        int (*mcheck)(struct flist_db_t *db, flist_db_batch_t *batch, size_t count);
+
+        // asynchronous operations, callbacks are called from the database
+        // event loop (during another asynchronous call or wait), the entry
+        // needs to stay valid until completion, wait returns when nothing
+        // is in flight anymore, unsupported handlers are NULL and
+        // libflist_db_* falls back to synchronous calls
+        int (*get_async)(struct flist_db_t *db, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+        int (*set_async)(struct flist_db_t *db, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+        int (*exists_async)(struct flist_db_t *db, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+        int (*wait)(struct flist_db_t *db);
+
+        // event loop of asynchronous databases, to wait on many of them
+        // at once: loopfd is readable when events are waiting, process
+        // handles them (calling callbacks) without blocking
+        int (*loopfd)(struct flist_db_t *db);
+        int (*process)(struct flist_db_t *db);
+
+        // list all the keys of the database (entries, metadata),
+        // unsupported handlers are NULL
+        int (*scan)(struct flist_db_t *db, flist_db_scan_t callback, void *userptr);
+        int (*mdscan)(struct flist_db_t *db, flist_db_scan_t callback, void *userptr);
+
         void (*clean)(value_t *value);
 
     } flist_db_t;
 
+    // amount of keys copied by libflist_db_copy
+    typedef struct flist_db_copy_t {
+        size_t entries;     // entries keys (directories, acl, ...)
+        size_t bytes;       // entries payload length
+        size_t metadata;    // metadata keys
+
+    } flist_db_copy_t;
+
     typedef enum flist_db_type_t {
         SQLITE3,
         REDIS,
 
     } flist_db_type_t;
 
+    // sqlite database tuning, selected before opening it
+    typedef enum flist_db_profile_t {
+        FLIST_DB_PROFILE_DEFAULT,  // rollback journal, one transaction for the session
+        FLIST_DB_PROFILE_INGEST,   // no journal nor sync, large cache and mmap, periodic commits
+        FLIST_DB_PROFILE_READ,     // large cache and mmap
+
+    } flist_db_profile_t;
+
+    // snapshot of the keys available on a backend (bloom filter), a key
+    // not in the inventory is certainly not on the backend (when the
+    // snapshot was taken), a key in the inventory is probably there
+    typedef struct flist_inventory_t {
+        uint8_t *bits;
+        size_t length;     // amount of bits
+        size_t keys;       // amount of keys added
+        int hashes;        // amount of bits set per key
+
+    } flist_inventory_t;
+
     typedef struct flist_backend_t {
         flist_db_t *database;
         char *rootpath;
 
+        // optional keys snapshot used to skip existence
+        // check of chunks certainly not on the backend
+        flist_inventory_t *inventory;
+
+        // flist settings (chunks hash and dictionary) used to verify and
+        // uncompress downloaded chunks, linked to the context compressor
+        // when attached to a context, NULL uses the defaults
+        struct flist_compressor_t *compressor;
+
     } flist_backend_t;
 
     typedef struct flist_backend_data_t {
@@ -181,6 +275,124 @@
 
     } flist_chunk_t;
 
+    // maximum amount of chunks encrypted together
+    #define FLIST_CHUNK_BATCH  8
+
+    // chunks compression
+    //
+    // snappy is the historical compression, snappy chunks are not tagged
+    // (chunk key is the 16 bytes payload hash), any other compression
+    // appends a one byte compression tag to the key
+    typedef enum flist_compression_t {
+        FLIST_COMPRESSION_SNAPPY = 0,
+        FLIST_COMPRESSION_STORE = 1,
+        FLIST_COMPRESSION_ZSTD = 2,
+        FLIST_COMPRESSION_LZ4 = 3,
+        FLIST_COMPRESSION_ZSTD_DICT = 4,
+
+    } flist_compression_t;
+
+    // zstd dictionary trained on small files of an flist
+    //
+    // the dictionary is saved as an entry of the flist database, the
+    // entry key is set on FLIST_METADATA_DICTIONARY, chunks compressed
+    // with the dictionary are tagged FLIST_COMPRESSION_ZSTD_DICT
+    typedef struct flist_dictionary_t {
+        uint8_t *data;    // raw zstd dictionary
+        size_t length;    // dictionary length
+        char *key;        // flist database entry key
+
+    } flist_dictionary_t;
+
+    #define FLIST_METADATA_DICTIONARY   "dictionary"
+
+    // files up to this size are dictionary samples
+    // and their chunks are compressed with the dictionary
+    #define FLIST_DICTIONARY_CHUNK_MAX  (64 * 1024)
+
+    // chunks encryption
+    //
+    // xxtea is the historical encryption, aead ciphers authenticate the
+    // payload and are recorded in the high bits of the key tag, the
+    // compression uses the low bits
+    typedef enum flist_cipher_t {
+        FLIST_CIPHER_XXTEA = 0,
+        FLIST_CIPHER_AES256GCM = 1,
+        FLIST_CIPHER_CHACHA20POLY1305 = 2,
+
+    } flist_cipher_t;
+
+    // chunks hash
+    //
+    // hash used to compute chunks key (plain payload) and id (encrypted
+    // payload), this is an flist setting, recorded in the flist metadata
+    // (FLIST_METADATA_HASH, blake2b when not set), all the chunks of one
+    // flist uses the same hash
+    typedef enum flist_hash_t {
+        FLIST_HASH_BLAKE2B = 0,
+        FLIST_HASH_BLAKE3 = 1,
+
+    } flist_hash_t;
+
+    #define FLIST_METADATA_HASH  "hash"
+
+    // chunk key maximum length (payload hash and compression/cipher tag)
+    #define FLIST_CHUNK_KEY_MAXLENGTH  17
+
+    typedef struct flist_compressor_t {
+        flist_compression_t type;   // compression used for new chunks
+        int level;                  // compression level (zstd), 0 for default
+        int sampling;               // store chunks which looks incompressible
+        flist_cipher_t cipher;      // encryption used for new chunks
+        flist_hash_t hash;          // chunks key and id hash (flist setting)
+        flist_dictionary_t *dictionary;  // zstd dictionary (flist setting, NULL if none)
+
+    } flist_compressor_t;
+
+    // reusable chunk encoder/decoder context
+    //
+    // the codec owns scratch buffers reused from one chunk to
+    // the next one, once buffers reached the chunk size, processing
+    // chunks doesn't allocate anything anymore
+    //
+    // a codec must not be shared between threads, use
+    // libflist_chunk_codec_thread to get a per-thread codec
+    typedef struct flist_chunk_codec_t {
+        uint8_t *encrypted;      // compression and encryption scratch buffer
+        size_t encryptedsize;    // encryption scratch buffer allocated size
+        uint8_t *plain;          // decrypted payload buffer
+        size_t plainsize;        // decrypted payload buffer allocated size
+
+        // scratch codecs used by the other chunks of a batch
+        // (the codec itself is used by the first one), created on demand
+        struct flist_chunk_codec_t *lanes[FLIST_CHUNK_BATCH - 1];
+
+        flist_compressor_t compressor;     // compression used to encrypt (snappy by default)
+        struct ZSTD_CCtx_s *zcompress;     // zstd compression context (created on demand)
+        struct ZSTD_DCtx_s *zdecompress;   // zstd decompression context (created on demand)
+        struct evp_cipher_ctx_st *aead;    // openssl aead context (created on demand)
+
+        // zstd dictionary digested for compression and decompression
+        // (created on demand), kept until the dictionary changes
+        struct ZSTD_CDict_s *zcdict;
+        unsigned int zcdictid;
+        int zcdictlevel;
+        struct ZSTD_DDict_s *zddict;
+        unsigned int zddictid;
+
+    } flist_chunk_codec_t;
+
+    // one chunk of an encryption batch
+    typedef struct flist_chunk_job_t {
+        const uint8_t *data;       // plain payload
+        size_t length;             // plain payload length
+        uint8_t *id;               // chunk id (caller memory, filled)
+        uint8_t *key;              // chunk key (caller memory, FLIST_CHUNK_KEY_MAXLENGTH bytes, filled)
+        size_t keylen;             // chunk key length (filled)
+        flist_buffer_t encrypted;  // encrypted payload (codec memory, filled)
+
+    } flist_chunk_job_t;
+
     typedef struct flist_chunks_t {
         size_t upsize;  // uploaded size
         size_t length;  // amount of chunks
@@ -200,6 +412,7 @@
         flist_db_t *db;
         flist_backend_t *backend;
         flist_stats_t stats;
+        flist_compressor_t compressor;
 
         void *userptr;
         int (*progress_cb)(void *userptr, flist_progress_t *progress);
@@ -224,6 +437,7 @@
     void libflist_debug_enable(int enable);
 
     char *libflist_hashhex(unsigned char *hash, int length);
+    char *libflist_hashhex_buffer(unsigned char *hash, int length, char *buffer);
     void *libflist_bufdup(void *source, size_t length);
 
     //
@@ -249,11 +463,39 @@
     flist_chunks_t *libflist_backend_upload_inode(flist_backend_t *backend, char *path, char *filename);
     int libflist_backend_upload_chunk(flist_backend_t *context, flist_chunk_t *chunk);
     int libflist_backend_chunk_commit(flist_backend_t *context, flist_chunk_t *chunk);
+    int libflist_backend_chunks_commit(flist_backend_t *context, flist_chunk_t *chunks, size_t count);
+    int libflist_backend_chunks_missing(flist_backend_t *context, inode_chunks_t *chunks);
+    int libflist_backend_chunks_invalid(flist_backend_t *context, inode_chunks_t *chunks);
+    int libflist_backend_inventory(flist_backend_t *context);
 
     flist_chunk_t *libflist_backend_download_chunk(flist_backend_t *backend, flist_chunk_t *chunk);
+    flist_chunk_t *libflist_backend_download_chunk_codec(flist_backend_t *backend, flist_chunk_codec_t *codec, flist_chunk_t *chunk);
 
     void libflist_backend_chunks_free(flist_chunks_t *chunks);
 
+    //
+    // database.c
+    //
+    //   batch operations on any database, using the database batch
+    //   handlers when available, one call per entry otherwise, keys
+    //   listing and bulk copy of a database into another one
+    //
+    int libflist_db_mexists(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+    int libflist_db_mset(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+    int libflist_db_mget(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+    int libflist_db_mcheck(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+    void libflist_db_batch_clean(flist_db_t *database, flist_db_batch_t *batch, size_t count);
+
+    int libflist_db_get_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+    int libflist_db_set_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+    int libflist_db_exists_async(flist_db_t *database, flist_db_batch_t *entry, flist_db_callback_t callback, void *userptr);
+    int libflist_db_wait(flist_db_t *database);
+
+    int libflist_db_scan(flist_db_t *database, flist_db_scan_t callback, void *userptr);
+    int libflist_db_mdscan(flist_db_t *database, flist_db_scan_t callback, void *userptr);
+
+    int libflist_db_copy(flist_db_t *source, flist_db_t *target, flist_db_copy_t *summary);
+
     //
     // database_redis.c
     //
@@ -262,6 +504,15 @@
     //
     flist_db_t *libflist_db_redis_init_tcp(char *host, int port, char *hset, char *password, char *token);
     flist_db_t *libflist_db_redis_init_unix(char *socket, char *namespace, char *password, char *token);
+    int libflist_db_redis_hash(flist_db_t *database);
+
+    //
+    // database_redis_async.c
+    //
+    //   same as redis, but non-blocking, with a built-in event loop, many
+    //   operations (up to window, 0 for default) can be in flight on one connection
+    //
+    flist_db_t *libflist_db_redis_async_init_tcp(char *host, int port, char *namespace, char *password, char *token, size_t window);
 
     //
     // database_sqlite.c
@@ -270,6 +521,62 @@
     //   flist metadata and entries
     //
     flist_db_t *libflist_db_sqlite_init(char *rootpath);
+    int libflist_db_sqlite_profile(flist_db_t *database, flist_db_profile_t profile);
+    int libflist_db_sqlite_readonly(flist_db_t *database, int immutable);
+    int libflist_db_sqlite_schema(flist_db_t *database, int version);
+    int libflist_db_sqlite_compact(flist_db_t *database, int incremental);
+    int libflist_db_sqlite_upgrade(flist_db_t *database);
+
+    int libflist_db_profile_parse(flist_db_profile_t *profile, const char *value);
+    const char *libflist_db_profile_name(flist_db_profile_t profile);
+
+    //
+    // database_cache.c
+    //
+    //   local disk cache (content-addressed, lru eviction) in front of
+    //   any other database, mostly used in front of a remote backend
+    //
+    flist_db_t *libflist_db_cache_init(flist_db_t *remote, char *rootpath, size_t maxsize);
+    flist_db_t *libflist_db_cache_local_init(flist_db_t *remote, flist_db_t *local);
+
+    //
+    // database_pack.c
+    //
+    //   local append-only pack files with a mmap'd hash index, no server
+    //   needed, usable as backend or as local storage of a cache
+    //
+    flist_db_t *libflist_db_pack_init(char *rootpath);
+
+    //
+    // inventory.c
+    //
+    //   in-memory snapshot (bloom filter) of keys found on a database,
+    //   used to avoid existence round-trip for keys not there
+    //
+    flist_inventory_t *libflist_inventory_snapshot(flist_db_t *database);
+    int libflist_inventory_contains(flist_inventory_t *inventory, uint8_t *key, size_t keylen);
+    void libflist_inventory_add(flist_inventory_t *inventory, uint8_t *key, size_t keylen);
+    void libflist_inventory_free(flist_inventory_t *inventory);
+
+    flist_inventory_t *libflist_inventory_new(size_t memory);
+    int libflist_inventory_flist(flist_inventory_t *inventory, flist_db_t *database);
+    double libflist_inventory_error_rate(flist_inventory_t *inventory);
+
+    //
+    // database_shard.c
+    //
+    //   spread keys over many databases (one connection each) using
+    //   consistent hashing on the key, shards are placed by their name
+    //
+    flist_db_t *libflist_db_shard_init(flist_db_t **shards, char **names, size_t count);
+
+    //
+    // database_replica.c
+    //
+    //   same keys on many asynchronous databases, reads are sent to the
+    //   fastest replica and hedged to the next one when the reply is late
+    //
+    flist_db_t *libflist_db_replica_init(flist_db_t **replicas, char **names, size_t count);
 
     //
     // zero_chunk.c
@@ -281,17 +588,38 @@
     inode_chunks_t *libflist_chunks_proceed(char *localfile, flist_ctx_t *ctx);
 
     uint8_t *libflist_chunk_hash(const void *buffer, size_t length);
+    int libflist_chunk_hash_batch(flist_buffer_t *buffers, uint8_t **hashes, size_t count);
 
     flist_chunk_t *libflist_chunk_new(uint8_t *hash, uint8_t *key, void *data, size_t length);
     flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize);
     flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk);
+    flist_chunk_t *libflist_chunk_decrypt_with(flist_chunk_t *chunk, flist_compressor_t *compressor);
 
     void libflist_chunk_free(flist_chunk_t *chunk);
 
+    flist_chunk_codec_t *libflist_chunk_codec_new();
+    flist_chunk_codec_t *libflist_chunk_codec_thread();
+    void libflist_chunk_codec_free(flist_chunk_codec_t *codec);
+
+    int libflist_compressor_parse(flist_compressor_t *compressor, const char *value);
+    const char *libflist_compression_name(flist_compression_t type);
+    int libflist_cipher_parse(flist_compressor_t *compressor, const char *value);
+    const char *libflist_cipher_name(flist_cipher_t cipher);
+    int libflist_hash_parse(flist_compressor_t *compressor, const char *value);
+    const char *libflist_hash_name(flist_hash_t hash);
+
+    int libflist_chunk_codec_encrypt(flist_chunk_codec_t *codec, const uint8_t *data, size_t length, uint8_t *id, uint8_t *key, size_t *keylen, flist_buffer_t *encrypted);
+    int libflist_chunk_codec_encrypt_batch(flist_chunk_codec_t *codec, flist_chunk_job_t *jobs, size_t count);
+    int libflist_chunk_codec_decrypt(flist_chunk_codec_t *codec, const uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain);
+    int libflist_chunk_codec_decrypt_inplace(flist_chunk_codec_t *codec, uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain);
+    int libflist_chunk_codec_decrypt_with(flist_chunk_codec_t *codec, flist_compressor_t *compressor, const uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain);
+    int libflist_chunk_codec_decrypt_inplace_with(flist_chunk_codec_t *codec, flist_compressor_t *compressor, uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain);
+
     //
     // flist_tools.c
     //
     flist_ctx_t *libflist_context_create(flist_db_t *db, flist_backend_t *backend);
+    flist_ctx_t *libflist_context_set_backend(flist_ctx_t *ctx, flist_backend_t *backend);
     flist_ctx_t *libflist_context_set_progress(flist_ctx_t *ctx, void *userptr, int (*cb)(void *, flist_progress_t *));
     void libflist_context_free(flist_ctx_t *ctx);
 
@@ -320,6 +648,8 @@
     void libflist_dirnode_free(dirnode_t *dirnode);
     void libflist_dirnode_free_recursive(dirnode_t *dirnode);
 
+    int libflist_dirnode_chunks_walk(flist_db_t *database, char *path, flist_chunk_walk_t callback, void *userptr);
+
     //
     // flist_inode.c
     //
@@ -336,6 +666,15 @@
 
     void libflist_inode_free(inode_t *inode);
 
+    //
+    // dictionary.c
+    //
+    //   zstd dictionary training, from small files of a local directory
+    //
+    flist_dictionary_t *libflist_dictionary_new(uint8_t *data, size_t length);
+    flist_dictionary_t *libflist_dictionary_train(char *localdir);
+    void libflist_dictionary_free(flist_dictionary_t *dictionary);
+
     //
     // flist_merger.c
     //
@@ -359,6 +698,10 @@
     int libflist_metadata_set(flist_db_t *database, char *metadata, char *payload);
     int libflist_metadata_remove(flist_db_t *database, char *metadata);
     char *libflist_metadata_get(flist_db_t *database, char *metadata);
+    int libflist_metadata_hash_load(flist_db_t *database, flist_compressor_t *compressor);
+    int libflist_metadata_hash_set(flist_db_t *database, flist_hash_t hash);
+    int libflist_metadata_dictionary_load(flist_db_t *database, flist_compressor_t *compressor);
+    int libflist_metadata_dictionary_set(flist_db_t *database, flist_dictionary_t *dictionary);
     flist_db_t *libflist_metadata_backend_database(flist_db_t *database);
     flist_db_t *libflist_metadata_backend_database_json(char *input);
 
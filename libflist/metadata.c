@@ -8,6 +8,12 @@
 #include "verbose.h"
 
 int libflist_metadata_set(flist_db_t *database, char *metadata, char *payload) {
+    // replicated and asynchronous databases don't keep metadata
+    if(!database->mdset) {
+        libflist_set_error("database (%s) doesn't support metadata", database->type);
+        return 0;
+    }
+
     if(database->mdset(database, metadata, payload)) {
         debug("[-] libflist: metadata: set: %s\n", libflist_strerror());
         return 0;
@@ -18,7 +24,15 @@ int libflist_metadata_set(flist_db_t *database, char *metadata, char *payload) {
 }
 
 char *libflist_metadata_get(flist_db_t *database, char *metadata) {
-    value_t *rawdata = database->mdget(database, metadata);
+    value_t *rawdata;
+
+    if(!database->mdget) {
+        libflist_set_error("database (%s) doesn't support metadata", database->type);
+        return NULL;
+    }
+
+    if(!(rawdata = database->mdget(database, metadata)))
+        return NULL;
 
     if(!rawdata->data) {
         debug("[-] libflist: metadata: get: metadata not found\n");
@@ -36,6 +50,11 @@ char *libflist_metadata_get(flist_db_t *database, char *metadata) {
 }
 
 int libflist_metadata_remove(flist_db_t *database, char *metadata) {
+    if(!database->mddel) {
+        libflist_set_error("database (%s) doesn't support metadata", database->type);
+        return 0;
+    }
+
     if(database->mddel(database, metadata)) {
         debug("[-] libflist: metadata: del: %s\n", libflist_strerror());
         return 0;
@@ -45,30 +64,236 @@ int libflist_metadata_remove(flist_db_t *database, char *metadata) {
     return 1;
 }
 
-flist_db_t *libflist_metadata_backend_database_json(char *input) {
-    flist_db_t *backdb;
-    json_error_t error;
-    json_t *backend = json_loads(input, 0, &error);
+// load chunks hash of an flist into the compressor
+// flist without hash metadata uses blake2b
+int libflist_metadata_hash_load(flist_db_t *database, flist_compressor_t *compressor) {
+    char *value;
 
-    if(!backend) {
-        libflist_set_error("backend json could not be parsed");
+    if(!(value = libflist_metadata_get(database, FLIST_METADATA_HASH))) {
+        compressor->hash = FLIST_HASH_BLAKE2B;
+        return 1;
+    }
+
+    // value is owned by the database backend
+    if(libflist_hash_parse(compressor, value)) {
+        debug("[-] libflist: metadata: hash: %s\n", libflist_strerror());
+        return 0;
+    }
+
+    return 1;
+}
+
+// set chunks hash of an flist, this needs to be done before
+// adding any file, all chunks of an flist uses the same hash
+int libflist_metadata_hash_set(flist_db_t *database, flist_hash_t hash) {
+    if(hash == FLIST_HASH_BLAKE2B)
+        return libflist_metadata_remove(database, FLIST_METADATA_HASH);
+
+    return libflist_metadata_set(database, FLIST_METADATA_HASH, (char *) libflist_hash_name(hash));
+}
+
+// load zstd dictionary of an flist into the compressor
+// flist without dictionary metadata doesn't use any dictionary
+int libflist_metadata_dictionary_load(flist_db_t *database, flist_compressor_t *compressor) {
+    flist_dictionary_t *dictionary;
+    value_t *value;
+    char *key;
+
+    // key is owned by the database backend
+    if(!(key = libflist_metadata_get(database, FLIST_METADATA_DICTIONARY)))
+        return 1;
+
+    value = database->sget(database, key);
+
+    if(!value->data) {
+        libflist_set_error("dictionary entry not found: %s", key);
+        database->clean(value);
+        return 0;
+    }
+
+    dictionary = libflist_dictionary_new((uint8_t *) value->data, value->length);
+    database->clean(value);
+
+    if(dictionary && strcmp(dictionary->key, key)) {
+        libflist_set_error("dictionary entry corrupted: %s", key);
+        libflist_dictionary_free(dictionary);
+        dictionary = NULL;
+    }
+
+    if(!dictionary)
+        return 0;
+
+    debug("[+] libflist: metadata: dictionary loaded (%lu bytes)\n", dictionary->length);
+
+    libflist_dictionary_free(compressor->dictionary);
+    compressor->dictionary = dictionary;
+
+    return 1;
+}
+
+// save zstd dictionary as an flist entry and reference it from metadata
+int libflist_metadata_dictionary_set(flist_db_t *database, flist_dictionary_t *dictionary) {
+    if(!database->sexists(database, dictionary->key)) {
+        if(database->sset(database, dictionary->key, dictionary->data, dictionary->length)) {
+            debug("[-] libflist: metadata: dictionary: %s\n", libflist_strerror());
+            return 0;
+        }
+    }
+
+    return libflist_metadata_set(database, FLIST_METADATA_DICTIONARY, dictionary->key);
+}
+
+// redis-compatible backends uses plain keys, unless "hash": true
+// requests keys inside the namespace hash
+static flist_db_t *metadata_backend_redis_hash(json_t *backend, flist_db_t *backdb) {
+    if(!json_is_true(json_object_get(backend, "hash")))
+        return backdb;
+
+    if(libflist_db_redis_hash(backdb)) {
+        backdb->close(backdb);
         return NULL;
     }
 
+    return backdb;
+}
+
+static flist_db_t *metadata_backend_redis(json_t *backend) {
     char *host = (char *) json_string_value(json_object_get(backend, "host"));
     char *namespace = (char *) json_string_value(json_object_get(backend, "namespace"));
     char *password = (char *) json_string_value(json_object_get(backend, "password"));
     char *token = (char *) json_string_value(json_object_get(backend, "token"));
     int port = json_integer_value(json_object_get(backend, "port"));
+    flist_db_t *backdb;
 
     debug("[+] libflist: backend: %s, %d (ns: %s)\n", host, port, namespace);
     debug("[+] libflist: backend: password: %s, token: %s\n", password ? "yes" : "no", token ? "yes" : "no");
 
-    if(!(backdb = libflist_db_redis_init_tcp(host, port, namespace, password, token))) {
-        json_decref(backend);
+    if(!(backdb = libflist_db_redis_init_tcp(host, port, namespace, password, token)))
         return NULL;
+
+    return metadata_backend_redis_hash(backend, backdb);
+}
+
+// replica connection, asynchronous (replicas are read together)
+static flist_db_t *metadata_backend_redis_async(json_t *backend) {
+    char *host = (char *) json_string_value(json_object_get(backend, "host"));
+    char *namespace = (char *) json_string_value(json_object_get(backend, "namespace"));
+    char *password = (char *) json_string_value(json_object_get(backend, "password"));
+    char *token = (char *) json_string_value(json_object_get(backend, "token"));
+    int port = json_integer_value(json_object_get(backend, "port"));
+    flist_db_t *backdb;
+
+    debug("[+] libflist: backend: replica: %s, %d (ns: %s)\n", host, port, namespace);
+
+    if(!(backdb = libflist_db_redis_async_init_tcp(host, port, namespace, password, token, 0)))
+        return NULL;
+
+    return metadata_backend_redis_hash(backend, backdb);
+}
+
+typedef flist_db_t *(*metadata_backend_group_t)(flist_db_t **backends, char **names, size_t count);
+
+// sharded backend: {"shards": [{"host": ..., "port": ...}, ...]}
+// each shard is identified by it's "host:port/namespace", this
+// identifier decides which keys the shard owns
+//
+// replicated backend: {"replicas": [{"host": ..., "port": ...}, ...]}
+// the same namespace on each replica, identified the same way
+static flist_db_t *metadata_backend_group(json_t *list, char *kind, int async, metadata_backend_group_t initializer) {
+    size_t count = json_array_size(list);
+    flist_db_t **backends = NULL;
+    flist_db_t *backdb = NULL;
+    char **names = NULL;
+    char reason[sizeof(libflist_internal_error)];
+    size_t index, length = 0;
+    json_t *node;
+
+    if(count == 0)
+        return libflist_set_error("backend json: empty %s list", kind);
+
+    if(!(backends = calloc(count, sizeof(flist_db_t *))) || !(names = calloc(count, sizeof(char *)))) {
+        libflist_errp("backend: calloc");
+        goto cleanup;
     }
 
+    json_array_foreach(list, index, node) {
+        char *host = (char *) json_string_value(json_object_get(node, "host"));
+        char *namespace = (char *) json_string_value(json_object_get(node, "namespace"));
+        int port = json_integer_value(json_object_get(node, "port"));
+
+        if(!host) {
+            libflist_set_error("backend json: %s %lu: host missing", kind, index);
+            goto cleanup;
+        }
+
+        if(asprintf(&names[length], "%s:%d/%s", host, port, namespace ? namespace : "") < 0) {
+            names[length] = NULL;
+            libflist_errp("backend: asprintf");
+            goto cleanup;
+        }
+
+        if((backends[length] = async ? metadata_backend_redis_async(node) : metadata_backend_redis(node))) {
+            length += 1;
+            continue;
+        }
+
+        // each shard owns it's own keys, but any replica
+        // can be missing, the other ones have the keys
+        if(!async)
+            goto cleanup;
+
+        // the reason is kept as last error, the replicated
+        // database still works without this replica
+        snprintf(reason, sizeof(reason), "%s", libflist_strerror());
+        libflist_set_error("backend: %s: %s, replica ignored", names[length], reason);
+        debug("[-] libflist: %s\n", libflist_strerror());
+
+        free(names[length]);
+        names[length] = NULL;
+    }
+
+    // all replicas ignored, the last reason is kept
+    if(length == 0)
+        goto cleanup;
+
+    // the sharded (or replicated) database owns the backends now
+    if((backdb = initializer(backends, names, length)))
+        memset(backends, 0, count * sizeof(flist_db_t *));
+
+cleanup:
+    for(size_t i = 0; i < count && backends; i++)
+        if(backends[i])
+            backends[i]->close(backends[i]);
+
+    for(size_t i = 0; i < count && names; i++)
+        free(names[i]);
+
+    free(backends);
+    free(names);
+
+    return backdb;
+}
+
+flist_db_t *libflist_metadata_backend_database_json(char *input) {
+    flist_db_t *backdb;
+    json_error_t error;
+    json_t *backend = json_loads(input, 0, &error);
+    json_t *shards, *replicas, *pack;
+
+    if(!backend) {
+        libflist_set_error("backend json could not be parsed");
+        return NULL;
+    }
+
+    if((shards = json_object_get(backend, "shards")) && json_is_array(shards))
+        backdb = metadata_backend_group(shards, "shards", 0, libflist_db_shard_init);
+    else if((replicas = json_object_get(backend, "replicas")) && json_is_array(replicas))
+        backdb = metadata_backend_group(replicas, "replicas", 1, libflist_db_replica_init);
+    else if((pack = json_object_get(backend, "pack")) && json_is_string(pack))
+        backdb = libflist_db_pack_init((char *) json_string_value(pack));
+    else
+        backdb = metadata_backend_redis(backend);
+
     json_decref(backend);
 
     return backdb;
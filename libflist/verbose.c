@@ -74,18 +74,30 @@ void libflist_warns(const char *str) {
 // hex dumps
 static char __hex[] = "0123456789abcdef";
 
-char *libflist_hashhex(unsigned char *hash, int length) {
-    char *buffer = calloc((length * 2) + 1, sizeof(char));
+// write hex representation into a caller buffer
+// buffer needs to be at least (length * 2) + 1 bytes
+char *libflist_hashhex_buffer(unsigned char *hash, int length, char *buffer) {
     char *writer = buffer;
 
-    for(int i = 0, j = 0; i < length; i++, j += 2) {
+    for(int i = 0; i < length; i++) {
         *writer++ = __hex[(hash[i] & 0xF0) >> 4];
         *writer++ = __hex[hash[i] & 0x0F];
     }
 
+    *writer = '\0';
+
     return buffer;
 }
 
+char *libflist_hashhex(unsigned char *hash, int length) {
+    char *buffer;
+
+    if(!(buffer = calloc((length * 2) + 1, sizeof(char))))
+        return NULL;
+
+    return libflist_hashhex_buffer(hash, length, buffer);
+}
+
 // duplicate a buffer
 void *libflist_bufdup(void *source, size_t length) {
     void *buffer;
@@ -249,6 +249,427 @@ static uint8_t * xxtea_ubyte_decrypt(const uint8_t * data, size_t len, const uin
     return out;
 }
 
+// convert (in place) a buffer of little endian bytes into native words
+// (and vice versa, the operation is symmetric), no-op on little endian hosts
+static void xxtea_native_words(uint32_t * data, size_t len) {
+#if defined(BYTE_ORDER) && (BYTE_ORDER == LITTLE_ENDIAN)
+    (void) data;
+    (void) len;
+#else
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        uint8_t *b = (uint8_t *)&data[i];
+        data[i] = (uint32_t)b[0] | ((uint32_t)b[1] << 8) | ((uint32_t)b[2] << 16) | ((uint32_t)b[3] << 24);
+    }
+#endif
+}
+
+static void xxtea_key_array(const uint8_t * key, uint32_t * key_array) {
+    memcpy(key_array, key, 16);
+    xxtea_native_words(key_array, 4);
+}
+
+// multi-buffer kernels
+//
+// several independent buffers are processed in lock step, one buffer
+// per vector lane, each lane keeps its own position, round and key
+// so buffers of different length can be mixed in the same pass
+//
+// words are loaded 8 by 8 on each lane and transposed, so the mixing
+// of 8 consecutive steps runs on registers, output is identical to the
+// scalar code
+#if defined(__GNUC__)
+#define XXTEA_MULTI 1
+#define XXTEA_LANES 8
+
+typedef uint32_t xxtea_vec_t __attribute__((vector_size(XXTEA_LANES * sizeof(uint32_t))));
+
+#ifdef __clang__
+#define XXTEA_SHUFFLE(a, b, ...) __builtin_shufflevector(a, b, __VA_ARGS__)
+#else
+#define XXTEA_SHUFFLE(a, b, ...) __builtin_shuffle(a, b, (xxtea_vec_t){__VA_ARGS__})
+#endif
+
+#define XXTEA_VEC_MX(z, y, sum, k) \
+    ((((z) >> 5) ^ ((y) << 2)) + (((y) >> 3) ^ ((z) << 4))) ^ (((sum) ^ (y)) + ((k) ^ (z)))
+
+typedef struct xxtea_lanes_t {
+    xxtea_job_t * job[XXTEA_LANES];   // job processed by the lane (NULL when idle)
+    uint32_t * data[XXTEA_LANES];     // first word of the buffer
+    uint32_t * cur[XXTEA_LANES];      // current word
+    uint32_t inc[XXTEA_LANES];        // 1 when lane is active, 0 when idle
+    uint32_t n[XXTEA_LANES];          // last word index
+    uint32_t p[XXTEA_LANES];          // current word index
+    uint32_t q[XXTEA_LANES];          // remaining rounds
+
+    xxtea_vec_t z, y, x, sum, e, vp;
+    xxtea_vec_t key[4];
+
+    uint32_t idle[XXTEA_LANES * 2];   // target of idle lanes
+
+} xxtea_lanes_t;
+
+// key word used by each lane, @offset steps after the current one
+static inline __attribute__((always_inline)) void xxtea_vec_key(xxtea_lanes_t * l, uint32_t offset, xxtea_vec_t * k) {
+    xxtea_vec_t index = ((l->vp + offset) & 3) ^ l->e;
+    xxtea_vec_t low = -(index & 1);
+    xxtea_vec_t high = -((index >> 1) & 1);
+    xxtea_vec_t k01 = (l->key[0] & ~low) | (l->key[1] & low);
+    xxtea_vec_t k23 = (l->key[2] & ~low) | (l->key[3] & low);
+
+    *k = (k01 & ~high) | (k23 & high);
+}
+
+// 8x8 words transpose, rows (one per lane) become columns (one per step)
+static inline __attribute__((always_inline)) void xxtea_vec_transpose(xxtea_vec_t * r) {
+    xxtea_vec_t t[8], u[8];
+    int i;
+
+    for (i = 0; i < 8; i += 2) {
+        t[i] = XXTEA_SHUFFLE(r[i], r[i + 1], 0, 8, 1, 9, 4, 12, 5, 13);
+        t[i + 1] = XXTEA_SHUFFLE(r[i], r[i + 1], 2, 10, 3, 11, 6, 14, 7, 15);
+    }
+
+    for (i = 0; i < 8; i += 4) {
+        u[i] = XXTEA_SHUFFLE(t[i], t[i + 2], 0, 1, 8, 9, 4, 5, 12, 13);
+        u[i + 1] = XXTEA_SHUFFLE(t[i], t[i + 2], 2, 3, 10, 11, 6, 7, 14, 15);
+        u[i + 2] = XXTEA_SHUFFLE(t[i + 1], t[i + 3], 0, 1, 8, 9, 4, 5, 12, 13);
+        u[i + 3] = XXTEA_SHUFFLE(t[i + 1], t[i + 3], 2, 3, 10, 11, 6, 7, 14, 15);
+    }
+
+    for (i = 0; i < 4; i++) {
+        r[i] = XXTEA_SHUFFLE(u[i], u[i + 4], 0, 1, 2, 3, 8, 9, 10, 11);
+        r[i + 4] = XXTEA_SHUFFLE(u[i], u[i + 4], 4, 5, 6, 7, 12, 13, 14, 15);
+    }
+}
+
+// pick next job with something to do (at least two words)
+static xxtea_job_t * xxtea_multi_next(xxtea_job_t * jobs, size_t count, size_t * next) {
+    while (*next < count) {
+        xxtea_job_t * job = &jobs[(*next)++];
+
+        if (job->status == 0 && (job->out_len >> 2) > 1)
+            return job;
+    }
+
+    return NULL;
+}
+
+static void xxtea_multi_idle(xxtea_lanes_t * l, int i, int encrypt) {
+    l->job[i] = NULL;
+    l->data[i] = l->idle;
+    l->cur[i] = encrypt ? l->idle : l->idle + XXTEA_LANES;
+    l->inc[i] = 0;
+    l->n[i] = UINT32_MAX;
+    l->p[i] = encrypt ? 0 : UINT32_MAX;
+    l->q[i] = 0;
+}
+
+static void xxtea_multi_assign(xxtea_lanes_t * l, int i, xxtea_job_t * job, int encrypt) {
+    uint32_t key[4];
+    uint32_t * data = (uint32_t *) job->buffer;
+    uint32_t n = (uint32_t)(job->out_len >> 2) - 1;
+    uint32_t q = 6 + 52 / (n + 1);
+    int j;
+
+    xxtea_key_array((const uint8_t *) job->key, key);
+
+    l->job[i] = job;
+    l->data[i] = data;
+    l->inc[i] = 1;
+    l->n[i] = n;
+    l->q[i] = q;
+
+    for (j = 0; j < 4; j++)
+        l->key[j][i] = key[j];
+
+    if (encrypt) {
+        l->cur[i] = data;
+        l->p[i] = 0;
+        l->z[i] = data[n];
+        l->x[i] = data[0];
+        l->sum[i] = DELTA;
+
+    } else {
+        l->cur[i] = data + n;
+        l->p[i] = n;
+        l->y[i] = data[0];
+        l->x[i] = data[n];
+        l->sum[i] = q * DELTA;
+    }
+
+    l->vp[i] = l->p[i];
+    l->e[i] = l->sum[i] >> 2 & 3;
+}
+
+static size_t xxtea_multi_init(xxtea_lanes_t * l, xxtea_job_t * jobs, size_t count, size_t * next, int encrypt) {
+    size_t active = 0;
+    int i;
+
+    memset(l, 0, sizeof(xxtea_lanes_t));
+
+    for (i = 0; i < XXTEA_LANES; i++) {
+        xxtea_job_t * job = xxtea_multi_next(jobs, count, next);
+
+        if (job) {
+            xxtea_multi_assign(l, i, job, encrypt);
+            active += 1;
+
+        } else xxtea_multi_idle(l, i, encrypt);
+    }
+
+    return active;
+}
+
+// lane reached the end of its round, returns 1 when lane became idle
+static int xxtea_multi_round(xxtea_lanes_t * l, int i, xxtea_job_t * jobs, size_t count, size_t * next, int encrypt) {
+    if (--l->q[i] == 0) {
+        xxtea_job_t * job = xxtea_multi_next(jobs, count, next);
+
+        if (job) {
+            xxtea_multi_assign(l, i, job, encrypt);
+            return 0;
+        }
+
+        xxtea_multi_idle(l, i, encrypt);
+        return 1;
+    }
+
+    if (encrypt) {
+        l->sum[i] += DELTA;
+        l->cur[i] = l->data[i];
+        l->p[i] = 0;
+
+    } else {
+        l->sum[i] -= DELTA;
+        l->cur[i] = l->data[i] + l->n[i];
+        l->p[i] = l->n[i];
+    }
+
+    l->e[i] = l->sum[i] >> 2 & 3;
+    l->vp[i] = l->p[i];
+
+    return 0;
+}
+
+static inline __attribute__((always_inline)) void xxtea_multi_encrypt_lanes(xxtea_job_t * jobs, size_t count) {
+    xxtea_lanes_t lanes, * l = &lanes;
+    xxtea_vec_t v[XXTEA_LANES], k[4];
+    uint32_t words[XXTEA_LANES];
+    size_t next = 0, active;
+    uint32_t steps, s;
+    int i;
+
+    active = xxtea_multi_init(l, jobs, count, &next, 1);
+
+    while (active) {
+        // amount of steps before one lane reach its last word
+        steps = UINT32_MAX;
+        for (i = 0; i < XXTEA_LANES; i++)
+            if (l->job[i] && l->n[i] - l->p[i] < steps)
+                steps = l->n[i] - l->p[i];
+
+        for (i = 0; i < XXTEA_LANES; i++)
+            l->p[i] += steps * l->inc[i];
+
+        for (s = 0; s < 4; s++)
+            xxtea_vec_key(l, s, &k[s]);
+
+        for (; steps >= XXTEA_LANES; steps -= XXTEA_LANES) {
+            for (i = 0; i < XXTEA_LANES; i++)
+                memcpy(&v[i], l->cur[i] + 1, sizeof(xxtea_vec_t));
+
+            xxtea_vec_transpose(v);
+
+            for (s = 0; s < XXTEA_LANES; s++) {
+                l->y = v[s];
+                l->z = l->x + (XXTEA_VEC_MX(l->z, l->y, l->sum, k[s & 3]));
+                l->x = l->y;
+                v[s] = l->z;
+            }
+
+            xxtea_vec_transpose(v);
+
+            for (i = 0; i < XXTEA_LANES; i++) {
+                memcpy(l->cur[i], &v[i], sizeof(xxtea_vec_t));
+                l->cur[i] += XXTEA_LANES * l->inc[i];
+            }
+
+            l->vp += XXTEA_LANES;
+        }
+
+        for (; steps > 0; steps--) {
+            for (i = 0; i < XXTEA_LANES; i++)
+                words[i] = l->cur[i][1];
+
+            memcpy(&l->y, words, sizeof(words));
+            xxtea_vec_key(l, 0, &k[0]);
+            l->z = l->x + (XXTEA_VEC_MX(l->z, l->y, l->sum, k[0]));
+            l->x = l->y;
+            l->vp += 1;
+
+            for (i = 0; i < XXTEA_LANES; i++) {
+                l->cur[i][0] = l->z[i];
+                l->cur[i] += l->inc[i];
+            }
+        }
+
+        // last word of the round wraps to the first one
+        for (i = 0; i < XXTEA_LANES; i++)
+            words[i] = (l->p[i] == l->n[i]) ? l->data[i][0] : l->cur[i][1];
+
+        memcpy(&l->y, words, sizeof(words));
+        xxtea_vec_key(l, 0, &k[0]);
+        l->z = l->x + (XXTEA_VEC_MX(l->z, l->y, l->sum, k[0]));
+        l->x = l->y;
+        l->vp += 1;
+
+        for (i = 0; i < XXTEA_LANES; i++) {
+            l->cur[i][0] = l->z[i];
+
+            if (!l->job[i] || l->p[i] != l->n[i]) {
+                l->cur[i] += l->inc[i];
+                l->p[i] += l->inc[i];
+                continue;
+            }
+
+            active -= xxtea_multi_round(l, i, jobs, count, &next, 1);
+        }
+    }
+}
+
+static inline __attribute__((always_inline)) void xxtea_multi_decrypt_lanes(xxtea_job_t * jobs, size_t count) {
+    xxtea_lanes_t lanes, * l = &lanes;
+    xxtea_vec_t v[XXTEA_LANES], k[4];
+    uint32_t words[XXTEA_LANES];
+    size_t next = 0, active;
+    uint32_t steps, s;
+    int i;
+
+    active = xxtea_multi_init(l, jobs, count, &next, 0);
+
+    while (active) {
+        // amount of steps before one lane reach its first word
+        steps = UINT32_MAX;
+        for (i = 0; i < XXTEA_LANES; i++)
+            if (l->job[i] && l->p[i] < steps)
+                steps = l->p[i];
+
+        for (i = 0; i < XXTEA_LANES; i++)
+            l->p[i] -= steps * l->inc[i];
+
+        for (s = 0; s < 4; s++)
+            xxtea_vec_key(l, -s, &k[s]);
+
+        for (; steps >= XXTEA_LANES; steps -= XXTEA_LANES) {
+            // v[j] holds word (current - 8 + j) of each lane
+            for (i = 0; i < XXTEA_LANES; i++)
+                memcpy(&v[i], l->cur[i] - XXTEA_LANES, sizeof(xxtea_vec_t));
+
+            xxtea_vec_transpose(v);
+
+            for (s = 0; s < XXTEA_LANES; s++) {
+                l->z = v[XXTEA_LANES - 1 - s];
+                l->y = l->x - (XXTEA_VEC_MX(l->z, l->y, l->sum, k[s & 3]));
+                l->x = l->z;
+                v[XXTEA_LANES - 1 - s] = l->y;
+            }
+
+            // v[j] now holds new word (current - 7 + j)
+            xxtea_vec_transpose(v);
+
+            for (i = 0; i < XXTEA_LANES; i++) {
+                memcpy(l->cur[i] - (XXTEA_LANES - 1), &v[i], sizeof(xxtea_vec_t));
+                l->cur[i] -= XXTEA_LANES * l->inc[i];
+            }
+
+            l->vp -= XXTEA_LANES;
+        }
+
+        for (; steps > 0; steps--) {
+            for (i = 0; i < XXTEA_LANES; i++)
+                words[i] = l->cur[i][-1];
+
+            memcpy(&l->z, words, sizeof(words));
+            xxtea_vec_key(l, 0, &k[0]);
+            l->y = l->x - (XXTEA_VEC_MX(l->z, l->y, l->sum, k[0]));
+            l->x = l->z;
+            l->vp -= 1;
+
+            for (i = 0; i < XXTEA_LANES; i++) {
+                l->cur[i][0] = l->y[i];
+                l->cur[i] -= l->inc[i];
+            }
+        }
+
+        // first word of the round wraps to the last one
+        for (i = 0; i < XXTEA_LANES; i++)
+            words[i] = (l->p[i] == 0) ? l->data[i][l->n[i]] : l->cur[i][-1];
+
+        memcpy(&l->z, words, sizeof(words));
+        xxtea_vec_key(l, 0, &k[0]);
+        l->y = l->x - (XXTEA_VEC_MX(l->z, l->y, l->sum, k[0]));
+        l->x = l->z;
+        l->vp -= 1;
+
+        for (i = 0; i < XXTEA_LANES; i++) {
+            l->cur[i][0] = l->y[i];
+
+            if (!l->job[i] || l->p[i] != 0) {
+                l->cur[i] -= l->inc[i];
+                l->p[i] -= l->inc[i];
+                continue;
+            }
+
+            active -= xxtea_multi_round(l, i, jobs, count, &next, 0);
+        }
+    }
+}
+
+// baseline build (sse2 on x86_64, whatever is available elsewhere)
+static void xxtea_multi_encrypt_generic(xxtea_job_t * jobs, size_t count) {
+    xxtea_multi_encrypt_lanes(jobs, count);
+}
+
+static void xxtea_multi_decrypt_generic(xxtea_job_t * jobs, size_t count) {
+    xxtea_multi_decrypt_lanes(jobs, count);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define XXTEA_MULTI_AVX2 1
+
+// same kernels, built for avx2 and selected at runtime
+__attribute__((target("avx2"))) static void xxtea_multi_encrypt_avx2(xxtea_job_t * jobs, size_t count) {
+    xxtea_multi_encrypt_lanes(jobs, count);
+}
+
+__attribute__((target("avx2"))) static void xxtea_multi_decrypt_avx2(xxtea_job_t * jobs, size_t count) {
+    xxtea_multi_decrypt_lanes(jobs, count);
+}
+#endif
+
+static void xxtea_multi_encrypt(xxtea_job_t * jobs, size_t count) {
+#ifdef XXTEA_MULTI_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        xxtea_multi_encrypt_avx2(jobs, count);
+        return;
+    }
+#endif
+    xxtea_multi_encrypt_generic(jobs, count);
+}
+
+static void xxtea_multi_decrypt(xxtea_job_t * jobs, size_t count) {
+#ifdef XXTEA_MULTI_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        xxtea_multi_decrypt_avx2(jobs, count);
+        return;
+    }
+#endif
+    xxtea_multi_decrypt_generic(jobs, count);
+}
+#endif
+
 // public functions
 
 void * xxtea_encrypt(const void * data, size_t len, const void * key, size_t * out_len) {
@@ -262,15 +683,188 @@ void * xxtea_decrypt(const void * data, size_t len, const void * key, size_t * o
 }
 
 void * xxtea_encrypt_bkey(const void * data, size_t len, const void * key, size_t key_len, size_t * out_len) {
-    if(key_len % 8)
+    uint8_t *out;
+
+    if (!len || key_len % 8) return NULL;
+
+    // one single buffer, encrypted in place
+    if (!(out = (uint8_t *)malloc(xxtea_encrypt_length(len) + 1))) return NULL;
+    memcpy(out, data, len);
+
+    if (xxtea_encrypt_bkey_inplace(out, len, key, key_len, out_len)) {
+        free(out);
         return NULL;
+    }
 
-    return xxtea_ubyte_encrypt((const uint8_t *)data, len, key, out_len);
+    out[*out_len] = '\0';
+
+    return out;
 }
 
 void * xxtea_decrypt_bkey(const void * data, size_t len, const void * key, size_t key_len, size_t * out_len) {
-    if(key_len % 8)
+    uint8_t *out;
+
+    if (!len || key_len % 8) return NULL;
+
+    // one single buffer, decrypted in place
+    if (!(out = (uint8_t *)malloc(len + 1))) return NULL;
+    memcpy(out, data, len);
+
+    if (xxtea_decrypt_bkey_inplace(out, len, key, key_len, out_len)) {
+        free(out);
         return NULL;
+    }
+
+    out[*out_len] = '\0';
+
+    return out;
+}
+
+size_t xxtea_encrypt_length(size_t len) {
+    return ((((len & 3) == 0) ? (len >> 2) : ((len >> 2) + 1)) + 1) << 2;
+}
+
+int xxtea_encrypt_bkey_inplace(void * buffer, size_t len, const void * key, size_t key_len, size_t * out_len) {
+    uint32_t key_array[4];
+    uint32_t *data_array = (uint32_t *)buffer;
+    size_t n;
+
+    if (!len || key_len % 8) return 1;
+
+    n = ((len & 3) == 0) ? (len >> 2) : ((len >> 2) + 1);
+
+    // clear padding, length is appended on the extra trailing word
+    memset((uint8_t *)buffer + len, 0, (n << 2) - len);
+    xxtea_native_words(data_array, n);
+    data_array[n] = (uint32_t)len;
+
+    xxtea_key_array((const uint8_t *)key, key_array);
+    xxtea_uint_encrypt(data_array, n + 1, key_array);
+    xxtea_native_words(data_array, n + 1);
+
+    *out_len = (n + 1) << 2;
+
+    return 0;
+}
+
+int xxtea_decrypt_bkey_inplace(void * buffer, size_t len, const void * key, size_t key_len, size_t * out_len) {
+    uint32_t key_array[4];
+    uint32_t *data_array = (uint32_t *)buffer;
+    size_t n, m;
+
+    if (!len || (len & 3) || key_len % 8) return 1;
+
+    n = len >> 2;
+
+    xxtea_native_words(data_array, n);
+
+    xxtea_key_array((const uint8_t *)key, key_array);
+    xxtea_uint_decrypt(data_array, n, key_array);
+
+    m = data_array[n - 1];
+    if ((m < ((n - 1) << 2) - 3) || (m > ((n - 1) << 2))) return 1;
+
+    xxtea_native_words(data_array, n - 1);
+    *out_len = m;
+
+    return 0;
+}
+
+int xxtea_encrypt_bkey_into(const void * data, size_t len, const void * key, size_t key_len, void * out, size_t * out_len) {
+    if (!len) return 1;
+
+    memcpy(out, data, len);
+    return xxtea_encrypt_bkey_inplace(out, len, key, key_len, out_len);
+}
+
+int xxtea_decrypt_bkey_into(const void * data, size_t len, const void * key, size_t key_len, void * out, size_t * out_len) {
+    if (!len) return 1;
+
+    memcpy(out, data, len);
+    return xxtea_decrypt_bkey_inplace(out, len, key, key_len, out_len);
+}
+
+size_t xxtea_encrypt_bkey_inplace_multi(xxtea_job_t * jobs, size_t count) {
+    size_t i, n, failed = 0;
+
+    for (i = 0; i < count; i++) {
+        xxtea_job_t * job = &jobs[i];
+
+#ifdef XXTEA_MULTI
+        if ((job->status = (!job->len || ((uintptr_t) job->buffer & 3)))) {
+            failed += 1;
+            continue;
+        }
+
+        n = ((job->len & 3) == 0) ? (job->len >> 2) : ((job->len >> 2) + 1);
+
+        // same layout than xxtea_encrypt_bkey_inplace, encrypted later
+        memset((uint8_t *) job->buffer + job->len, 0, (n << 2) - job->len);
+        xxtea_native_words((uint32_t *) job->buffer, n);
+        ((uint32_t *) job->buffer)[n] = (uint32_t) job->len;
+
+        job->out_len = (n + 1) << 2;
+#else
+        (void) n;
+        failed += (job->status = xxtea_encrypt_bkey_inplace(job->buffer, job->len, job->key, 16, &job->out_len));
+#endif
+    }
+
+#ifdef XXTEA_MULTI
+    xxtea_multi_encrypt(jobs, count);
+
+    for (i = 0; i < count; i++)
+        if (jobs[i].status == 0)
+            xxtea_native_words((uint32_t *) jobs[i].buffer, jobs[i].out_len >> 2);
+#endif
+
+    return failed;
+}
+
+size_t xxtea_decrypt_bkey_inplace_multi(xxtea_job_t * jobs, size_t count) {
+    size_t i, n, m, failed = 0;
+
+    for (i = 0; i < count; i++) {
+        xxtea_job_t * job = &jobs[i];
+
+#ifdef XXTEA_MULTI
+        if ((job->status = (!job->len || (job->len & 3) || ((uintptr_t) job->buffer & 3)))) {
+            failed += 1;
+            continue;
+        }
+
+        xxtea_native_words((uint32_t *) job->buffer, job->len >> 2);
+        job->out_len = job->len;
+#else
+        (void) n;
+        (void) m;
+        failed += (job->status = xxtea_decrypt_bkey_inplace(job->buffer, job->len, job->key, 16, &job->out_len));
+#endif
+    }
+
+#ifdef XXTEA_MULTI
+    xxtea_multi_decrypt(jobs, count);
+
+    for (i = 0; i < count; i++) {
+        xxtea_job_t * job = &jobs[i];
+        uint32_t * data_array = (uint32_t *) job->buffer;
+
+        if (job->status)
+            continue;
+
+        n = job->len >> 2;
+        m = data_array[n - 1];
+
+        if ((m < ((n - 1) << 2) - 3) || (m > ((n - 1) << 2))) {
+            job->status = 1;
+            failed += 1;
+            continue;
+        }
+
+        xxtea_native_words(data_array, n - 1);
+        job->out_len = m;
+    }
+#endif
 
-    return xxtea_ubyte_decrypt((const uint8_t *)data, len, key, out_len);
+    return failed;
 }
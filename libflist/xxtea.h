@@ -53,6 +53,106 @@ void * xxtea_decrypt(const void * data, size_t len, const void * key, size_t * o
 
 void * xxtea_decrypt_bkey(const void * data, size_t len, const void * key, size_t key_len, size_t * out_len);
 
+/**
+ * Function: xxtea_encrypt_length
+ * @len:     Length of the data to be encrypted
+ * Returns:  Length of the encrypted data (payload padded plus length word)
+ */
+size_t xxtea_encrypt_length(size_t len);
+
+/**
+ * Function: xxtea_encrypt_bkey_into
+ * @data:    Data to be encrypted
+ * @len:     Length of the data to be encrypted
+ * @key:     Symmetric key
+ * @key_len: Length of the key
+ * @out:     Output buffer, 4 bytes aligned, at least xxtea_encrypt_length(len) bytes
+ * @out_len: Pointer to output length variable
+ * Returns:  0 on success, 1 on failure
+ *
+ * Nothing is allocated, output is written to the caller buffer.
+ */
+int xxtea_encrypt_bkey_into(const void * data, size_t len, const void * key, size_t key_len, void * out, size_t * out_len);
+
+/**
+ * Function: xxtea_decrypt_bkey_into
+ * @data:    Data to be decrypted
+ * @len:     Length of the data to be decrypted
+ * @key:     Symmetric key
+ * @key_len: Length of the key
+ * @out:     Output buffer, 4 bytes aligned, at least @len bytes
+ * @out_len: Pointer to output length variable
+ * Returns:  0 on success, 1 on failure
+ *
+ * Nothing is allocated, output is written to the caller buffer.
+ */
+int xxtea_decrypt_bkey_into(const void * data, size_t len, const void * key, size_t key_len, void * out, size_t * out_len);
+
+/**
+ * Function: xxtea_encrypt_bkey_inplace
+ * @buffer:  Data to be encrypted, 4 bytes aligned, at least xxtea_encrypt_length(len) bytes
+ * @len:     Length of the data to be encrypted
+ * @key:     Symmetric key
+ * @key_len: Length of the key
+ * @out_len: Pointer to output length variable
+ * Returns:  0 on success, 1 on failure
+ *
+ * Data is encrypted in place, only padding and the trailing length
+ * word are appended to the payload.
+ */
+int xxtea_encrypt_bkey_inplace(void * buffer, size_t len, const void * key, size_t key_len, size_t * out_len);
+
+/**
+ * Function: xxtea_decrypt_bkey_inplace
+ * @buffer:  Data to be decrypted, 4 bytes aligned
+ * @len:     Length of the data to be decrypted
+ * @key:     Symmetric key
+ * @key_len: Length of the key
+ * @out_len: Pointer to output length variable
+ * Returns:  0 on success, 1 on failure
+ *
+ * Data is decrypted in place, plain payload starts at @buffer.
+ */
+int xxtea_decrypt_bkey_inplace(void * buffer, size_t len, const void * key, size_t key_len, size_t * out_len);
+
+/**
+ * Multi-buffer job, one independent buffer processed in place
+ * @buffer:  Data, 4 bytes aligned (same size requirements than the single inplace functions)
+ * @len:     Length of the data
+ * @key:     Symmetric key, 16 bytes
+ * @out_len: Output length (filled)
+ * @status:  0 on success, 1 on failure (filled)
+ */
+typedef struct xxtea_job_t {
+    void * buffer;
+    size_t len;
+    const void * key;
+    size_t out_len;
+    int status;
+} xxtea_job_t;
+
+/**
+ * Function: xxtea_encrypt_bkey_inplace_multi
+ * @jobs:    Array of independent jobs
+ * @count:   Amount of jobs
+ * Returns:  Amount of failed jobs
+ *
+ * Same output than xxtea_encrypt_bkey_inplace on each buffer, but
+ * buffers are encrypted simultaneously, one per SIMD lane (AVX2 when
+ * available at runtime).
+ */
+size_t xxtea_encrypt_bkey_inplace_multi(xxtea_job_t * jobs, size_t count);
+
+/**
+ * Function: xxtea_decrypt_bkey_inplace_multi
+ * @jobs:    Array of independent jobs
+ * @count:   Amount of jobs
+ * Returns:  Amount of failed jobs
+ *
+ * Same output than xxtea_decrypt_bkey_inplace on each buffer.
+ */
+size_t xxtea_decrypt_bkey_inplace_multi(xxtea_job_t * jobs, size_t count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -3,18 +3,37 @@
 #include <stdint.h>
 #include <string.h>
 #include <snappy-c.h>
+#include <zstd.h>
+#include <lz4.h>
 #include <zlib.h>
 #include <math.h>
 #include <time.h>
 #include <blake2.h>
+#include <blake3.h>
+#include <pthread.h>
+#include <openssl/evp.h>
 #include "libflist.h"
 #include "verbose.h"
 #include "xxtea.h"
+#include "blake2b_multi.h"
 #include "flist_tools.h"
 #include "zero_chunk.h"
 
 #define CHUNK_SIZE    1024 * 512    // 512 KB
 
+#define COMPRESSION_ZSTD_LEVEL      3      // zstd default level
+#define COMPRESSION_LZ4_HEADER      4      // uncompressed length, prefixing lz4 block
+#define COMPRESSION_SAMPLE_SIZE     512    // bytes per entropy sample
+#define COMPRESSION_SAMPLE_COUNT    16     // entropy samples spread over a chunk
+#define COMPRESSION_ENTROPY_LIMIT   7.5    // bits per byte, above is considered incompressible
+
+#define CHUNK_TAG_COMPRESSION       0x0f   // key tag bits of the compression
+#define CHUNK_TAG_CIPHER_SHIFT      4      // key tag bits of the cipher
+
+#define CIPHER_AEAD_KEY             32     // aead key length, derived from the chunk key
+#define CIPHER_AEAD_NONCE           12     // nonce length, prefixing aead payload
+#define CIPHER_AEAD_TAG             16     // authentication tag length, following aead payload
+
 //
 // buffer manager
 //
@@ -94,21 +113,27 @@ buffer_t *buffer_writer(char *filename) {
     return buffer;
 }
 
-const unsigned char *buffer_next(buffer_t *buffer) {
+// load next chunk into target, which needs to be
+// at least chunksize long
+const unsigned char *buffer_next_into(buffer_t *buffer, uint8_t *target) {
     // resize chunksize if it's smaller than the remaining
     // amount of data
     if(buffer->current + buffer->chunksize > buffer->length)
         buffer->chunksize = buffer->length - buffer->current;
 
     // loading this chunk in memory
-    if(fread(buffer->data, buffer->chunksize, 1, buffer->fp) != 1) {
+    if(fread(target, buffer->chunksize, 1, buffer->fp) != 1) {
         perror("[-] fread");
         return NULL;
     }
 
     buffer->current += buffer->chunksize;
 
-    return (const uint8_t *) buffer->data;
+    return (const uint8_t *) target;
+}
+
+const unsigned char *buffer_next(buffer_t *buffer) {
+    return buffer_next_into(buffer, buffer->data);
 }
 
 void buffer_free(buffer_t *buffer) {
@@ -134,6 +159,71 @@ uint8_t *libflist_chunk_hash(const void *buffer, size_t length) {
     return hash;
 }
 
+static const char *hash_names[] = {
+    [FLIST_HASH_BLAKE2B] = "blake2b",
+    [FLIST_HASH_BLAKE3] = "blake3",
+};
+
+#define HASH_COUNT  (sizeof(hash_names) / sizeof(char *))
+
+const char *libflist_hash_name(flist_hash_t hash) {
+    if((size_t) hash >= HASH_COUNT)
+        return "unknown";
+
+    return hash_names[hash];
+}
+
+// parse a hash name: blake2b or blake3
+int libflist_hash_parse(flist_compressor_t *compressor, const char *value) {
+    for(size_t i = 0; i < HASH_COUNT; i++) {
+        if(strcmp(hash_names[i], value))
+            continue;
+
+        compressor->hash = (flist_hash_t) i;
+        return 0;
+    }
+
+    libflist_set_error("unknown hash: %s", value);
+    return 1;
+}
+
+// compute digests of independent buffers, blake2b digests are computed
+// simultaneously (multi-buffer), blake3 already uses simd within each buffer
+static int hash_compute(flist_hash_t hash, blake2b_job_t *jobs, size_t count) {
+    if(hash == FLIST_HASH_BLAKE2B)
+        return blake2b_multi(jobs, count);
+
+    for(size_t i = 0; i < count; i++) {
+        blake3_hasher hasher;
+
+        blake3_hasher_init(&hasher);
+        blake3_hasher_update(&hasher, jobs[i].data, jobs[i].length);
+        blake3_hasher_finalize(&hasher, jobs[i].hash, jobs[i].hashlen);
+    }
+
+    return 0;
+}
+
+// hash several buffers at once, hashes needs to be
+// ZEROCHUNK_HASH_LENGTH bytes long, provided by the caller
+int libflist_chunk_hash_batch(flist_buffer_t *buffers, uint8_t **hashes, size_t count) {
+    blake2b_job_t jobs[FLIST_CHUNK_BATCH];
+
+    for(size_t i = 0; i < count; i += FLIST_CHUNK_BATCH) {
+        size_t length = (count - i < FLIST_CHUNK_BATCH) ? count - i : FLIST_CHUNK_BATCH;
+
+        for(size_t j = 0; j < length; j++)
+            jobs[j] = (blake2b_job_t) {.data = buffers[i + j].data, .length = buffers[i + j].length, .hash = hashes[i + j], .hashlen = ZEROCHUNK_HASH_LENGTH};
+
+        if(blake2b_multi(jobs, length)) {
+            libflist_set_error("blake2 failed");
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
 
 //
 // chunks manager
@@ -177,129 +267,986 @@ void libflist_chunk_free(flist_chunk_t *chunk) {
 }
 
 //
-// encryption and decryption
+// codec
 //
-// encrypt a buffer
-// returns a chunk with key, cipher, data and it's length
-flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
-    // hashing this chunk
-    unsigned char *hashkey = libflist_chunk_hash(chunk, chunksize);
+static pthread_key_t codec_thread_key;
+static pthread_once_t codec_thread_once = PTHREAD_ONCE_INIT;
+
+// ensure a scratch buffer is large enough, buffer contents
+// is not preserved when growing
+static int codec_reserve(uint8_t **buffer, size_t *size, size_t needed) {
+    if(*size >= needed)
+        return 0;
 
-    if(libflist_debug_flag) {
-        char *inhash = libflist_hashhex(hashkey, ZEROCHUNK_HASH_LENGTH);
-        debug("[+] libflist: chunk: encrypt: original hash: %s\n", inhash);
-        free(inhash);
+    free(*buffer);
+    *size = 0;
+
+    if(!(*buffer = malloc(needed))) {
+        libflist_errp("codec: malloc");
+        return 1;
     }
 
-    //
-    // compress
-    //
-    size_t output_length = snappy_max_compressed_length(chunksize);
-    char *compressed = (char *) malloc(output_length);
+    *size = needed;
+
+    return 0;
+}
+
+flist_chunk_codec_t *libflist_chunk_codec_new() {
+    flist_chunk_codec_t *codec;
 
-    if(snappy_compress((char *) chunk, chunksize, compressed, &output_length) != SNAPPY_OK) {
-        libflist_set_error("snappy compression error");
+    if(!(codec = calloc(sizeof(flist_chunk_codec_t), 1)))
+        return libflist_errp("codec: calloc");
+
+    // pre-allocate buffers for a full chunk
+    size_t compressed = snappy_max_compressed_length(CHUNK_SIZE);
+
+    if(codec_reserve(&codec->encrypted, &codec->encryptedsize, xxtea_encrypt_length(compressed)))
+        goto failed;
+
+    if(codec_reserve(&codec->plain, &codec->plainsize, CHUNK_SIZE))
+        goto failed;
+
+    return codec;
+
+failed:
+    libflist_chunk_codec_free(codec);
+    return NULL;
+}
+
+void libflist_chunk_codec_free(flist_chunk_codec_t *codec) {
+    if(!codec)
+        return;
+
+    for(int i = 0; i < FLIST_CHUNK_BATCH - 1; i++)
+        libflist_chunk_codec_free(codec->lanes[i]);
+
+    ZSTD_freeCCtx(codec->zcompress);
+    ZSTD_freeDCtx(codec->zdecompress);
+    ZSTD_freeCDict(codec->zcdict);
+    ZSTD_freeDDict(codec->zddict);
+    EVP_CIPHER_CTX_free(codec->aead);
+
+    free(codec->encrypted);
+    free(codec->plain);
+    free(codec);
+}
+
+// scratch codec used by the chunk at index of a batch
+static flist_chunk_codec_t *codec_lane(flist_chunk_codec_t *codec, size_t index) {
+    if(index == 0)
+        return codec;
+
+    if(!codec->lanes[index - 1])
+        codec->lanes[index - 1] = libflist_chunk_codec_new();
+
+    return codec->lanes[index - 1];
+}
+
+static void codec_thread_destroy(void *codec) {
+    libflist_chunk_codec_free((flist_chunk_codec_t *) codec);
+}
+
+static void codec_thread_init() {
+    pthread_key_create(&codec_thread_key, codec_thread_destroy);
+}
+
+// returns the codec attached to the calling thread, the
+// codec is created on the first call and released when
+// the thread exits
+flist_chunk_codec_t *libflist_chunk_codec_thread() {
+    flist_chunk_codec_t *codec;
+
+    pthread_once(&codec_thread_once, codec_thread_init);
+
+    if((codec = pthread_getspecific(codec_thread_key)))
+        return codec;
+
+    if(!(codec = libflist_chunk_codec_new()))
         return NULL;
+
+    pthread_setspecific(codec_thread_key, codec);
+
+    return codec;
+}
+
+//
+// encryption and decryption
+//
+// compute several chunk hashes at once
+static int codec_hash(blake2b_job_t *jobs, size_t count, flist_hash_t hash, const char *name) {
+    char hexhash[(ZEROCHUNK_HASH_LENGTH * 2) + 1];
+
+    if(hash_compute(hash, jobs, count)) {
+        libflist_set_error("%s failed", libflist_hash_name(hash));
+        return 1;
     }
 
-    // printf("Compressed size: %lu\n", output_length);
+    for(size_t i = 0; i < count; i++)
+        debug("[+] libflist: chunk: encrypt: %s hash: %s\n", name, libflist_hashhex_buffer(jobs[i].hash, jobs[i].hashlen, hexhash));
 
-    //
-    // encrypt
-    //
-    size_t encrypt_length;
-    unsigned char *encrypt_data = xxtea_encrypt_bkey(compressed, output_length, hashkey, ZEROCHUNK_HASH_LENGTH, &encrypt_length);
+    return 0;
+}
+
+//
+// compression
+//
+static const char *compression_names[] = {
+    [FLIST_COMPRESSION_SNAPPY] = "snappy",
+    [FLIST_COMPRESSION_STORE] = "store",
+    [FLIST_COMPRESSION_ZSTD] = "zstd",
+    [FLIST_COMPRESSION_LZ4] = "lz4",
+    [FLIST_COMPRESSION_ZSTD_DICT] = "zstd-dict",
+};
+
+#define COMPRESSION_COUNT  (sizeof(compression_names) / sizeof(char *))
+
+const char *libflist_compression_name(flist_compression_t type) {
+    if((size_t) type >= COMPRESSION_COUNT)
+        return "unknown";
+
+    return compression_names[type];
+}
+
+// parse a compression settings string: name[:level]
+// eg: snappy, store, lz4, zstd, zstd:19, zstd-dict:9
+int libflist_compressor_parse(flist_compressor_t *compressor, const char *value) {
+    const char *level = strchr(value, ':');
+    size_t length = level ? (size_t)(level - value) : strlen(value);
+
+    for(size_t i = 0; i < COMPRESSION_COUNT; i++) {
+        if(strlen(compression_names[i]) != length || strncmp(compression_names[i], value, length))
+            continue;
 
-    unsigned char *hashcrypt = libflist_chunk_hash(encrypt_data, encrypt_length);
+        compressor->type = (flist_compression_t) i;
+        compressor->level = level ? atoi(level + 1) : 0;
 
-    if(libflist_debug_flag) {
-        char *inhash = libflist_hashhex(hashcrypt, ZEROCHUNK_HASH_LENGTH);
-        debug("[+] libflist: chunk: encrypt: final hash: %s\n", inhash);
-        free(inhash);
+        // any other compression than snappy tags chunks, storing
+        // incompressible chunks doesn't change anything more
+        compressor->sampling = (compressor->type != FLIST_COMPRESSION_SNAPPY);
+
+        return 0;
     }
 
-    // cleaning
-    free(compressed);
+    libflist_set_error("unknown compression: %s", value);
+    return 1;
+}
 
-    flist_chunk_t *response = libflist_chunk_new(hashcrypt, hashkey, NULL, 0);
-    response->encrypted.data = encrypt_data;
-    response->encrypted.length = encrypt_length;
+// estimate the payload entropy (bits per byte) on samples spread
+// over the payload, already compressed data are close to 8 bits
+static double compression_entropy(const uint8_t *data, size_t length) {
+    uint32_t histogram[256] = {0};
+    size_t samples = COMPRESSION_SAMPLE_COUNT;
+    size_t samplesize = COMPRESSION_SAMPLE_SIZE;
+    size_t stride = 0;
+    double entropy = 0;
 
-    // memory duplicated on chunk object
-    free(hashcrypt);
-    free(hashkey);
+    if(length <= samples * samplesize) {
+        samples = 1;
+        samplesize = length;
 
-    return response;
+    } else stride = (length - samplesize) / (samples - 1);
+
+    for(size_t i = 0; i < samples; i++) {
+        const uint8_t *sample = data + (i * stride);
+
+        for(size_t j = 0; j < samplesize; j++)
+            histogram[sample[j]] += 1;
+    }
+
+    for(int i = 0; i < 256; i++) {
+        if(!histogram[i])
+            continue;
+
+        double p = histogram[i] / (double)(samples * samplesize);
+        entropy -= p * log2(p);
+    }
+
+    return entropy;
 }
 
-// uncrypt a chunk
-// it takes a chunk as parameter
-// returns a chunk (without key and cipher) with payload data and length
-flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk) {
-    char *uncipherdata = NULL;
-    size_t uncipherlength;
+//
+// encryption
+//
+static const char *cipher_names[] = {
+    [FLIST_CIPHER_XXTEA] = "xxtea",
+    [FLIST_CIPHER_AES256GCM] = "aes-256-gcm",
+    [FLIST_CIPHER_CHACHA20POLY1305] = "chacha20-poly1305",
+};
 
-    //
-    // uncrypt payload
-    //
-    char *key = libflist_hashhex(chunk->cipher.data, chunk->cipher.length);
-    debug("[+] libflist: chunk: uncrypt %lu buffer, with key: %s\n", chunk->encrypted.length, key);
-    free(key);
+#define CIPHER_COUNT  (sizeof(cipher_names) / sizeof(char *))
 
-    if(!(uncipherdata = xxtea_decrypt_bkey(chunk->encrypted.data, chunk->encrypted.length, chunk->cipher.data, chunk->cipher.length, &uncipherlength))) {
-        libflist_set_error("cannot decrypt data, invalid key or payload");
+const char *libflist_cipher_name(flist_cipher_t cipher) {
+    if((size_t) cipher >= CIPHER_COUNT)
+        return "unknown";
+
+    return cipher_names[cipher];
+}
+
+// aes-gcm is only fast with hardware aes, otherwise
+// chacha20-poly1305 is the fastest aead in software
+static flist_cipher_t cipher_preferred() {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    if(__builtin_cpu_supports("aes"))
+        return FLIST_CIPHER_AES256GCM;
+#endif
+
+    return FLIST_CIPHER_CHACHA20POLY1305;
+}
+
+// parse a cipher name: xxtea, aes-256-gcm, chacha20-poly1305
+// or aead (best aead available on this cpu)
+int libflist_cipher_parse(flist_compressor_t *compressor, const char *value) {
+    if(strcmp(value, "aead") == 0) {
+        compressor->cipher = cipher_preferred();
+        return 0;
+    }
+
+    for(size_t i = 0; i < CIPHER_COUNT; i++) {
+        if(strcmp(cipher_names[i], value))
+            continue;
+
+        compressor->cipher = (flist_cipher_t) i;
+        return 0;
+    }
+
+    libflist_set_error("unknown cipher: %s", value);
+    return 1;
+}
+
+// encrypted payload length, including cipher overhead
+static size_t cipher_length(flist_cipher_t cipher, size_t length) {
+    if(cipher == FLIST_CIPHER_XXTEA)
+        return xxtea_encrypt_length(length);
+
+    return CIPHER_AEAD_NONCE + length + CIPHER_AEAD_TAG;
+}
+
+// payload offset into the encrypted buffer
+static size_t cipher_offset(flist_cipher_t cipher) {
+    return (cipher == FLIST_CIPHER_XXTEA) ? 0 : CIPHER_AEAD_NONCE;
+}
+
+static size_t compression_bound(flist_compression_t type, size_t length) {
+    switch(type) {
+        case FLIST_COMPRESSION_STORE:
+            return length;
+
+        case FLIST_COMPRESSION_ZSTD:
+        case FLIST_COMPRESSION_ZSTD_DICT:
+            return ZSTD_compressBound(length);
+
+        case FLIST_COMPRESSION_LZ4:
+            return COMPRESSION_LZ4_HEADER + LZ4_compressBound(length);
+
+        default:
+            return snappy_max_compressed_length(length);
+    }
+}
+
+// flist dictionary digested for compression, digested dictionary
+// is kept by the codec until the dictionary or the level changes
+static ZSTD_CDict *codec_cdict(flist_chunk_codec_t *codec, flist_dictionary_t *dictionary, int level) {
+    unsigned int id = ZSTD_getDictID_fromDict(dictionary->data, dictionary->length);
+
+    if(codec->zcdict && codec->zcdictid == id && codec->zcdictlevel == level)
+        return codec->zcdict;
+
+    ZSTD_freeCDict(codec->zcdict);
+
+    if(!(codec->zcdict = ZSTD_createCDict(dictionary->data, dictionary->length, level))) {
+        libflist_set_error("zstd dictionary digest failed");
         return NULL;
     }
 
-    //
-    // decompress
-    //
-    size_t uncompressed_length = 0;
-    snappy_status status;
+    codec->zcdictid = id;
+    codec->zcdictlevel = level;
 
-    debug("[+] libflist: chunk: uncompressing %lu bytes\n", uncipherlength);
+    return codec->zcdict;
+}
+
+// flist dictionary digested for decompression
+static ZSTD_DDict *codec_ddict(flist_chunk_codec_t *codec, flist_dictionary_t *dictionary) {
+    unsigned int id;
 
-    if((status = snappy_uncompressed_length(uncipherdata, uncipherlength, &uncompressed_length)) != SNAPPY_OK) {
-        libflist_set_error("snappy uncompression length error: %d", status);
+    if(!dictionary) {
+        libflist_set_error("chunk compressed with a dictionary, flist dictionary not loaded");
         return NULL;
     }
 
-    char *uncompress = (char *) malloc(uncompressed_length);
-    if((status = snappy_uncompress(uncipherdata, uncipherlength, uncompress, &uncompressed_length)) != SNAPPY_OK) {
-        libflist_set_error("snappy uncompression error: %d", status);
+    id = ZSTD_getDictID_fromDict(dictionary->data, dictionary->length);
+
+    if(codec->zddict && codec->zddictid == id)
+        return codec->zddict;
+
+    ZSTD_freeDDict(codec->zddict);
+
+    if(!(codec->zddict = ZSTD_createDDict(dictionary->data, dictionary->length))) {
+        libflist_set_error("zstd dictionary digest failed");
         return NULL;
     }
 
-    chunk->plain.data = (uint8_t *) uncompress;
-    chunk->plain.length = uncompressed_length;
+    codec->zddictid = id;
+
+    return codec->zddict;
+}
+
+// compress a buffer into codec encryption buffer, the buffer is
+// sized to receive the cipher overhead (xxtea padding and trailing
+// length word, aead nonce and tag), payload is then encrypted in place,
+// compression really used is set on used (incompressible payload can be stored)
+static int codec_compress(flist_chunk_codec_t *codec, flist_compressor_t *compressor, const uint8_t *data, size_t length, size_t *compressed, flist_compression_t *used) {
+    flist_compression_t type = compressor->type;
+    uint8_t *target;
+    size_t bound;
+
+    if(compressor->sampling && type != FLIST_COMPRESSION_STORE && length >= COMPRESSION_SAMPLE_SIZE) {
+        if(compression_entropy(data, length) > COMPRESSION_ENTROPY_LIMIT) {
+            debug("[+] libflist: chunk: payload looks incompressible, storing it\n");
+            type = FLIST_COMPRESSION_STORE;
+        }
+    }
+
+    // only small chunks benefit from the dictionary
+    if(type == FLIST_COMPRESSION_ZSTD_DICT && (!compressor->dictionary || length > FLIST_DICTIONARY_CHUNK_MAX))
+        type = FLIST_COMPRESSION_ZSTD;
+
+    bound = compression_bound(type, length);
+
+    if(codec_reserve(&codec->encrypted, &codec->encryptedsize, cipher_length(compressor->cipher, bound)))
+        return 1;
+
+    target = codec->encrypted + cipher_offset(compressor->cipher);
+
+    switch(type) {
+        case FLIST_COMPRESSION_STORE:
+            memcpy(target, data, length);
+            *compressed = length;
+            break;
+
+        case FLIST_COMPRESSION_ZSTD:
+        case FLIST_COMPRESSION_ZSTD_DICT: {
+            int level = compressor->level ? compressor->level : COMPRESSION_ZSTD_LEVEL;
+            ZSTD_CDict *cdict = NULL;
+
+            if(!codec->zcompress && !(codec->zcompress = ZSTD_createCCtx())) {
+                libflist_set_error("zstd context allocation failed");
+                return 1;
+            }
+
+            if(type == FLIST_COMPRESSION_ZSTD_DICT && !(cdict = codec_cdict(codec, compressor->dictionary, level)))
+                return 1;
+
+            if(cdict) *compressed = ZSTD_compress_usingCDict(codec->zcompress, target, bound, data, length, cdict);
+            else *compressed = ZSTD_compressCCtx(codec->zcompress, target, bound, data, length, level);
+
+            if(ZSTD_isError(*compressed)) {
+                libflist_set_error("zstd compression error: %s", ZSTD_getErrorName(*compressed));
+                return 1;
+            }
+
+            break;
+        }
+
+        case FLIST_COMPRESSION_LZ4: {
+            int value;
+
+            // lz4 blocks doesn't contains uncompressed length
+            for(int i = 0; i < COMPRESSION_LZ4_HEADER; i++)
+                target[i] = (length >> (i * 8)) & 0xff;
+
+            value = LZ4_compress_default((char *) data, (char *) target + COMPRESSION_LZ4_HEADER, length, bound - COMPRESSION_LZ4_HEADER);
+
+            if(value <= 0) {
+                libflist_set_error("lz4 compression error");
+                return 1;
+            }
+
+            *compressed = COMPRESSION_LZ4_HEADER + value;
+            break;
+        }
+
+        default:
+            *compressed = bound;
+
+            if(snappy_compress((char *) data, length, (char *) target, compressed) != SNAPPY_OK) {
+                libflist_set_error("snappy compression error");
+                return 1;
+            }
+    }
+
+    // compression didn't help, keeping payload as it
+    if(compressor->sampling && type != FLIST_COMPRESSION_STORE && *compressed >= length) {
+        debug("[+] libflist: chunk: compression not effective, storing payload\n");
+        memcpy(target, data, length);
+        *compressed = length;
+        type = FLIST_COMPRESSION_STORE;
+    }
+
+    *used = type;
+
+    return 0;
+}
+
+// snappy and xxtea chunks keeps the plain hash as key, any
+// other compression or cipher is tagged after the hash
+static size_t codec_key_tag(uint8_t *key, flist_compression_t used, flist_cipher_t cipher) {
+    if(used == FLIST_COMPRESSION_SNAPPY && cipher == FLIST_CIPHER_XXTEA)
+        return ZEROCHUNK_HASH_LENGTH;
+
+    key[ZEROCHUNK_HASH_LENGTH] = (uint8_t) used | (uint8_t)(cipher << CHUNK_TAG_CIPHER_SHIFT);
+    return ZEROCHUNK_HASH_LENGTH + 1;
+}
+
+//
+// aead payload: nonce, ciphertext, authentication tag
+//
+// encryption stays convergent: aead key is derived from the chunk key (plain
+// payload hash and tag) and the nonce is the hash of the compressed payload,
+// the same chunk always gives the same payload (deduplication still works)
+// and one key never encrypts two different payloads with the same nonce
+//
+static const EVP_CIPHER *cipher_evp(flist_cipher_t cipher) {
+    if(cipher == FLIST_CIPHER_AES256GCM)
+        return EVP_aes_256_gcm();
+
+    return EVP_chacha20_poly1305();
+}
+
+static EVP_CIPHER_CTX *codec_aead(flist_chunk_codec_t *codec, const uint8_t *key, uint8_t *aeadkey) {
+    if(!codec->aead && !(codec->aead = EVP_CIPHER_CTX_new())) {
+        libflist_set_error("aead context allocation failed");
+        return NULL;
+    }
+
+    if(blake2b(aeadkey, key + ZEROCHUNK_HASH_LENGTH, key, CIPHER_AEAD_KEY, 1, ZEROCHUNK_HASH_LENGTH)) {
+        libflist_set_error("blake2 failed");
+        return NULL;
+    }
+
+    return codec->aead;
+}
+
+// encrypt in place the payload following the nonce (already set)
+// and append the authentication tag
+static int codec_aead_encrypt(flist_chunk_codec_t *codec, flist_cipher_t cipher, const uint8_t *key, uint8_t *buffer, size_t length, size_t *outlen) {
+    uint8_t aeadkey[CIPHER_AEAD_KEY];
+    uint8_t *payload = buffer + CIPHER_AEAD_NONCE;
+    EVP_CIPHER_CTX *ctx;
+    int written, final;
+
+    if(!(ctx = codec_aead(codec, key, aeadkey)))
+        return 1;
+
+    if(EVP_EncryptInit_ex(ctx, cipher_evp(cipher), NULL, aeadkey, buffer) != 1)
+        goto failed;
+
+    if(EVP_EncryptUpdate(ctx, payload, &written, payload, (int) length) != 1)
+        goto failed;
+
+    if(EVP_EncryptFinal_ex(ctx, payload + written, &final) != 1)
+        goto failed;
+
+    if(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, CIPHER_AEAD_TAG, payload + length) != 1)
+        goto failed;
+
+    *outlen = cipher_length(cipher, length);
+
+    return 0;
+
+failed:
+    libflist_set_error("%s encryption error", libflist_cipher_name(cipher));
+    return 1;
+}
+
+// authenticate and decrypt an aead payload into target, which can
+// be the payload itself (data + CIPHER_AEAD_NONCE) or another buffer
+static int codec_aead_decrypt(flist_chunk_codec_t *codec, flist_cipher_t cipher, const uint8_t *key, const uint8_t *data, size_t length, uint8_t *target, size_t *plainlength) {
+    uint8_t aeadkey[CIPHER_AEAD_KEY];
+    uint8_t tag[CIPHER_AEAD_TAG];
+    EVP_CIPHER_CTX *ctx;
+    int written, final;
+    size_t cipherlength;
+
+    if(length < cipher_length(cipher, 0)) {
+        libflist_set_error("cannot decrypt data, payload too short");
+        return 1;
+    }
+
+    cipherlength = length - cipher_length(cipher, 0);
+    memcpy(tag, data + CIPHER_AEAD_NONCE + cipherlength, CIPHER_AEAD_TAG);
+
+    if(!(ctx = codec_aead(codec, key, aeadkey)))
+        return 1;
+
+    if(EVP_DecryptInit_ex(ctx, cipher_evp(cipher), NULL, aeadkey, data) != 1)
+        goto failed;
+
+    if(EVP_DecryptUpdate(ctx, target, &written, data + CIPHER_AEAD_NONCE, (int) cipherlength) != 1)
+        goto failed;
+
+    if(EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, CIPHER_AEAD_TAG, tag) != 1)
+        goto failed;
+
+    if(EVP_DecryptFinal_ex(ctx, target + written, &final) != 1) {
+        libflist_set_error("cannot decrypt data, authentication failed");
+        return 1;
+    }
+
+    *plainlength = cipherlength;
+
+    return 0;
+
+failed:
+    libflist_set_error("%s decryption error", libflist_cipher_name(cipher));
+    return 1;
+}
+
+// encrypt a buffer using a compressor
+static int codec_encrypt(flist_chunk_codec_t *codec, flist_compressor_t *compressor, const uint8_t *data, size_t length, uint8_t *id, uint8_t *key, size_t *keylen, flist_buffer_t *encrypted) {
+    flist_compression_t used;
+    size_t compressed;
+
+    // hashing this chunk, this is the encryption key
+    blake2b_job_t hash = {.data = data, .length = length, .hash = key, .hashlen = ZEROCHUNK_HASH_LENGTH};
+
+    if(codec_hash(&hash, 1, compressor->hash, "original"))
+        return 1;
+
+    if(codec_compress(codec, compressor, data, length, &compressed, &used))
+        return 1;
+
+    *keylen = codec_key_tag(key, used, compressor->cipher);
+
+    if(compressor->cipher != FLIST_CIPHER_XXTEA) {
+        hash = (blake2b_job_t) {.data = codec->encrypted + CIPHER_AEAD_NONCE, .length = compressed, .hash = codec->encrypted, .hashlen = CIPHER_AEAD_NONCE};
+
+        if(codec_hash(&hash, 1, compressor->hash, "nonce"))
+            return 1;
+
+        if(codec_aead_encrypt(codec, compressor->cipher, key, codec->encrypted, compressed, &encrypted->length))
+            return 1;
+
+    } else if(xxtea_encrypt_bkey_inplace(codec->encrypted, compressed, key, ZEROCHUNK_HASH_LENGTH, &encrypted->length)) {
+        libflist_set_error("xxtea encryption error");
+        return 1;
+    }
+
+    encrypted->data = codec->encrypted;
+
+    // hashing encrypted payload, this is the chunk id
+    hash = (blake2b_job_t) {.data = encrypted->data, .length = encrypted->length, .hash = id, .hashlen = ZEROCHUNK_HASH_LENGTH};
+
+    return codec_hash(&hash, 1, compressor->hash, "final");
+}
+
+// encrypt a buffer
+// id needs to be ZEROCHUNK_HASH_LENGTH bytes long and key FLIST_CHUNK_KEY_MAXLENGTH
+// bytes long, provided by the caller, key length depends of the compression used
+// encrypted payload points to codec memory, valid until next codec call
+int libflist_chunk_codec_encrypt(flist_chunk_codec_t *codec, const uint8_t *data, size_t length, uint8_t *id, uint8_t *key, size_t *keylen, flist_buffer_t *encrypted) {
+    return codec_encrypt(codec, &codec->compressor, data, length, id, key, keylen, encrypted);
+}
+
+// encrypt a batch using a compressor
+static int codec_encrypt_batch(flist_chunk_codec_t *codec, flist_compressor_t *compressor, flist_chunk_job_t *jobs, size_t count) {
+    xxtea_job_t xjobs[FLIST_CHUNK_BATCH];
+    blake2b_job_t hashes[FLIST_CHUNK_BATCH];
+    flist_compression_t used;
+
+    if(count > FLIST_CHUNK_BATCH) {
+        libflist_set_error("too many chunks in batch (%lu, max %d)", count, FLIST_CHUNK_BATCH);
+        return 1;
+    }
+
+    if(count == 1)
+        return codec_encrypt(codec, compressor, jobs[0].data, jobs[0].length, jobs[0].id, jobs[0].key, &jobs[0].keylen, &jobs[0].encrypted);
+
+    // hashing chunks, these are the encryption keys
+    for(size_t i = 0; i < count; i++)
+        hashes[i] = (blake2b_job_t) {.data = jobs[i].data, .length = jobs[i].length, .hash = jobs[i].key, .hashlen = ZEROCHUNK_HASH_LENGTH};
+
+    if(codec_hash(hashes, count, compressor->hash, "original"))
+        return 1;
+
+    for(size_t i = 0; i < count; i++) {
+        flist_chunk_codec_t *lane;
+
+        if(!(lane = codec_lane(codec, i)))
+            return 1;
+
+        if(codec_compress(lane, compressor, jobs[i].data, jobs[i].length, &xjobs[i].len, &used))
+            return 1;
+
+        jobs[i].keylen = codec_key_tag(jobs[i].key, used, compressor->cipher);
+
+        xjobs[i].buffer = lane->encrypted;
+        xjobs[i].key = jobs[i].key;
+    }
+
+    if(compressor->cipher != FLIST_CIPHER_XXTEA) {
+        // aead ciphers are not multi-buffer, only
+        // nonces are computed simultaneously
+        for(size_t i = 0; i < count; i++) {
+            uint8_t *buffer = (uint8_t *) xjobs[i].buffer;
+            hashes[i] = (blake2b_job_t) {.data = buffer + CIPHER_AEAD_NONCE, .length = xjobs[i].len, .hash = buffer, .hashlen = CIPHER_AEAD_NONCE};
+        }
+
+        if(codec_hash(hashes, count, compressor->hash, "nonce"))
+            return 1;
+
+        for(size_t i = 0; i < count; i++)
+            if(codec_aead_encrypt(codec, compressor->cipher, jobs[i].key, xjobs[i].buffer, xjobs[i].len, &xjobs[i].out_len))
+                return 1;
+
+    } else if(xxtea_encrypt_bkey_inplace_multi(xjobs, count)) {
+        libflist_set_error("xxtea encryption error");
+        return 1;
+    }
+
+    // hashing encrypted payloads, these are the chunks id
+    for(size_t i = 0; i < count; i++) {
+        jobs[i].encrypted.data = xjobs[i].buffer;
+        jobs[i].encrypted.length = xjobs[i].out_len;
+
+        hashes[i] = (blake2b_job_t) {.data = jobs[i].encrypted.data, .length = jobs[i].encrypted.length, .hash = jobs[i].id, .hashlen = ZEROCHUNK_HASH_LENGTH};
+    }
+
+    return codec_hash(hashes, count, compressor->hash, "final");
+}
+
+// encrypt up to FLIST_CHUNK_BATCH buffers at once, hashing and encryption
+// of all the chunks are done simultaneously (multi-buffer blake2b and xxtea)
+// each encrypted payload points to a different scratch buffer
+// of the codec, valid until next codec call
+int libflist_chunk_codec_encrypt_batch(flist_chunk_codec_t *codec, flist_chunk_job_t *jobs, size_t count) {
+    return codec_encrypt_batch(codec, &codec->compressor, jobs, count);
+}
+
+// compression and cipher used by a chunk, from it's key
+static int codec_key_format(const uint8_t *key, size_t keylen, flist_compression_t *type, flist_cipher_t *cipher) {
+    uint8_t tag;
+
+    if(keylen == ZEROCHUNK_HASH_LENGTH) {
+        *type = FLIST_COMPRESSION_SNAPPY;
+        *cipher = FLIST_CIPHER_XXTEA;
+        return 0;
+    }
+
+    if(keylen != ZEROCHUNK_HASH_LENGTH + 1) {
+        libflist_set_error("invalid decipher key length");
+        return 1;
+    }
+
+    tag = key[ZEROCHUNK_HASH_LENGTH];
+
+    if((tag & CHUNK_TAG_COMPRESSION) >= COMPRESSION_COUNT || (tag >> CHUNK_TAG_CIPHER_SHIFT) >= CIPHER_COUNT) {
+        libflist_set_error("invalid decipher key");
+        return 1;
+    }
+
+    *type = (flist_compression_t)(tag & CHUNK_TAG_COMPRESSION);
+    *cipher = (flist_cipher_t)(tag >> CHUNK_TAG_CIPHER_SHIFT);
+
+    return 0;
+}
+
+static int codec_uncompressed_length(flist_compression_t type, uint8_t *uncipher, size_t uncipherlength, size_t *length) {
+    unsigned long long content;
+    snappy_status status;
+
+    switch(type) {
+        case FLIST_COMPRESSION_STORE:
+            *length = uncipherlength;
+            return 0;
+
+        case FLIST_COMPRESSION_ZSTD:
+        case FLIST_COMPRESSION_ZSTD_DICT:
+            content = ZSTD_getFrameContentSize(uncipher, uncipherlength);
+
+            if(content == ZSTD_CONTENTSIZE_UNKNOWN || content == ZSTD_CONTENTSIZE_ERROR) {
+                libflist_set_error("zstd uncompression length error");
+                return 1;
+            }
+
+            *length = content;
+            return 0;
+
+        case FLIST_COMPRESSION_LZ4:
+            if(uncipherlength < COMPRESSION_LZ4_HEADER) {
+                libflist_set_error("lz4 uncompression length error");
+                return 1;
+            }
+
+            *length = 0;
+            for(int i = 0; i < COMPRESSION_LZ4_HEADER; i++)
+                *length |= (size_t) uncipher[i] << (i * 8);
+
+            return 0;
+
+        default:
+            if((status = snappy_uncompressed_length((char *) uncipher, uncipherlength, length)) != SNAPPY_OK) {
+                libflist_set_error("snappy uncompression length error: %d", status);
+                return 1;
+            }
+
+            return 0;
+    }
+}
+
+static int codec_uncompress(flist_chunk_codec_t *codec, flist_compressor_t *compressor, flist_compression_t type, uint8_t *uncipher, size_t uncipherlength, uint8_t *target, size_t length) {
+    ZSTD_DDict *ddict = NULL;
+    snappy_status status;
+    size_t value;
+    int written;
+
+    switch(type) {
+        case FLIST_COMPRESSION_STORE:
+            memcpy(target, uncipher, length);
+            return 0;
+
+        case FLIST_COMPRESSION_ZSTD:
+        case FLIST_COMPRESSION_ZSTD_DICT:
+            if(!codec->zdecompress && !(codec->zdecompress = ZSTD_createDCtx())) {
+                libflist_set_error("zstd context allocation failed");
+                return 1;
+            }
+
+            if(type == FLIST_COMPRESSION_ZSTD_DICT && !(ddict = codec_ddict(codec, compressor->dictionary)))
+                return 1;
+
+            if(ddict) value = ZSTD_decompress_usingDDict(codec->zdecompress, target, length, uncipher, uncipherlength, ddict);
+            else value = ZSTD_decompressDCtx(codec->zdecompress, target, length, uncipher, uncipherlength);
+
+            if(ZSTD_isError(value) || value != length) {
+                libflist_set_error("zstd uncompression error");
+                return 1;
+            }
+
+            return 0;
+
+        case FLIST_COMPRESSION_LZ4:
+            written = LZ4_decompress_safe((char *) uncipher + COMPRESSION_LZ4_HEADER, (char *) target, uncipherlength - COMPRESSION_LZ4_HEADER, length);
+
+            if(written < 0 || (size_t) written != length) {
+                libflist_set_error("lz4 uncompression error");
+                return 1;
+            }
+
+            return 0;
+
+        default:
+            if((status = snappy_uncompress((char *) uncipher, uncipherlength, (char *) target, &length)) != SNAPPY_OK) {
+                libflist_set_error("snappy uncompression error: %d", status);
+                return 1;
+            }
+
+            return 0;
+    }
+}
+
+// decompress and check integrity of an uncrypted payload, integrity
+// check is skipped for aead payloads, already authenticated, the compressor
+// gives the flist settings (chunks hash and dictionary)
+static int codec_decompress(flist_chunk_codec_t *codec, flist_compressor_t *compressor, uint8_t *uncipher, size_t uncipherlength, const uint8_t *key, size_t keylen, flist_compression_t type, int authenticated, flist_buffer_t *plain) {
+    char hexhash[(FLIST_CHUNK_KEY_MAXLENGTH * 2) + 1];
+    uint8_t integrity[ZEROCHUNK_HASH_LENGTH];
+    size_t uncompressed_length = 0;
+    blake2b_job_t hash;
+    uint8_t *target;
+
+    debug("[+] libflist: chunk: uncompressing %lu bytes (%s)\n", uncipherlength, libflist_compression_name(type));
+
+    if(codec_uncompressed_length(type, uncipher, uncipherlength, &uncompressed_length))
+        return 1;
+
+    if(plain->data) {
+        if(plain->length < uncompressed_length) {
+            libflist_set_error("plain buffer too small (%lu, need %lu)", plain->length, uncompressed_length);
+            return 1;
+        }
+
+        target = plain->data;
+
+    } else {
+        if(codec_reserve(&codec->plain, &codec->plainsize, uncompressed_length))
+            return 1;
+
+        target = codec->plain;
+    }
+
+    if(codec_uncompress(codec, compressor, type, uncipher, uncipherlength, target, uncompressed_length))
+        return 1;
+
+    if(authenticated)
+        goto done;
 
     //
     // testing integrity
     //
-    unsigned char *integrity = libflist_chunk_hash((unsigned char *) uncompress, uncompressed_length);
-    // printf("[+] integrity: %s\n", integrity);
-
+    hash = (blake2b_job_t) {.data = target, .length = uncompressed_length, .hash = integrity, .hashlen = ZEROCHUNK_HASH_LENGTH};
 
-    if(memcmp(integrity, chunk->cipher.data, chunk->cipher.length)) {
-        char *inhash = libflist_hashhex(integrity, ZEROCHUNK_HASH_LENGTH);
-        char *outhash = libflist_hashhex(chunk->cipher.data, chunk->cipher.length);
+    if(hash_compute(compressor->hash, &hash, 1)) {
+        libflist_set_error("%s failed", libflist_hash_name(compressor->hash));
+        return 1;
+    }
 
+    if(memcmp(integrity, key, ZEROCHUNK_HASH_LENGTH)) {
         debug("[-] libflist: integrity check failed: hash mismatch\n");
-        debug("[-] libflist: %s <> %s\n", inhash, outhash);
+        debug("[-] libflist: %s <> ", libflist_hashhex_buffer(integrity, ZEROCHUNK_HASH_LENGTH, hexhash));
+        debug("%s\n", libflist_hashhex_buffer((uint8_t *) key, keylen, hexhash));
         libflist_set_error("chunk integrity mismatch");
+        return 1;
+    }
+
+done:
+    plain->data = target;
+    plain->length = uncompressed_length;
+
+    return 0;
+}
+
+// uncrypt a buffer in place, the input buffer is modified
+// if plain buffer data is provided, payload is written into it (plain length
+// needs to be set to the buffer size), otherwise plain points to codec memory,
+// valid until next codec call, chunks are verified and uncompressed with the
+// compressor settings (flist hash and dictionary)
+int libflist_chunk_codec_decrypt_inplace_with(flist_chunk_codec_t *codec, flist_compressor_t *compressor, uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain) {
+    char hexhash[(FLIST_CHUNK_KEY_MAXLENGTH * 2) + 1];
+    flist_compression_t type;
+    flist_cipher_t cipher;
+    size_t uncipherlength;
+
+    if(codec_key_format(key, keylen, &type, &cipher))
+        return 1;
+
+    // xxtea works on 32 bits words, unaligned
+    // buffer needs to be moved to codec memory
+    if(cipher == FLIST_CIPHER_XXTEA && ((uintptr_t) data & 3))
+        return libflist_chunk_codec_decrypt_with(codec, compressor, data, length, key, keylen, plain);
+
+    debug("[+] libflist: chunk: uncrypt %lu buffer (%s), with key: %s\n", length, libflist_cipher_name(cipher), libflist_hashhex_buffer((uint8_t *) key, keylen, hexhash));
+
+    if(cipher != FLIST_CIPHER_XXTEA) {
+        uint8_t *payload = data + CIPHER_AEAD_NONCE;
+
+        if(codec_aead_decrypt(codec, cipher, key, data, length, payload, &uncipherlength))
+            return 1;
+
+        return codec_decompress(codec, compressor, payload, uncipherlength, key, keylen, type, 1, plain);
+    }
 
-        free(inhash);
-        free(outhash);
+    // compression tag is not part of the encryption key
+    if(xxtea_decrypt_bkey_inplace(data, length, key, ZEROCHUNK_HASH_LENGTH, &uncipherlength)) {
+        libflist_set_error("cannot decrypt data, invalid key or payload");
+        return 1;
+    }
+
+    return codec_decompress(codec, compressor, data, uncipherlength, key, keylen, type, 0, plain);
+}
+
+// uncrypt a buffer, the input buffer is not modified
+// see libflist_chunk_codec_decrypt_inplace_with for plain buffer
+int libflist_chunk_codec_decrypt_with(flist_chunk_codec_t *codec, flist_compressor_t *compressor, const uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain) {
+    char hexhash[(FLIST_CHUNK_KEY_MAXLENGTH * 2) + 1];
+    flist_compression_t type;
+    flist_cipher_t cipher;
+    size_t uncipherlength;
+
+    if(codec_key_format(key, keylen, &type, &cipher))
+        return 1;
+
+    debug("[+] libflist: chunk: uncrypt %lu buffer (%s), with key: %s\n", length, libflist_cipher_name(cipher), libflist_hashhex_buffer((uint8_t *) key, keylen, hexhash));
+
+    if(codec_reserve(&codec->encrypted, &codec->encryptedsize, length))
+        return 1;
+
+    if(cipher != FLIST_CIPHER_XXTEA) {
+        if(codec_aead_decrypt(codec, cipher, key, data, length, codec->encrypted, &uncipherlength))
+            return 1;
+
+        return codec_decompress(codec, compressor, codec->encrypted, uncipherlength, key, keylen, type, 1, plain);
+    }
 
+    // compression tag is not part of the encryption key
+    if(xxtea_decrypt_bkey_into(data, length, key, ZEROCHUNK_HASH_LENGTH, codec->encrypted, &uncipherlength)) {
+        libflist_set_error("cannot decrypt data, invalid key or payload");
+        return 1;
+    }
+
+    return codec_decompress(codec, compressor, codec->encrypted, uncipherlength, key, keylen, type, 0, plain);
+}
+
+// same as the _with versions, using the codec settings
+int libflist_chunk_codec_decrypt_inplace(flist_chunk_codec_t *codec, uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain) {
+    return libflist_chunk_codec_decrypt_inplace_with(codec, &codec->compressor, data, length, key, keylen, plain);
+}
+
+int libflist_chunk_codec_decrypt(flist_chunk_codec_t *codec, const uint8_t *data, size_t length, const uint8_t *key, size_t keylen, flist_buffer_t *plain) {
+    return libflist_chunk_codec_decrypt_with(codec, &codec->compressor, data, length, key, keylen, plain);
+}
+
+// encrypt a buffer
+// returns a chunk with key, cipher, data and it's length
+flist_chunk_t *libflist_chunk_encrypt(const uint8_t *chunk, size_t chunksize) {
+    flist_chunk_codec_t *codec;
+    uint8_t id[ZEROCHUNK_HASH_LENGTH];
+    uint8_t key[FLIST_CHUNK_KEY_MAXLENGTH];
+    flist_buffer_t encrypted;
+    flist_chunk_t *response;
+    size_t keylen;
+
+    if(!(codec = libflist_chunk_codec_thread()))
         return NULL;
+
+    if(libflist_chunk_codec_encrypt(codec, chunk, chunksize, id, key, &keylen, &encrypted))
+        return NULL;
+
+    if(!(response = libflist_chunk_new(id, key, NULL, 0)))
+        return NULL;
+
+    // key contains compression tag
+    if(keylen != ZEROCHUNK_HASH_LENGTH) {
+        libflist_buffer_free(&response->cipher);
+        response->cipher = libflist_buffer_new(key, keylen);
     }
 
-    free(integrity);
-    free(uncipherdata);
+    // encrypted payload lives in codec memory
+    response->encrypted = libflist_buffer_new(encrypted.data, encrypted.length);
+
+    return response;
+}
+
+// uncrypt a chunk of an flist, compressor holds the flist settings
+// (chunks hash and dictionary, see libflist_metadata_hash_load and
+// libflist_metadata_dictionary_load), NULL uses the defaults
+// returns a chunk (without key and cipher) with payload data and length
+flist_chunk_t *libflist_chunk_decrypt_with(flist_chunk_t *chunk, flist_compressor_t *compressor) {
+    flist_chunk_codec_t *codec;
+    flist_buffer_t plain = {
+        .data = NULL,
+        .length = 0,
+    };
+
+    if(!(codec = libflist_chunk_codec_thread()))
+        return NULL;
+
+    if(!compressor)
+        compressor = &codec->compressor;
+
+    if(libflist_chunk_codec_decrypt_with(codec, compressor, chunk->encrypted.data, chunk->encrypted.length, chunk->cipher.data, chunk->cipher.length, &plain))
+        return NULL;
+
+    // plain payload lives in codec memory
+    chunk->plain = libflist_buffer_new(plain.data, plain.length);
 
     return chunk;
 }
 
+// uncrypt a chunk with default settings (blake2b, no dictionary)
+flist_chunk_t *libflist_chunk_decrypt(flist_chunk_t *chunk) {
+    return libflist_chunk_decrypt_with(chunk, NULL);
+}
+
 static uint8_t *buffer_duplicate(flist_buffer_t *input) {
     uint8_t *copy;
 
@@ -313,10 +1260,18 @@ static uint8_t *buffer_duplicate(flist_buffer_t *input) {
 // compute file chunks, if context backend is specified (not NULL), committing
 // the chunk into the backend
 inode_chunks_t *libflist_chunks_proceed(char *localfile, flist_ctx_t *ctx) {
+    flist_chunk_codec_t *codec;
+    flist_compressor_t compressor;
     buffer_t *buffer;
     inode_chunks_t *chunks;
     size_t totalsize = 0;
 
+    if(!(codec = libflist_chunk_codec_thread()))
+        return NULL;
+
+    // chunks compression is a context setting
+    compressor = ctx ? ctx->compressor : codec->compressor;
+
     // initialize buffer
     if(!(buffer = bufferize(localfile)))
         return NULL;
@@ -334,36 +1289,70 @@ inode_chunks_t *libflist_chunks_proceed(char *localfile, flist_ctx_t *ctx) {
     // processing each chunks
     debug("[+] libflist: chunks: processing %d chunks\n", buffer->chunks);
 
-    for(int i = 0; i < buffer->chunks; i++) {
-        const unsigned char *data = buffer_next(buffer);
+    // chunks are read and encrypted by batches, each chunk
+    // is loaded into the plain buffer of it's batch codec
+    for(int i = 0; i < buffer->chunks; i += FLIST_CHUNK_BATCH) {
+        flist_chunk_job_t jobs[FLIST_CHUNK_BATCH];
+        uint8_t ids[FLIST_CHUNK_BATCH][ZEROCHUNK_HASH_LENGTH];
+        uint8_t keys[FLIST_CHUNK_BATCH][FLIST_CHUNK_KEY_MAXLENGTH];
+        size_t count = buffer->chunks - i;
+
+        if(count > FLIST_CHUNK_BATCH)
+            count = FLIST_CHUNK_BATCH;
+
+        for(size_t j = 0; j < count; j++) {
+            flist_chunk_codec_t *lane;
+
+            if(!(lane = codec_lane(codec, j)))
+                return NULL;
+
+            if(codec_reserve(&lane->plain, &lane->plainsize, buffer->chunksize))
+                return NULL;
+
+            if(!(jobs[j].data = buffer_next_into(buffer, lane->plain)))
+                return NULL;
 
-        // encrypting chunk
-        flist_chunk_t *chunk;
-        inode_chunk_t *ichunk = &chunks->list[i];
+            jobs[j].length = buffer->chunksize;
+            jobs[j].id = ids[j];
+            jobs[j].key = keys[j];
+        }
 
-        if(!(chunk = libflist_chunk_encrypt(data, buffer->chunksize))) {
+        // encrypting chunks, using codec memory
+        // and local id and key, nothing is allocated
+        if(codec_encrypt_batch(codec, &compressor, jobs, count)) {
             // FIXME: memory leak
             return NULL;
         }
 
-        ichunk->entryid = buffer_duplicate(&chunk->id);
-        ichunk->entrylen = chunk->id.length;
-        ichunk->decipher = buffer_duplicate(&chunk->cipher);
-        ichunk->decipherlen = chunk->cipher.length;
+        flist_chunk_t batch[FLIST_CHUNK_BATCH];
+
+        for(size_t j = 0; j < count; j++) {
+            inode_chunk_t *ichunk = &chunks->list[i + j];
+            flist_chunk_t *chunk = &batch[j];
+
+            *chunk = (flist_chunk_t) {
+                .id = {.data = ids[j], .length = ZEROCHUNK_HASH_LENGTH},
+                .cipher = {.data = keys[j], .length = jobs[j].keylen},
+                .encrypted = jobs[j].encrypted,
+            };
+
+            ichunk->entryid = buffer_duplicate(&chunk->id);
+            ichunk->entrylen = chunk->id.length;
+            ichunk->decipher = buffer_duplicate(&chunk->cipher);
+            ichunk->decipherlen = chunk->cipher.length;
+
+            totalsize += chunk->encrypted.length;
+        }
 
         // if context is provided
-        // uploading this chunk
+        // uploading the whole batch
         if(ctx && ctx->backend) {
-            if(libflist_backend_chunk_commit(ctx->backend, chunk) < 0) {
+            if(libflist_backend_chunks_commit(ctx->backend, batch, count) < 0) {
                 // FIXME: memory leak
                 fprintf(stderr, "[-] libflist: chunk: %s\n", libflist_strerror());
                 return NULL;
             }
         }
-
-        totalsize += chunk->encrypted.length;
-
-        libflist_chunk_free(chunk);
     }
 
     debug("[+] libflist: chunks: %lu bytes\n", totalsize);
@@ -20,6 +20,7 @@
     buffer_t *bufferize(char *filename);
     buffer_t *buffer_writer(char *filename);
     const uint8_t *buffer_next(buffer_t *buffer);
+    const uint8_t *buffer_next_into(buffer_t *buffer, uint8_t *target);
     void buffer_free(buffer_t *buffer);
 
     // chunk
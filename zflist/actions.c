@@ -18,6 +18,7 @@
 #include "actions.h"
 #include "actions_metadata.h"
 #include "actions_hub.h"
+#include "actions_bench.h"
 #include "prefetch.h"
 
 //
@@ -62,9 +63,24 @@ int zf_init(zf_callback_t *cb) {
 
     debug("[+] action: creating the flist database\n");
     flist_db_t *database = libflist_db_sqlite_init(cb->settings->mnt);
+    zf_internal_db_profile(database);
+    zf_internal_db_schema(database);
     database->open(database);
 
     flist_ctx_t *ctx = libflist_context_create(database, NULL);
+    char *hash;
+
+    // chunks hash is chosen when the flist is created
+    if((hash = getenv("ZFLIST_HASH"))) {
+        if(libflist_hash_parse(&ctx->compressor, hash) || !libflist_metadata_hash_set(database, ctx->compressor.hash)) {
+            zf_error(cb, "init", "hash: %s", libflist_strerror());
+            database->close(database);
+            libflist_context_free(ctx);
+            return 1;
+        }
+
+        debug("[+] action: init: chunks hash: %s\n", libflist_hash_name(ctx->compressor.hash));
+    }
 
     // initialize root directory
     dirnode_t *root = libflist_dirnode_create("", "");
@@ -90,6 +106,34 @@ int zf_commit(zf_callback_t *cb) {
     }
 
     char *filename = cb->argv[1];
+    char *compact = getenv("ZFLIST_COMPACT");
+    char temp[2048];
+
+    // database (old flists) is converted to the v2 schema (unless v1
+    // is requested) and compacted once here, not on each change, opening
+    // it for changes also restores its journal (wal kept by readers)
+    snprintf(temp, sizeof(temp), "%s/flistdb.sqlite3", cb->settings->mnt);
+    if(file_exists(temp)) {
+        int incremental = (compact && strcmp(compact, "incremental") == 0);
+        flist_db_t *database = libflist_db_sqlite_init(cb->settings->mnt);
+        int schema = zf_internal_db_schema(database);
+
+        if(!database->open(database)) {
+            fprintf(stderr, "[-] commit: database: %s\n", libflist_strerror());
+
+        } else if(schema == 2 && libflist_db_sqlite_upgrade(database)) {
+            fprintf(stderr, "[-] commit: upgrade: %s\n", libflist_strerror());
+
+        } else if(!(compact && strcmp(compact, "none") == 0)) {
+            debug("[+] action: commit: compacting database (%s)\n", incremental ? "incremental" : "full");
+
+            if(libflist_db_sqlite_compact(database, incremental))
+                fprintf(stderr, "[-] commit: compact: %s\n", libflist_strerror());
+        }
+
+        database->close(database);
+    }
+
     debug("[+] action: commit: creating <%s>\n", filename);
 
     // removing possible already existing db
@@ -403,31 +447,7 @@ int zf_find(zf_callback_t *cb) {
         return 1;
     }
 
-    zf_find_recursive(cb, dirnode, 0);
-    zf_find_finalize(cb);
-
-    libflist_dirnode_free(dirnode);
-
-    return 0;
-}
-
-//
-// check
-//
-int zf_check(zf_callback_t *cb) {
-    dirnode_t *dirnode;
-
-    if(!(zf_public_backend_extract(cb->ctx))) {
-        zf_error(cb, "check", "backend: %s", libflist_strerror());
-        return 1;
-    }
-
-    if(!(dirnode = libflist_dirnode_get(cb->ctx->db, "/"))) {
-        zf_error(cb, "check", "no such root directory");
-        return 1;
-    }
-
-    zf_find_recursive(cb, dirnode, 1);
+    zf_find_recursive(cb, dirnode, ZF_INTEGRITY_NONE);
     zf_find_finalize(cb);
 
     libflist_dirnode_free(dirnode);
@@ -519,7 +539,7 @@ int zf_cat(zf_callback_t *cb) {
         return 1;
     }
 
-    if(!(zf_public_backend_extract(cb->ctx))) {
+    if(!(zf_public_backend_extract(cb->ctx, 1))) {
         zf_error(cb, "cat", "backend: %s", libflist_strerror());
         return 1;
     }
@@ -551,17 +571,23 @@ int zf_cat(zf_callback_t *cb) {
         return 1;
     }
 
+    // chunks are verified with the flist hash and uncompressed
+    // with its dictionary, the backend carries the context settings
+    flist_chunk_codec_t *codec = libflist_chunk_codec_thread();
+
     for(size_t i = 0; i < inode->chunks->size; i++) {
         inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
+        flist_chunk_t chunk = {
+            .id = {.data = ichunk->entryid, .length = ichunk->entrylen},
+            .cipher = {.data = ichunk->decipher, .length = ichunk->decipherlen},
+        };
 
-        if(!libflist_backend_download_chunk(cb->ctx->backend, chunk)) {
+        if(!codec || !libflist_backend_download_chunk_codec(cb->ctx->backend, codec, &chunk)) {
             zf_error(cb, "cat", "could not download file: %s", libflist_strerror());
             return 1;
         }
 
-        printf("%.*s\n", (int) chunk->plain.length, chunk->plain.data);
-        libflist_chunk_free(chunk);
+        printf("%.*s\n", (int) chunk.plain.length, chunk.plain.data);
     }
 
     libflist_dirnode_free(dirnode);
@@ -578,7 +604,7 @@ int zf_get(zf_callback_t *cb) {
         return 1;
     }
 
-    if(!(zf_public_backend_extract(cb->ctx))) {
+    if(!(zf_public_backend_extract(cb->ctx, 1))) {
         zf_error(cb, "get", "backend: %s", libflist_strerror());
         return 1;
     }
@@ -615,19 +641,24 @@ int zf_get(zf_callback_t *cb) {
     if((fd = creat(destination, 0664)) < 0)
         zf_diep(cb, destination);
 
+    // chunks are verified with the flist hash and uncompressed
+    // with its dictionary, the backend carries the context settings
+    flist_chunk_codec_t *codec = libflist_chunk_codec_thread();
+
     for(size_t i = 0; i < inode->chunks->size; i++) {
         inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
+        flist_chunk_t chunk = {
+            .id = {.data = ichunk->entryid, .length = ichunk->entrylen},
+            .cipher = {.data = ichunk->decipher, .length = ichunk->decipherlen},
+        };
 
-        if(!libflist_backend_download_chunk(cb->ctx->backend, chunk)) {
+        if(!codec || !libflist_backend_download_chunk_codec(cb->ctx->backend, codec, &chunk)) {
             zf_error(cb, "get", "could not download file: %s", libflist_strerror());
             return 1;
         }
 
-        if(write(fd, chunk->plain.data, chunk->plain.length) != (int) chunk->plain.length)
+        if(write(fd, chunk.plain.data, chunk.plain.length) != (int) chunk.plain.length)
             zf_diep(cb, destination);
-
-        libflist_chunk_free(chunk);
     }
 
     close(fd);
@@ -764,6 +795,35 @@ int zf_putdir(zf_callback_t *cb) {
 //
 // merge
 //
+// chunks of the merged flist compressed with a dictionary needs
+// that same dictionary, the target flist adopts it if it has none
+static int zf_merge_dictionary(zf_callback_t *cb, flist_ctx_t *ctx) {
+    flist_dictionary_t *source = ctx->compressor.dictionary;
+    flist_dictionary_t *target = cb->ctx->compressor.dictionary;
+
+    if(!source)
+        return 0;
+
+    if(target) {
+        if(strcmp(source->key, target->key) == 0)
+            return 0;
+
+        zf_error(cb, "merge", "flists uses different compression dictionaries");
+        return 1;
+    }
+
+    if(!(target = libflist_dictionary_new(source->data, source->length)) || !libflist_metadata_dictionary_set(cb->ctx->db, target)) {
+        libflist_dictionary_free(target);
+        zf_error(cb, "merge", "dictionary: %s", libflist_strerror());
+        return 1;
+    }
+
+    debug("[+] action: merge: dictionary imported: %s\n", target->key);
+    cb->ctx->compressor.dictionary = target;
+
+    return 0;
+}
+
 int zf_merge(zf_callback_t *cb) {
     int value = 0;
 
@@ -790,12 +850,28 @@ int zf_merge(zf_callback_t *cb) {
     }
 
     // merging the flist with the current database
-    flist_ctx_t *ctx = zf_internal_init(dname);
+    flist_ctx_t *ctx;
+
+    if(!(ctx = zf_internal_init(dname, ZF_DB_IMMUTABLE))) {
+        zf_error(cb, "merge", "database: %s", libflist_strerror());
+        zf_remove_database(cb, dname);
+        rmdir(dname);
+        return 1;
+    }
 
     // do the merge
     dirnode_t *merged;
 
-    if((merged = libflist_merge(cb->ctx, ctx))) {
+    // chunks of both flists needs to be verified the same way
+    if(ctx->compressor.hash != cb->ctx->compressor.hash) {
+        zf_error(cb, "merge", "flists uses different chunks hash (%s, %s)",
+                 libflist_hash_name(cb->ctx->compressor.hash), libflist_hash_name(ctx->compressor.hash));
+        value = 1;
+
+    } else if(zf_merge_dictionary(cb, ctx)) {
+        value = 1;
+
+    } else if((merged = libflist_merge(cb->ctx, ctx))) {
         libflist_serial_dirnode_commit(merged, cb->ctx, merged);
         libflist_dirnode_free_recursive(merged);
 
@@ -820,6 +896,63 @@ int zf_merge(zf_callback_t *cb) {
     return value;
 }
 
+//
+// export and import
+//
+// entries and metadata of the current flist are copied to (or from) a
+// database backend (eg: a zdb namespace), an exported flist can be read
+// remotely without downloading the archive
+//
+static int zf_copy(zf_callback_t *cb, int export) {
+    char *action = export ? "export" : "import";
+    flist_db_copy_t summary = {0};
+    flist_db_t *remote;
+    int value;
+
+    if(cb->argc != 2) {
+        zf_error(cb, action, "missing backend (json) argument");
+        return 1;
+    }
+
+    if(!(remote = libflist_metadata_backend_database_json(cb->argv[1]))) {
+        zf_error(cb, action, "backend: %s", libflist_strerror());
+        return 1;
+    }
+
+    if(export)
+        value = libflist_db_copy(cb->ctx->db, remote, &summary);
+    else
+        value = libflist_db_copy(remote, cb->ctx->db, &summary);
+
+    remote->close(remote);
+
+    if(value) {
+        zf_error(cb, action, "%s", libflist_strerror());
+        return 1;
+    }
+
+    if(cb->jout) {
+        json_t *response = json_object_get(cb->jout, "response");
+
+        json_object_set_new(response, "entries", json_integer(summary.entries));
+        json_object_set_new(response, "bytes", json_integer(summary.bytes));
+        json_object_set_new(response, "metadata", json_integer(summary.metadata));
+        return 0;
+    }
+
+    printf("[+] %s: %lu entries (%lu bytes), %lu metadata\n", action, summary.entries, summary.bytes, summary.metadata);
+
+    return 0;
+}
+
+int zf_export(zf_callback_t *cb) {
+    return zf_copy(cb, 1);
+}
+
+int zf_import(zf_callback_t *cb) {
+    return zf_copy(cb, 0);
+}
+
 //
 // put et putdir (memory leak)
 //
@@ -885,6 +1018,26 @@ int zf_hub(zf_callback_t *cb) {
     return 1;
 }
 
+//
+// bench
+//
+int zf_bench(zf_callback_t *cb) {
+    if(cb->argc < 2) {
+        zf_error(cb, "bench", "missing bench subcommand");
+        return 1;
+    }
+
+    // skipping first argument
+    cb->argc -= 1;
+    cb->argv += 1;
+
+    if(strcmp(cb->argv[0], "backend") == 0)
+        return zf_bench_backend(cb);
+
+    zf_error(cb, "bench", "unknown bench subcommand");
+    return 1;
+}
+
 //
 // debug
 //
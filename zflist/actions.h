@@ -12,7 +12,6 @@
     int zf_mkdir(zf_callback_t *cb);
     int zf_ls(zf_callback_t *cb);
     int zf_find(zf_callback_t *cb);
-    int zf_check(zf_callback_t *cb);
     int zf_stat(zf_callback_t *cb);
     int zf_cat(zf_callback_t *cb);
     int zf_get(zf_callback_t *cb);
@@ -20,8 +19,14 @@
     int zf_putdir(zf_callback_t *cb);
     int zf_metadata(zf_callback_t *cb);
     int zf_merge(zf_callback_t *cb);
+    int zf_export(zf_callback_t *cb);
+    int zf_import(zf_callback_t *cb);
     int zf_debug(zf_callback_t *cb);
     int zf_prefetch(zf_callback_t *cb);
 
     int zf_hub(zf_callback_t *cb);
+    int zf_bench(zf_callback_t *cb);
+    int zf_sync_chunks(zf_callback_t *cb);
+    int zf_gc(zf_callback_t *cb);
+    int zf_check(zf_callback_t *cb);
 #endif
@@ -0,0 +1,479 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <jansson.h>
+#include "libflist.h"
+#include "zero_chunk.h"
+#include "zflist.h"
+#include "actions_bench.h"
+#include "tools.h"
+
+// keys are generated like chunks id (libflist_chunk_hash)
+#define ZF_BENCH_KEYLEN  ZEROCHUNK_HASH_LENGTH
+
+static char *zf_bench_names[] = {
+    [ZF_BENCH_SET] = "set",
+    [ZF_BENCH_EXISTS] = "exists",
+    [ZF_BENCH_GET] = "get",
+};
+
+static double zf_bench_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+//
+// operations
+//
+static size_t zf_bench_single(zf_bench_worker_t *worker, size_t index) {
+    flist_db_t *db = worker->db;
+    uint8_t *key = worker->keys[index];
+    value_t *value;
+    size_t errors = 0;
+
+    switch(worker->operation) {
+        case ZF_BENCH_SET:
+            errors = (db->set(db, key, ZF_BENCH_KEYLEN, worker->payload, worker->size) != 0);
+            break;
+
+        case ZF_BENCH_EXISTS:
+            errors = (db->exists(db, key, ZF_BENCH_KEYLEN) != 1);
+            break;
+
+        case ZF_BENCH_GET:
+            if(!(value = db->get(db, key, ZF_BENCH_KEYLEN)))
+                return 1;
+
+            errors = (!value->data || value->length != worker->size);
+            db->clean(value);
+            break;
+    }
+
+    return errors;
+}
+
+static size_t zf_bench_batch(zf_bench_worker_t *worker, flist_db_batch_t *batch, size_t index, size_t length) {
+    flist_db_t *db = worker->db;
+    size_t errors = 0;
+
+    for(size_t i = 0; i < length; i++) {
+        memset(&batch[i], 0, sizeof(flist_db_batch_t));
+
+        batch[i].key = worker->keys[index + i];
+        batch[i].keylen = ZF_BENCH_KEYLEN;
+        batch[i].data = worker->payload;
+        batch[i].datalen = worker->size;
+    }
+
+    switch(worker->operation) {
+        case ZF_BENCH_SET:
+            if(libflist_db_mset(db, batch, length))
+                return length;
+            break;
+
+        case ZF_BENCH_EXISTS:
+            if(libflist_db_mexists(db, batch, length))
+                return length;
+
+            for(size_t i = 0; i < length; i++)
+                errors += (batch[i].exists != 1);
+
+            break;
+
+        case ZF_BENCH_GET:
+            if(libflist_db_mget(db, batch, length))
+                errors = length;
+
+            for(size_t i = 0; i < length && !errors; i++)
+                errors += (!batch[i].value || batch[i].value->length != worker->size);
+
+            libflist_db_batch_clean(db, batch, length);
+            break;
+    }
+
+    return errors;
+}
+
+static void *zf_bench_worker(void *userptr) {
+    zf_bench_worker_t *worker = (zf_bench_worker_t *) userptr;
+    flist_db_batch_t *batch = NULL;
+
+    if(worker->pipeline > 1 && !(batch = malloc(sizeof(flist_db_batch_t) * worker->pipeline))) {
+        worker->errors = worker->count;
+        return NULL;
+    }
+
+    worker->samples = 0;
+    worker->errors = 0;
+
+    for(size_t index = 0; index < worker->count; index += worker->pipeline) {
+        size_t length = worker->count - index;
+        double started = zf_bench_now();
+
+        if(length > worker->pipeline)
+            length = worker->pipeline;
+
+        if(batch)
+            worker->errors += zf_bench_batch(worker, batch, index, length);
+        else
+            worker->errors += zf_bench_single(worker, index);
+
+        worker->latencies[worker->samples++] = zf_bench_now() - started;
+    }
+
+    free(batch);
+
+    return NULL;
+}
+
+//
+// run one operation on all workers at once
+//
+static int zf_bench_compare(const void *a, const void *b) {
+    double da = *((const double *) a);
+    double db = *((const double *) b);
+
+    return (da > db) - (da < db);
+}
+
+static double zf_bench_percentile(double *latencies, size_t length, double percentile) {
+    if(length == 0)
+        return 0;
+
+    return latencies[(size_t) (percentile * (length - 1))];
+}
+
+static int zf_bench_run(zf_bench_worker_t *workers, size_t concurrency, zf_bench_op_t operation, zf_bench_result_t *result) {
+    size_t samples = 0;
+    double *latencies;
+    double started;
+
+    memset(result, 0, sizeof(zf_bench_result_t));
+    result->operation = operation;
+    result->size = workers[0].size;
+
+    started = zf_bench_now();
+
+    for(size_t i = 0; i < concurrency; i++) {
+        workers[i].operation = operation;
+
+        if(pthread_create(&workers[i].thread, NULL, zf_bench_worker, &workers[i])) {
+            // run it in place, timing will be wrong but
+            // we keep all workers consistent
+            zf_bench_worker(&workers[i]);
+            workers[i].thread = 0;
+        }
+    }
+
+    for(size_t i = 0; i < concurrency; i++)
+        if(workers[i].thread)
+            pthread_join(workers[i].thread, NULL);
+
+    result->elapsed = zf_bench_now() - started;
+
+    for(size_t i = 0; i < concurrency; i++)
+        samples += workers[i].samples;
+
+    if(!(latencies = malloc(sizeof(double) * (samples + 1))))
+        return 1;
+
+    samples = 0;
+
+    for(size_t i = 0; i < concurrency; i++) {
+        memcpy(latencies + samples, workers[i].latencies, sizeof(double) * workers[i].samples);
+        samples += workers[i].samples;
+
+        result->operations += workers[i].count;
+        result->errors += workers[i].errors;
+    }
+
+    qsort(latencies, samples, sizeof(double), zf_bench_compare);
+
+    result->p50 = zf_bench_percentile(latencies, samples, 0.50);
+    result->p90 = zf_bench_percentile(latencies, samples, 0.90);
+    result->p99 = zf_bench_percentile(latencies, samples, 0.99);
+    result->max = zf_bench_percentile(latencies, samples, 1.00);
+
+    free(latencies);
+
+    return 0;
+}
+
+//
+// keys and payload of one payload size
+//
+static int zf_bench_prepare(zf_bench_worker_t *worker, size_t id, size_t size, unsigned int seed) {
+    unsigned int state = seed + id;
+    char label[128];
+
+    worker->size = size;
+
+    if(!(worker->payload = malloc(size)))
+        return 1;
+
+    for(size_t i = 0; i < size; i++)
+        worker->payload[i] = rand_r(&state);
+
+    if(!(worker->keys = calloc(worker->count, sizeof(uint8_t *))))
+        return 1;
+
+    // keys are unique per run, worker, size and index
+    for(size_t i = 0; i < worker->count; i++) {
+        int length = snprintf(label, sizeof(label), "zflist-bench:%u:%lu:%lu:%lu", seed, id, size, i);
+
+        if(!(worker->keys[i] = libflist_chunk_hash(label, length)))
+            return 1;
+    }
+
+    return 0;
+}
+
+static void zf_bench_release(zf_bench_worker_t *worker) {
+    for(size_t i = 0; i < worker->count && worker->keys; i++) {
+        // keys are not kept on the backend if it supports deletion
+        if(worker->db && worker->db->del && worker->keys[i])
+            worker->db->del(worker->db, worker->keys[i], ZF_BENCH_KEYLEN);
+
+        free(worker->keys[i]);
+    }
+
+    free(worker->keys);
+    free(worker->payload);
+
+    worker->keys = NULL;
+    worker->payload = NULL;
+}
+
+//
+// output
+//
+static void zf_bench_dump_text(zf_bench_result_t *result) {
+    double seconds = result->elapsed > 0 ? result->elapsed : 1;
+    double ops = result->operations / seconds;
+    double mbps = 0;
+
+    if(result->operation != ZF_BENCH_EXISTS)
+        mbps = (ops * result->size) / (1024 * 1024);
+
+    printf("%9lu  %-6s  %10.0f  %9.2f  %9.3f  %9.3f  %9.3f  %9.3f  %6lu\n",
+        result->size, zf_bench_names[result->operation], ops, mbps,
+        result->p50 * 1000, result->p90 * 1000, result->p99 * 1000, result->max * 1000,
+        result->errors
+    );
+}
+
+static void zf_bench_dump_json(zf_callback_t *cb, zf_bench_result_t *result) {
+    json_t *response = json_object_get(cb->jout, "response");
+    json_t *results = json_object_get(response, "results");
+    json_t *entry = json_object();
+    json_t *latency = json_object();
+
+    // latencies in microseconds
+    json_object_set_new(latency, "p50", json_integer(result->p50 * 1000000));
+    json_object_set_new(latency, "p90", json_integer(result->p90 * 1000000));
+    json_object_set_new(latency, "p99", json_integer(result->p99 * 1000000));
+    json_object_set_new(latency, "max", json_integer(result->max * 1000000));
+
+    json_object_set_new(entry, "operation", json_string(zf_bench_names[result->operation]));
+    json_object_set_new(entry, "size", json_integer(result->size));
+    json_object_set_new(entry, "operations", json_integer(result->operations));
+    json_object_set_new(entry, "errors", json_integer(result->errors));
+    json_object_set_new(entry, "elapsed", json_real(result->elapsed));
+    json_object_set_new(entry, "ops", json_real(result->elapsed > 0 ? result->operations / result->elapsed : 0));
+    json_object_set_new(entry, "latency", latency);
+
+    json_array_append_new(results, entry);
+}
+
+//
+// entry point
+//
+static struct option bench_long_options[] = {
+    {"size",        required_argument, 0, 's'},
+    {"count",       required_argument, 0, 'c'},
+    {"concurrency", required_argument, 0, 'j'},
+    {"pipeline",    required_argument, 0, 'p'},
+    {"help",        no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+static int zf_bench_sizes(char *input, size_t **sizes) {
+    char *copy = strdup(input);
+    char *token, *saveptr = NULL;
+    int count = 0;
+
+    *sizes = NULL;
+
+    for(token = strtok_r(copy, ",", &saveptr); token; token = strtok_r(NULL, ",", &saveptr)) {
+        size_t size = strtoul(token, NULL, 10);
+
+        if(size == 0)
+            continue;
+
+        if(!(*sizes = realloc(*sizes, sizeof(size_t) * (count + 1))))
+            break;
+
+        (*sizes)[count++] = size;
+    }
+
+    free(copy);
+
+    return count;
+}
+
+int zf_bench_backend(zf_callback_t *cb) {
+    zf_bench_worker_t *workers = NULL;
+    zf_bench_result_t result;
+    char *sizelist = ZF_BENCH_SIZES;
+    size_t count = ZF_BENCH_COUNT;
+    size_t concurrency = ZF_BENCH_CONCURRENCY;
+    size_t pipeline = ZF_BENCH_PIPELINE;
+    unsigned int seed = time(NULL) ^ getpid();
+    int option_index = 0;
+    size_t *sizes = NULL;
+    int nsizes, value = 1;
+    char *envbackend;
+
+    while(1) {
+        int i = getopt_long_only(cb->argc, cb->argv, "", bench_long_options, &option_index);
+
+        if(i == -1)
+            break;
+
+        switch(i) {
+            case 's':
+                sizelist = optarg;
+                break;
+
+            case 'c':
+                count = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'j':
+                concurrency = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                pipeline = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'h':
+                printf("[+] action: bench: arguments:\n");
+                printf("[+]   --size         <bytes,...>   payload sizes (default: %s)\n", ZF_BENCH_SIZES);
+                printf("[+]   --count        <count>       operations per test (default: %d)\n", ZF_BENCH_COUNT);
+                printf("[+]   --concurrency  <workers>     parallel connections (default: %d)\n", ZF_BENCH_CONCURRENCY);
+                printf("[+]   --pipeline     <depth>       operations per request (default: %d)\n", ZF_BENCH_PIPELINE);
+                printf("[+]   --help                       show this message\n");
+                printf("[+]\n");
+                printf("[+] backend is read from ZFLIST_BACKEND, keys written are kept when\n");
+                printf("[+] the backend doesn't support deletion, use a dedicated namespace\n");
+                return 1;
+
+            case '?':
+            default:
+               return 1;
+        }
+    }
+
+    if(!(envbackend = getenv("ZFLIST_BACKEND"))) {
+        zf_error(cb, "bench", "ZFLIST_BACKEND not set");
+        return 1;
+    }
+
+    if((nsizes = zf_bench_sizes(sizelist, &sizes)) == 0) {
+        zf_error(cb, "bench", "invalid payload sizes: %s", sizelist);
+        return 1;
+    }
+
+    if(count == 0 || concurrency == 0 || pipeline == 0) {
+        zf_error(cb, "bench", "count, concurrency and pipeline needs to be positive");
+        free(sizes);
+        return 1;
+    }
+
+    if(concurrency > count)
+        concurrency = count;
+
+    if(!(workers = calloc(concurrency, sizeof(zf_bench_worker_t))))
+        zf_diep(cb, "bench: calloc");
+
+    // one connection per worker, opened without cache
+    // to only measure the backend itself
+    for(size_t i = 0; i < concurrency; i++) {
+        zf_bench_worker_t *worker = &workers[i];
+
+        if(!(worker->db = libflist_metadata_backend_database_json(envbackend))) {
+            zf_error(cb, "bench", "backend: %s", libflist_strerror());
+            goto cleanup;
+        }
+
+        // operations are spread evenly, first workers take the rest
+        worker->count = (count / concurrency) + (i < count % concurrency);
+        worker->pipeline = pipeline;
+
+        if(!(worker->latencies = malloc(sizeof(double) * worker->count)))
+            zf_diep(cb, "bench: malloc");
+    }
+
+    if(cb->jout) {
+        json_t *response = json_object_get(cb->jout, "response");
+
+        json_object_set_new(response, "backend", json_string(workers[0].db->type));
+        json_object_set_new(response, "count", json_integer(count));
+        json_object_set_new(response, "concurrency", json_integer(concurrency));
+        json_object_set_new(response, "pipeline", json_integer(pipeline));
+        json_object_set_new(response, "results", json_array());
+
+    } else {
+        printf("[+] bench: %s backend, %lu operations, %lu workers, pipeline %lu\n",
+            workers[0].db->type, count, concurrency, pipeline);
+        printf("[+] bench: latencies are per request, in milliseconds\n");
+        printf("%9s  %-6s  %10s  %9s  %9s  %9s  %9s  %9s  %6s\n",
+            "size", "op", "ops/s", "MB/s", "p50", "p90", "p99", "max", "errors");
+    }
+
+    for(int s = 0; s < nsizes; s++) {
+        for(size_t i = 0; i < concurrency; i++)
+            if(zf_bench_prepare(&workers[i], i, sizes[s], seed))
+                zf_diep(cb, "bench: prepare");
+
+        // exists and get need set to be done first
+        zf_bench_op_t operations[] = {ZF_BENCH_SET, ZF_BENCH_EXISTS, ZF_BENCH_GET};
+
+        for(size_t o = 0; o < sizeof(operations) / sizeof(zf_bench_op_t); o++) {
+            if(zf_bench_run(workers, concurrency, operations[o], &result))
+                zf_diep(cb, "bench: malloc");
+
+            if(cb->jout)
+                zf_bench_dump_json(cb, &result);
+            else
+                zf_bench_dump_text(&result);
+        }
+
+        for(size_t i = 0; i < concurrency; i++)
+            zf_bench_release(&workers[i]);
+    }
+
+    value = 0;
+
+cleanup:
+    for(size_t i = 0; i < concurrency; i++) {
+        if(workers[i].db)
+            workers[i].db->close(workers[i].db);
+
+        free(workers[i].latencies);
+    }
+
+    free(workers);
+    free(sizes);
+
+    return value;
+}
@@ -0,0 +1,52 @@
+#ifndef ZFLIST_ACTIONS_BENCH_H
+    #define ZFLIST_ACTIONS_BENCH_H
+
+    // default benchmark settings
+    #define ZF_BENCH_SIZES        "4096,131072,524288"
+    #define ZF_BENCH_COUNT        1000
+    #define ZF_BENCH_CONCURRENCY  1
+    #define ZF_BENCH_PIPELINE     1
+
+    typedef enum zf_bench_op_t {
+        ZF_BENCH_SET,
+        ZF_BENCH_EXISTS,
+        ZF_BENCH_GET,
+
+    } zf_bench_op_t;
+
+    // one connection to the backend, one thread
+    typedef struct zf_bench_worker_t {
+        pthread_t thread;
+        flist_db_t *db;
+
+        zf_bench_op_t operation;
+        uint8_t *payload;         // payload sent (set) or expected (get)
+        size_t size;              // payload length
+
+        uint8_t **keys;           // keys used by this worker
+        size_t count;             // amount of keys (operations)
+        size_t pipeline;          // operations per call
+
+        double *latencies;        // one latency per call (seconds)
+        size_t samples;           // amount of latencies collected
+        size_t errors;            // failed or wrong replies
+
+    } zf_bench_worker_t;
+
+    // result of one operation, for one payload size
+    typedef struct zf_bench_result_t {
+        zf_bench_op_t operation;
+        size_t size;
+        size_t operations;
+        size_t errors;
+        double elapsed;           // wall time (seconds)
+
+        double p50;               // calls latencies (seconds)
+        double p90;
+        double p99;
+        double max;
+
+    } zf_bench_result_t;
+
+    int zf_bench_backend(zf_callback_t *cb);
+#endif
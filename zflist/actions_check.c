@@ -0,0 +1,410 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <jansson.h>
+#include "libflist.h"
+#include "zflist.h"
+#include "actions.h"
+#include "actions_check.h"
+#include "tools.h"
+
+//
+// archive integrity check
+//
+// by default, each file is listed and its chunks existence is checked
+// on the backend (one batch per file), with --server the backend verifies
+// the payloads itself (zdb CHECK), nothing is downloaded in both cases
+//
+// with --deep, every chunk referenced (once) is downloaded and decrypted
+// by parallel workers, one backend connection each, decryption verifies
+// the chunk hash, this is the only end-to-end verification
+//
+static double zf_check_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+static void zf_check_progress(zf_callback_t *cb, char *message, size_t current, size_t total) {
+    flist_progress_t progress = {
+        .message = message,
+        .current = current,
+        .total = total,
+    };
+
+    if(cb->ctx->progress_cb)
+        cb->ctx->progress_cb(cb->ctx->userptr, &progress);
+}
+
+//
+// chunks referenced
+//
+static int zf_check_collect(inode_t *inode, inode_chunk_t *chunk, void *userptr) {
+    zf_check_chunks_t *chunks = (zf_check_chunks_t *) userptr;
+    zf_check_chunk_t *entry;
+    (void) inode;
+
+    if(chunks->length == chunks->allocated) {
+        size_t allocated = chunks->allocated ? chunks->allocated * 2 : 4096;
+        zf_check_chunk_t *list;
+
+        if(!(list = realloc(chunks->list, sizeof(zf_check_chunk_t) * allocated)))
+            return 1;
+
+        chunks->list = list;
+        chunks->allocated = allocated;
+    }
+
+    entry = &chunks->list[chunks->length];
+
+    if(!(entry->id = libflist_bufdup(chunk->entryid, chunk->entrylen)))
+        return 1;
+
+    if(!(entry->key = libflist_bufdup(chunk->decipher, chunk->decipherlen))) {
+        free(entry->id);
+        return 1;
+    }
+
+    entry->idlen = chunk->entrylen;
+    entry->keylen = chunk->decipherlen;
+    chunks->length += 1;
+
+    return 0;
+}
+
+static int zf_check_compare(const void *a, const void *b) {
+    const zf_check_chunk_t *ka = (const zf_check_chunk_t *) a;
+    const zf_check_chunk_t *kb = (const zf_check_chunk_t *) b;
+
+    if(ka->idlen != kb->idlen)
+        return (ka->idlen < kb->idlen) ? -1 : 1;
+
+    return memcmp(ka->id, kb->id, ka->idlen);
+}
+
+// sort and remove duplicated chunks (shared between files)
+static void zf_check_unique(zf_check_chunks_t *chunks) {
+    size_t length = 0;
+
+    qsort(chunks->list, chunks->length, sizeof(zf_check_chunk_t), zf_check_compare);
+
+    for(size_t i = 0; i < chunks->length; i++) {
+        if(length > 0 && zf_check_compare(&chunks->list[length - 1], &chunks->list[i]) == 0) {
+            free(chunks->list[i].id);
+            free(chunks->list[i].key);
+            continue;
+        }
+
+        chunks->list[length++] = chunks->list[i];
+    }
+
+    chunks->length = length;
+}
+
+static void zf_check_chunks_free(zf_check_chunks_t *chunks) {
+    for(size_t i = 0; i < chunks->length; i++) {
+        free(chunks->list[i].id);
+        free(chunks->list[i].key);
+    }
+
+    free(chunks->list);
+}
+
+//
+// verification workers
+//
+static void *zf_check_worker(void *userptr) {
+    zf_check_t *check = (zf_check_t *) userptr;
+    size_t total = check->chunks->length;
+    flist_db_batch_t *batch = NULL;
+    flist_chunk_codec_t *codec;
+    flist_db_t *backend = NULL;
+
+    if(!(codec = libflist_chunk_codec_thread()))
+        goto failed;
+
+    if(!(backend = libflist_metadata_backend_database_json(check->backend)))
+        goto failed;
+
+    if(!(batch = calloc(check->pipeline, sizeof(flist_db_batch_t))))
+        goto failed;
+
+    while(1) {
+        size_t index, length, valid = 0, bytes = 0, missing = 0, corrupted = 0, errors = 0;
+
+        pthread_mutex_lock(&check->lock);
+
+        index = check->next;
+        length = (total - index > check->pipeline) ? check->pipeline : total - index;
+        check->next += length;
+
+        pthread_mutex_unlock(&check->lock);
+
+        if(length == 0)
+            break;
+
+        memset(batch, 0, sizeof(flist_db_batch_t) * length);
+
+        for(size_t i = 0; i < length; i++) {
+            batch[i].key = check->chunks->list[index + i].id;
+            batch[i].keylen = check->chunks->list[index + i].idlen;
+        }
+
+        if(libflist_db_mget(backend, batch, length)) {
+            errors = length;
+            goto progress;
+        }
+
+        for(size_t i = 0; i < length; i++) {
+            zf_check_chunk_t *chunk = &check->chunks->list[index + i];
+            flist_buffer_t plain = {0};
+
+            if(!batch[i].value) {
+                missing += 1;
+                continue;
+            }
+
+            bytes += batch[i].value->length;
+
+            if(libflist_chunk_codec_decrypt_with(codec, &check->cb->ctx->compressor, (uint8_t *) batch[i].value->data, batch[i].value->length, chunk->key, chunk->keylen, &plain)) {
+                char *hexid = libflist_hashhex(chunk->id, chunk->idlen);
+                debug("[-] check: chunk %s: %s\n", hexid, libflist_strerror());
+                free(hexid);
+
+                corrupted += 1;
+                continue;
+            }
+
+            valid += 1;
+        }
+
+        libflist_db_batch_clean(backend, batch, length);
+
+    progress:
+        pthread_mutex_lock(&check->lock);
+
+        check->valid += valid;
+        check->bytes += bytes;
+        check->missing += missing;
+        check->corrupted += corrupted;
+        check->errors += errors;
+
+        zf_check_progress(check->cb, "verifying chunks", check->valid + check->missing + check->corrupted + check->errors, total);
+
+        pthread_mutex_unlock(&check->lock);
+    }
+
+    free(batch);
+    backend->close(backend);
+
+    return NULL;
+
+failed:
+    debug("[-] check: worker: %s\n", libflist_strerror());
+
+    if(backend)
+        backend->close(backend);
+
+    free(batch);
+
+    // this worker doesn't verify anything, others take over
+    return NULL;
+}
+
+//
+// output
+//
+static void zf_check_dump_text(zf_check_t *check, double elapsed) {
+    double seconds = elapsed > 0 ? elapsed : 1;
+
+    printf("[+] check: chunks referenced : %lu\n", check->chunks->length);
+    printf("[+] check: valid             : %lu (%.2f MB)\n", check->valid, check->bytes / (1024.0 * 1024));
+    printf("[+] check: missing           : %lu\n", check->missing);
+    printf("[+] check: corrupted         : %lu\n", check->corrupted);
+    printf("[+] check: not verified      : %lu\n", check->errors);
+    printf("[+] check: throughput        : %.0f chunks/s, %.2f MB/s (%.2f seconds)\n",
+        check->valid / seconds, (check->bytes / seconds) / (1024 * 1024), elapsed);
+}
+
+static void zf_check_dump_json(zf_check_t *check, double elapsed) {
+    json_t *response = json_object_get(check->cb->jout, "response");
+
+    json_object_set_new(response, "referenced", json_integer(check->chunks->length));
+    json_object_set_new(response, "valid", json_integer(check->valid));
+    json_object_set_new(response, "bytes", json_integer(check->bytes));
+    json_object_set_new(response, "missing", json_integer(check->missing));
+    json_object_set_new(response, "corrupted", json_integer(check->corrupted));
+    json_object_set_new(response, "failed", json_integer(check->errors));
+    json_object_set_new(response, "elapsed", json_real(elapsed));
+}
+
+// download and decrypt every chunk referenced
+static int zf_check_deep(zf_callback_t *cb, size_t concurrency, size_t pipeline) {
+    zf_check_chunks_t chunks = {0};
+    pthread_t *threads = NULL;
+    char *backend = NULL;
+    double started;
+    int value = 1;
+
+    zf_check_t check = {
+        .cb = cb,
+        .chunks = &chunks,
+        .pipeline = pipeline,
+    };
+
+    // value is owned by the flist database
+    if(!(backend = libflist_metadata_get(cb->ctx->db, "backend"))) {
+        zf_error(cb, "check", "flist backend metadata not found");
+        return 1;
+    }
+
+    if(!(check.backend = strdup(backend)))
+        zf_diep(cb, "check: strdup");
+
+    if(cb->progress)
+        libflist_context_set_progress(cb->ctx, cb, zf_progress_putdir_cb);
+
+    started = zf_check_now();
+
+    debug("[+] check: listing chunks referenced by the flist\n");
+
+    if(libflist_dirnode_chunks_walk(cb->ctx->db, "/", zf_check_collect, &chunks)) {
+        zf_error(cb, "check", "could not list chunks: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    zf_check_unique(&chunks);
+
+    debug("[+] check: %lu chunks to verify, %lu workers\n", chunks.length, concurrency);
+
+    pthread_mutex_init(&check.lock, NULL);
+
+    if(concurrency > chunks.length)
+        concurrency = chunks.length ? chunks.length : 1;
+
+    if(!(threads = calloc(concurrency, sizeof(pthread_t))))
+        zf_diep(cb, "check: calloc");
+
+    for(size_t i = 0; i < concurrency; i++)
+        if(pthread_create(&threads[i], NULL, zf_check_worker, &check))
+            zf_diep(cb, "check: pthread_create");
+
+    for(size_t i = 0; i < concurrency; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&check.lock);
+
+    // workers could not connect, nothing was taken
+    check.errors += chunks.length - check.next;
+
+    if(cb->jout)
+        zf_check_dump_json(&check, zf_check_now() - started);
+    else
+        zf_check_dump_text(&check, zf_check_now() - started);
+
+    if(check.missing || check.corrupted || check.errors)
+        zf_error(cb, "check", "%lu chunks are not valid", check.missing + check.corrupted + check.errors);
+    else
+        value = 0;
+
+cleanup:
+    zf_check_chunks_free(&chunks);
+    free(threads);
+    free(check.backend);
+
+    return value;
+}
+
+//
+// entry point
+//
+static struct option check_long_options[] = {
+    {"server",      no_argument,       0, 's'},
+    {"deep",        no_argument,       0, 'd'},
+    {"concurrency", required_argument, 0, 'j'},
+    {"pipeline",    required_argument, 0, 'p'},
+    {"help",        no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+int zf_check(zf_callback_t *cb) {
+    size_t concurrency = ZF_CHECK_CONCURRENCY;
+    size_t pipeline = ZF_CHECK_PIPELINE;
+    int integrity = ZF_INTEGRITY_EXISTS;
+    int option_index = 0;
+    int deep = 0;
+    dirnode_t *dirnode;
+
+    while(1) {
+        int i = getopt_long_only(cb->argc, cb->argv, "", check_long_options, &option_index);
+
+        if(i == -1)
+            break;
+
+        switch(i) {
+            case 's':
+                integrity = ZF_INTEGRITY_SERVER;
+                break;
+
+            case 'd':
+                deep = 1;
+                break;
+
+            case 'j':
+                concurrency = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                pipeline = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'h':
+                printf("[+] action: check: arguments:\n");
+                printf("[+]   --server                   backend verifies chunks payload (zdb CHECK)\n");
+                printf("[+]   --deep                     download and decrypt every chunk\n");
+                printf("[+]   --concurrency  <workers>   parallel downloads (deep, default: %d)\n", ZF_CHECK_CONCURRENCY);
+                printf("[+]   --pipeline     <depth>     chunks per request (deep, default: %d)\n", ZF_CHECK_PIPELINE);
+                printf("[+]   --help                     show this message\n");
+                printf("[+]\n");
+                printf("[+] without argument, chunks existence is checked on the backend\n");
+                return 1;
+
+            case '?':
+            default:
+               return 1;
+        }
+    }
+
+    if(deep) {
+        if(concurrency == 0 || pipeline == 0) {
+            zf_error(cb, "check", "concurrency and pipeline needs to be positive");
+            return 1;
+        }
+
+        return zf_check_deep(cb, concurrency, pipeline);
+    }
+
+    // existence is checked on the backend, never on the local cache
+    if(!(zf_public_backend_extract(cb->ctx, 0))) {
+        zf_error(cb, "check", "backend: %s", libflist_strerror());
+        return 1;
+    }
+
+    if(!(dirnode = libflist_dirnode_get(cb->ctx->db, "/"))) {
+        zf_error(cb, "check", "no such root directory");
+        return 1;
+    }
+
+    zf_find_recursive(cb, dirnode, integrity);
+    zf_find_finalize(cb);
+
+    libflist_dirnode_free(dirnode);
+
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef ZFLIST_ACTIONS_CHECK_H
+    #define ZFLIST_ACTIONS_CHECK_H
+
+    // default deep verification settings
+    #define ZF_CHECK_CONCURRENCY  4
+    #define ZF_CHECK_PIPELINE     32
+
+    // one chunk referenced by the flist, with the key
+    // needed to decrypt it (and verify its hash)
+    typedef struct zf_check_chunk_t {
+        uint8_t *id;
+        size_t idlen;
+        uint8_t *key;
+        size_t keylen;
+
+    } zf_check_chunk_t;
+
+    typedef struct zf_check_chunks_t {
+        zf_check_chunk_t *list;
+        size_t length;
+        size_t allocated;
+
+    } zf_check_chunks_t;
+
+    // shared by all the workers
+    typedef struct zf_check_t {
+        zf_callback_t *cb;
+        pthread_mutex_t lock;
+
+        char *backend;              // backend (json)
+        zf_check_chunks_t *chunks;  // chunks to verify
+        size_t next;                // next chunk to take (protected by lock)
+        size_t pipeline;            // chunks per request
+
+        size_t valid;               // chunks downloaded and verified
+        size_t bytes;               // bytes downloaded
+        size_t missing;             // chunks not found on the backend
+        size_t corrupted;           // chunks not decrypted or hash mismatch
+        size_t errors;              // chunks not verified (backend error)
+
+    } zf_check_t;
+#endif
@@ -0,0 +1,273 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <jansson.h>
+#include "libflist.h"
+#include "zflist.h"
+#include "actions.h"
+#include "actions_gc.h"
+#include "filesystem.h"
+#include "tools.h"
+
+//
+// backend garbage collection
+//
+// chunks referenced by a list of flists are added to a fixed-size set
+// (inventory bloom filter), then every key of the backend namespace is
+// checked against that set: keys not in the set are certainly not
+// referenced by any of these flists, they are reported (and deleted on
+// request), false positives only keep some garbage
+//
+// the backend namespace needs to be dedicated to these flists: a chunk
+// uploaded for another flist (or while the collection runs) would be
+// considered as garbage
+//
+
+// add chunks of one flist file to the referenced set, the flist
+// is extracted on a temporary directory, like merge does
+static int zf_gc_flist(zf_gc_t *gc, char *filename) {
+    zf_callback_t *cb = gc->cb;
+    char dname[2048];
+    flist_ctx_t *ctx;
+    int value = 0;
+
+    if(!dir_exists(cb->settings->mnt) && dir_create(cb->settings->mnt) < 0)
+        zf_diep(cb, cb->settings->mnt);
+
+    snprintf(dname, sizeof(dname), "%s/gcXXXXXX", cb->settings->mnt);
+
+    if(!mkdtemp(dname))
+        zf_diep(cb, "mkdtemp");
+
+    debug("[+] action: gc: reading %s (%s)\n", filename, dname);
+
+    if(zf_open_file(cb, filename, dname)) {
+        rmdir(dname);
+        return 1;
+    }
+
+    if(!(ctx = zf_internal_init(dname, ZF_DB_IMMUTABLE))) {
+        zf_error(cb, "gc", "%s: database: %s", filename, libflist_strerror());
+        value = 1;
+
+    } else if(libflist_inventory_flist(gc->referenced, ctx->db)) {
+        zf_error(cb, "gc", "%s: could not list chunks: %s", filename, libflist_strerror());
+        value = 1;
+    }
+
+    if(ctx)
+        zf_internal_cleanup(ctx);
+
+    if(zf_remove_database(cb, dname) || rmdir(dname) < 0)
+        debug("[-] action: gc: could not clean %s\n", dname);
+
+    return value;
+}
+
+static int zf_gc_sweep(uint8_t *key, size_t keylen, void *userptr) {
+    zf_gc_t *gc = (zf_gc_t *) userptr;
+
+    gc->scanned += 1;
+
+    if(libflist_inventory_contains(gc->referenced, key, keylen))
+        return 0;
+
+    gc->unreferenced += 1;
+
+    if(!gc->cb->jout) {
+        char *hexkey = libflist_hashhex(key, keylen);
+        printf("%s\n", hexkey);
+        free(hexkey);
+    }
+
+    if(!gc->delete)
+        return 0;
+
+    // keys are deleted after the scan, deleting
+    // while scanning could move the scan cursor
+    if(gc->stored == gc->allocated) {
+        size_t allocated = gc->allocated ? gc->allocated * 2 : 4096;
+        uint8_t **keys;
+        size_t *keyslen;
+
+        if(!(keys = realloc(gc->keys, sizeof(uint8_t *) * allocated)))
+            return 1;
+
+        gc->keys = keys;
+
+        if(!(keyslen = realloc(gc->keyslen, sizeof(size_t) * allocated)))
+            return 1;
+
+        gc->keyslen = keyslen;
+        gc->allocated = allocated;
+    }
+
+    if(!(gc->keys[gc->stored] = libflist_bufdup(key, keylen)))
+        return 1;
+
+    gc->keyslen[gc->stored++] = keylen;
+
+    return 0;
+}
+
+//
+// entry point
+//
+static struct option gc_long_options[] = {
+    {"backend", required_argument, 0, 'b'},
+    {"memory",  required_argument, 0, 'm'},
+    {"delete",  no_argument,       0, 'd'},
+    {"help",    no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+int zf_gc(zf_callback_t *cb) {
+    char *backend = getenv("ZFLIST_BACKEND");
+    size_t memory = ZF_GC_MEMORY;
+    size_t deleted = 0, failed = 0;
+    flist_db_t *backdb = NULL;
+    int option_index = 0;
+    int value = 1;
+    double rate;
+
+    zf_gc_t gc = {
+        .cb = cb,
+    };
+
+    while(1) {
+        int i = getopt_long_only(cb->argc, cb->argv, "", gc_long_options, &option_index);
+
+        if(i == -1)
+            break;
+
+        switch(i) {
+            case 'b':
+                backend = optarg;
+                break;
+
+            case 'm':
+                memory = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'd':
+                gc.delete = 1;
+                break;
+
+            case 'h':
+                printf("[+] action: gc: arguments: [options] <flist> [flist ...]\n");
+                printf("[+]   --backend  <json>   backend to clean (default: ZFLIST_BACKEND)\n");
+                printf("[+]   --memory   <mb>     referenced chunks set size (default: %d)\n", ZF_GC_MEMORY);
+                printf("[+]   --delete            delete unreferenced keys (default: only list them)\n");
+                printf("[+]   --help              show this message\n");
+                printf("[+]\n");
+                printf("[+] keys of the backend not referenced by any of the flists are\n");
+                printf("[+] garbage, the backend needs to be dedicated to these flists\n");
+                return 1;
+
+            case '?':
+            default:
+               return 1;
+        }
+    }
+
+    if(optind >= cb->argc) {
+        zf_error(cb, "gc", "missing flists list");
+        return 1;
+    }
+
+    if(!backend) {
+        zf_error(cb, "gc", "backend not set (--backend or ZFLIST_BACKEND)");
+        return 1;
+    }
+
+    if(!(gc.referenced = libflist_inventory_new(memory * 1024 * 1024))) {
+        zf_error(cb, "gc", "%s", libflist_strerror());
+        return 1;
+    }
+
+    // any flist not read would make its chunks garbage,
+    // nothing is done if one of them fails
+    for(int i = optind; i < cb->argc; i++) {
+        if(zf_gc_flist(&gc, cb->argv[i]))
+            goto cleanup;
+
+        if(cb->progress) {
+            flist_progress_t progress = {
+                .message = "reading flists",
+                .current = i - optind + 1,
+                .total = cb->argc - optind,
+            };
+
+            zf_progress_putdir_cb(cb, &progress);
+        }
+    }
+
+    rate = libflist_inventory_error_rate(gc.referenced);
+    debug("[+] action: gc: %lu chunks referenced, false positive rate: %.4f\n", gc.referenced->keys, rate);
+
+    if(rate > ZF_GC_MAX_ERROR)
+        fprintf(stderr, "[-] gc: referenced set too small (%.1f%% false positive), raise --memory\n", rate * 100);
+
+    if(!(backdb = libflist_metadata_backend_database_json(backend))) {
+        zf_error(cb, "gc", "backend: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    if(gc.delete && !backdb->del) {
+        zf_error(cb, "gc", "backend doesn't support deletion");
+        goto cleanup;
+    }
+
+    if(libflist_db_scan(backdb, zf_gc_sweep, &gc)) {
+        zf_error(cb, "gc", "backend scan: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    for(size_t i = 0; i < gc.stored; i++) {
+        if(backdb->del(backdb, gc.keys[i], gc.keyslen[i]))
+            failed += 1;
+        else
+            deleted += 1;
+    }
+
+    if(cb->jout) {
+        json_t *response = json_object_get(cb->jout, "response");
+
+        json_object_set_new(response, "referenced", json_integer(gc.referenced->keys));
+        json_object_set_new(response, "error_rate", json_real(rate));
+        json_object_set_new(response, "scanned", json_integer(gc.scanned));
+        json_object_set_new(response, "unreferenced", json_integer(gc.unreferenced));
+        json_object_set_new(response, "deleted", json_integer(deleted));
+        json_object_set_new(response, "failed", json_integer(failed));
+
+    } else {
+        printf("[+] gc: chunks referenced : %lu (%.2f%% false positive)\n", gc.referenced->keys, rate * 100);
+        printf("[+] gc: keys on backend   : %lu\n", gc.scanned);
+        printf("[+] gc: unreferenced keys : %lu\n", gc.unreferenced);
+
+        if(gc.delete)
+            printf("[+] gc: deleted           : %lu (%lu failed)\n", deleted, failed);
+    }
+
+    if(failed)
+        zf_error(cb, "gc", "%lu keys could not be deleted", failed);
+    else
+        value = 0;
+
+cleanup:
+    if(backdb)
+        backdb->close(backdb);
+
+    for(size_t i = 0; i < gc.stored; i++)
+        free(gc.keys[i]);
+
+    free(gc.keys);
+    free(gc.keyslen);
+    libflist_inventory_free(gc.referenced);
+
+    return value;
+}
@@ -0,0 +1,26 @@
+#ifndef ZFLIST_ACTIONS_GC_H
+    #define ZFLIST_ACTIONS_GC_H
+
+    // default referenced set size (megabytes), enough
+    // for ~100 millions chunks at 1% false positive
+    #define ZF_GC_MEMORY      128
+
+    // warn when the referenced set is too small for the
+    // amount of chunks (most garbage would be kept)
+    #define ZF_GC_MAX_ERROR   0.05
+
+    typedef struct zf_gc_t {
+        zf_callback_t *cb;
+        flist_inventory_t *referenced;
+
+        size_t scanned;           // keys found on the backend
+        size_t unreferenced;      // keys not referenced by any flist
+
+        int delete;               // unreferenced keys needs to be deleted
+        uint8_t **keys;           // unreferenced keys (only when deleting)
+        size_t *keyslen;
+        size_t stored;
+        size_t allocated;
+
+    } zf_gc_t;
+#endif
@@ -122,14 +122,50 @@ static struct option backend_long_options[] = {
     {"socket",    required_argument, 0, 's'},
     {"namespace", required_argument, 0, 'n'},
     {"password",  required_argument, 0, 'x'},
+    {"shard",     required_argument, 0, 'S'},
+    {"replica",   required_argument, 0, 'R'},
+    {"pack",      required_argument, 0, 'P'},
     {"reset",     no_argument,       0, 'r'},
     {"help",      no_argument,       0, 'h'},
     {0, 0, 0, 0}
 };
 
+// shard or replica: <host>:<port>[/<namespace>]
+static json_t *zf_metadata_backend_shard(zf_callback_t *cb, char *kind, char *input) {
+    char *host = strdup(input);
+    char *port, *namespace;
+    json_t *shard;
+
+    if((namespace = strchr(host, '/')))
+        *namespace++ = '\0';
+
+    if(!(port = strrchr(host, ':'))) {
+        zf_error(cb, "metadata", "%s <%s>: port missing", kind, input);
+        free(host);
+        return NULL;
+    }
+
+    *port++ = '\0';
+
+    shard = json_object();
+    json_object_set_new(shard, "host", json_string(host));
+    json_object_set_new(shard, "port", json_integer(atoi(port)));
+
+    if(namespace && *namespace)
+        json_object_set_new(shard, "namespace", json_string(namespace));
+
+    free(host);
+
+    return shard;
+}
+
 int zf_metadata_set_backend(zf_callback_t *cb) {
     json_t *root = json_object();
+    json_t *shards = json_array();
+    char *group = "shards";
     int option_index = 0;
+    json_t *shard;
+    size_t index;
 
     char *host = "hub.grid.tf";
     int port = 9900;
@@ -165,6 +201,37 @@ int zf_metadata_set_backend(zf_callback_t *cb) {
                 json_object_set_new(root, "password", json_string(optarg));
                 break;
 
+            case 'S':
+            case 'R':
+                // shards and replicas can't be mixed
+                if(json_array_size(shards) > 0 && strcmp(group, (i == 'S') ? "shards" : "replicas")) {
+                    zf_error(cb, "metadata", "shards and replicas can't be mixed");
+                    json_decref(shards);
+                    json_decref(root);
+                    return 1;
+                }
+
+                group = (i == 'S') ? "shards" : "replicas";
+
+                if(!(shard = zf_metadata_backend_shard(cb, group, optarg))) {
+                    json_decref(shards);
+                    json_decref(root);
+                    return 1;
+                }
+
+                json_array_append_new(shards, shard);
+                break;
+
+            case 'P':
+                json_decref(shards);
+                json_decref(root);
+
+                // local pack directory, nothing else needed
+                root = json_object();
+                json_object_set_new(root, "pack", json_string(optarg));
+
+                return zf_metadata_apply(cb, "backend", root);
+
             case 'h':
                 printf("[+] action: metadata: arguments:\n");
                 printf("[+]   --host       <host>        tcp remote host\n");
@@ -172,11 +239,17 @@ int zf_metadata_set_backend(zf_callback_t *cb) {
                 printf("[+]   --socket     <hostname>    unix socket path\n");
                 printf("[+]   --namespace  <namespace>   zdb namespace name (optional)\n");
                 printf("[+]   --password   <password>    zdb namespace password (optional)\n");
+                printf("[+]   --shard      <host:port/ns> add a shard, keys are spread over shards\n");
+                printf("[+]                              (can be repeated, replaces host and port)\n");
+                printf("[+]   --replica    <host:port/ns> add a replica, reads use the fastest one\n");
+                printf("[+]                              (can be repeated, replaces host and port)\n");
+                printf("[+]   --pack       <directory>   local pack files directory (no server)\n");
                 printf("[+]   --reset                    remove backend metadata\n");
                 printf("[+]   --help                     show this message\n");
                 printf("[+]\n");
                 printf("[+] tcp connection to <%s>, port %d will be set\n", host, port);
                 printf("[+] if you set the unix socket, the port needs to be set to 0\n");
+                json_decref(shards);
                 json_decref(root);
                 return 1;
 
@@ -186,6 +259,27 @@ int zf_metadata_set_backend(zf_callback_t *cb) {
         }
     }
 
+    if(json_array_size(shards) > 0) {
+        // namespace and password set globally apply to
+        // every shard which doesn't specify it's own
+        json_array_foreach(shards, index, shard) {
+            if(!json_object_get(shard, "namespace") && json_object_get(root, "namespace"))
+                json_object_set(shard, "namespace", json_object_get(root, "namespace"));
+
+            if(json_object_get(root, "password"))
+                json_object_set(shard, "password", json_object_get(root, "password"));
+        }
+
+        json_decref(root);
+
+        root = json_object();
+        json_object_set_new(root, group, shards);
+
+        return zf_metadata_apply(cb, "backend", root);
+    }
+
+    json_decref(shards);
+
     json_object_set_new(root, "host", json_string(host));
     json_object_set_new(root, "port", json_integer(port));
 
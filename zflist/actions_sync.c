@@ -0,0 +1,418 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <pthread.h>
+#include <jansson.h>
+#include "libflist.h"
+#include "zflist.h"
+#include "actions.h"
+#include "actions_sync.h"
+#include "tools.h"
+
+//
+// backend to backend chunks synchronization
+//
+// every chunk referenced by the flist is checked on the target backend
+// (batched existence requests), only missing chunks are copied: fetched
+// from the source and sent to the target by parallel workers, one source
+// and one target connection each, payloads are copied as-is (still
+// compressed and encrypted), chunks are never decoded
+//
+static double zf_sync_now() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1000000000.0);
+}
+
+static void zf_sync_progress(zf_callback_t *cb, char *message, size_t current, size_t total) {
+    flist_progress_t progress = {
+        .message = message,
+        .current = current,
+        .total = total,
+    };
+
+    if(cb->ctx->progress_cb)
+        cb->ctx->progress_cb(cb->ctx->userptr, &progress);
+}
+
+//
+// chunks referenced
+//
+static int zf_sync_collect(inode_t *inode, inode_chunk_t *chunk, void *userptr) {
+    zf_sync_keys_t *keys = (zf_sync_keys_t *) userptr;
+    (void) inode;
+
+    if(keys->length == keys->allocated) {
+        size_t allocated = keys->allocated ? keys->allocated * 2 : 4096;
+        zf_sync_key_t *list;
+
+        if(!(list = realloc(keys->list, sizeof(zf_sync_key_t) * allocated)))
+            return 1;
+
+        keys->list = list;
+        keys->allocated = allocated;
+    }
+
+    if(!(keys->list[keys->length].key = libflist_bufdup(chunk->entryid, chunk->entrylen)))
+        return 1;
+
+    keys->list[keys->length].keylen = chunk->entrylen;
+    keys->length += 1;
+
+    return 0;
+}
+
+static int zf_sync_compare(const void *a, const void *b) {
+    const zf_sync_key_t *ka = (const zf_sync_key_t *) a;
+    const zf_sync_key_t *kb = (const zf_sync_key_t *) b;
+
+    if(ka->keylen != kb->keylen)
+        return (ka->keylen < kb->keylen) ? -1 : 1;
+
+    return memcmp(ka->key, kb->key, ka->keylen);
+}
+
+// sort and remove duplicated chunks (shared between files)
+static void zf_sync_unique(zf_sync_keys_t *keys) {
+    size_t length = 0;
+
+    qsort(keys->list, keys->length, sizeof(zf_sync_key_t), zf_sync_compare);
+
+    for(size_t i = 0; i < keys->length; i++) {
+        if(length > 0 && zf_sync_compare(&keys->list[length - 1], &keys->list[i]) == 0) {
+            free(keys->list[i].key);
+            continue;
+        }
+
+        keys->list[length++] = keys->list[i];
+    }
+
+    keys->length = length;
+}
+
+static void zf_sync_keys_free(zf_sync_keys_t *keys) {
+    for(size_t i = 0; i < keys->length; i++)
+        free(keys->list[i].key);
+
+    free(keys->list);
+}
+
+// keep only the chunks not found on the target
+static int zf_sync_missing(zf_callback_t *cb, flist_db_t *target, zf_sync_keys_t *keys, zf_sync_keys_t *missing) {
+    flist_db_batch_t batch[ZF_SYNC_BATCH];
+
+    for(size_t index = 0; index < keys->length; index += ZF_SYNC_BATCH) {
+        size_t length = keys->length - index;
+
+        if(length > ZF_SYNC_BATCH)
+            length = ZF_SYNC_BATCH;
+
+        memset(batch, 0, sizeof(flist_db_batch_t) * length);
+
+        for(size_t i = 0; i < length; i++) {
+            batch[i].key = keys->list[index + i].key;
+            batch[i].keylen = keys->list[index + i].keylen;
+        }
+
+        if(libflist_db_mexists(target, batch, length))
+            return 1;
+
+        // missing list doesn't own the keys
+        for(size_t i = 0; i < length; i++)
+            if(!batch[i].exists)
+                missing->list[missing->length++] = keys->list[index + i];
+
+        zf_sync_progress(cb, "checking target", index + length, keys->length);
+    }
+
+    return 0;
+}
+
+//
+// copy workers
+//
+static void *zf_sync_worker(void *userptr) {
+    zf_sync_t *sync = (zf_sync_t *) userptr;
+    flist_db_t *source = NULL, *target = NULL;
+    flist_db_batch_t *batch = NULL;
+    size_t total = sync->missing->length;
+
+    if(!(source = libflist_metadata_backend_database_json(sync->source)))
+        goto failed;
+
+    if(!(target = libflist_metadata_backend_database_json(sync->target)))
+        goto failed;
+
+    if(!(batch = calloc(sync->pipeline, sizeof(flist_db_batch_t))))
+        goto failed;
+
+    while(1) {
+        size_t index, length, found = 0, copied = 0, bytes = 0, unavailable = 0, errors = 0;
+
+        pthread_mutex_lock(&sync->lock);
+
+        index = sync->next;
+        length = (total - index > sync->pipeline) ? sync->pipeline : total - index;
+        sync->next += length;
+
+        pthread_mutex_unlock(&sync->lock);
+
+        if(length == 0)
+            break;
+
+        memset(batch, 0, sizeof(flist_db_batch_t) * length);
+
+        for(size_t i = 0; i < length; i++) {
+            batch[i].key = sync->missing->list[index + i].key;
+            batch[i].keylen = sync->missing->list[index + i].keylen;
+        }
+
+        if(libflist_db_mget(source, batch, length)) {
+            errors = length;
+            goto progress;
+        }
+
+        // only forwarding what the source returned, batch is
+        // compacted in place (keys stay aligned with values)
+        for(size_t i = 0; i < length; i++) {
+            if(!batch[i].value) {
+                unavailable += 1;
+                continue;
+            }
+
+            batch[i].data = (uint8_t *) batch[i].value->data;
+            batch[i].datalen = batch[i].value->length;
+            bytes += batch[i].datalen;
+
+            batch[found++] = batch[i];
+        }
+
+        if(libflist_db_mset(target, batch, found)) {
+            errors = found;
+            bytes = 0;
+
+        } else {
+            copied = found;
+        }
+
+        libflist_db_batch_clean(source, batch, found);
+
+    progress:
+        pthread_mutex_lock(&sync->lock);
+
+        sync->copied += copied;
+        sync->bytes += bytes;
+        sync->unavailable += unavailable;
+        sync->errors += errors;
+
+        zf_sync_progress(sync->cb, "copying chunks", sync->copied + sync->unavailable + sync->errors, total);
+
+        pthread_mutex_unlock(&sync->lock);
+    }
+
+    free(batch);
+    source->close(source);
+    target->close(target);
+
+    return NULL;
+
+failed:
+    debug("[-] sync: worker: %s\n", libflist_strerror());
+
+    if(source)
+        source->close(source);
+
+    if(target)
+        target->close(target);
+
+    free(batch);
+
+    // this worker doesn't copy anything, others take over
+    return NULL;
+}
+
+//
+// output
+//
+static void zf_sync_dump_text(zf_sync_t *sync, size_t referenced, size_t present, double elapsed) {
+    double seconds = elapsed > 0 ? elapsed : 1;
+
+    printf("[+] sync: chunks referenced : %lu\n", referenced);
+    printf("[+] sync: already on target : %lu\n", present);
+    printf("[+] sync: copied            : %lu (%.2f MB)\n", sync->copied, sync->bytes / (1024.0 * 1024));
+    printf("[+] sync: not on source     : %lu\n", sync->unavailable);
+    printf("[+] sync: failed            : %lu\n", sync->errors);
+    printf("[+] sync: throughput        : %.0f chunks/s, %.2f MB/s (%.2f seconds)\n",
+        sync->copied / seconds, (sync->bytes / seconds) / (1024 * 1024), elapsed);
+}
+
+static void zf_sync_dump_json(zf_sync_t *sync, size_t referenced, size_t present, double elapsed) {
+    json_t *response = json_object_get(sync->cb->jout, "response");
+
+    json_object_set_new(response, "referenced", json_integer(referenced));
+    json_object_set_new(response, "present", json_integer(present));
+    json_object_set_new(response, "copied", json_integer(sync->copied));
+    json_object_set_new(response, "bytes", json_integer(sync->bytes));
+    json_object_set_new(response, "unavailable", json_integer(sync->unavailable));
+    json_object_set_new(response, "failed", json_integer(sync->errors));
+    json_object_set_new(response, "elapsed", json_real(elapsed));
+}
+
+//
+// entry point
+//
+static struct option sync_long_options[] = {
+    {"target",      required_argument, 0, 't'},
+    {"concurrency", required_argument, 0, 'j'},
+    {"pipeline",    required_argument, 0, 'p'},
+    {"help",        no_argument,       0, 'h'},
+    {0, 0, 0, 0}
+};
+
+int zf_sync_chunks(zf_callback_t *cb) {
+    zf_sync_keys_t keys = {0}, missing = {0};
+    pthread_t *threads = NULL;
+    flist_db_t *target = NULL;
+    size_t concurrency = ZF_SYNC_CONCURRENCY;
+    int option_index = 0;
+    char *source = NULL;
+    double started;
+    int value = 1;
+
+    zf_sync_t sync = {
+        .cb = cb,
+        .target = getenv("ZFLIST_BACKEND"),
+        .pipeline = ZF_SYNC_PIPELINE,
+    };
+
+    while(1) {
+        int i = getopt_long_only(cb->argc, cb->argv, "", sync_long_options, &option_index);
+
+        if(i == -1)
+            break;
+
+        switch(i) {
+            case 't':
+                sync.target = optarg;
+                break;
+
+            case 'j':
+                concurrency = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'p':
+                sync.pipeline = strtoul(optarg, NULL, 10);
+                break;
+
+            case 'h':
+                printf("[+] action: sync-chunks: arguments:\n");
+                printf("[+]   --target       <json>      target backend (default: ZFLIST_BACKEND)\n");
+                printf("[+]   --concurrency  <workers>   parallel copies (default: %d)\n", ZF_SYNC_CONCURRENCY);
+                printf("[+]   --pipeline     <depth>     chunks per request (default: %d)\n", ZF_SYNC_PIPELINE);
+                printf("[+]   --help                     show this message\n");
+                printf("[+]\n");
+                printf("[+] chunks are read from the flist backend (metadata) and copied\n");
+                printf("[+] to the target backend when not already there\n");
+                return 1;
+
+            case '?':
+            default:
+               return 1;
+        }
+    }
+
+    if(!sync.target) {
+        zf_error(cb, "sync-chunks", "target backend not set (--target or ZFLIST_BACKEND)");
+        return 1;
+    }
+
+    if(concurrency == 0 || sync.pipeline == 0) {
+        zf_error(cb, "sync-chunks", "concurrency and pipeline needs to be positive");
+        return 1;
+    }
+
+    // value is owned by the flist database
+    if(!(source = libflist_metadata_get(cb->ctx->db, "backend"))) {
+        zf_error(cb, "sync-chunks", "flist backend metadata not found");
+        return 1;
+    }
+
+    if(!(sync.source = strdup(source)))
+        zf_diep(cb, "sync: strdup");
+
+    if(cb->progress)
+        libflist_context_set_progress(cb->ctx, cb, zf_progress_putdir_cb);
+
+    started = zf_sync_now();
+
+    debug("[+] sync: listing chunks referenced by the flist\n");
+
+    if(libflist_dirnode_chunks_walk(cb->ctx->db, "/", zf_sync_collect, &keys)) {
+        zf_error(cb, "sync-chunks", "could not list chunks: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    zf_sync_unique(&keys);
+
+    if(!(target = libflist_metadata_backend_database_json(sync.target))) {
+        zf_error(cb, "sync-chunks", "target: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    if(!(missing.list = malloc(sizeof(zf_sync_key_t) * (keys.length + 1))))
+        zf_diep(cb, "sync: malloc");
+
+    if(zf_sync_missing(cb, target, &keys, &missing)) {
+        zf_error(cb, "sync-chunks", "target: %s", libflist_strerror());
+        goto cleanup;
+    }
+
+    debug("[+] sync: %lu chunks referenced, %lu missing on target\n", keys.length, missing.length);
+
+    sync.missing = &missing;
+    pthread_mutex_init(&sync.lock, NULL);
+
+    if(concurrency > missing.length)
+        concurrency = missing.length ? missing.length : 1;
+
+    if(!(threads = calloc(concurrency, sizeof(pthread_t))))
+        zf_diep(cb, "sync: calloc");
+
+    for(size_t i = 0; i < concurrency; i++)
+        if(pthread_create(&threads[i], NULL, zf_sync_worker, &sync))
+            zf_diep(cb, "sync: pthread_create");
+
+    for(size_t i = 0; i < concurrency; i++)
+        pthread_join(threads[i], NULL);
+
+    pthread_mutex_destroy(&sync.lock);
+
+    // workers could not connect, nothing was taken
+    sync.errors += missing.length - sync.next;
+
+    if(cb->jout)
+        zf_sync_dump_json(&sync, keys.length, keys.length - missing.length, zf_sync_now() - started);
+    else
+        zf_sync_dump_text(&sync, keys.length, keys.length - missing.length, zf_sync_now() - started);
+
+    if(sync.errors || sync.unavailable)
+        zf_error(cb, "sync-chunks", "%lu chunks could not be copied", sync.errors + sync.unavailable);
+    else
+        value = 0;
+
+cleanup:
+    if(target)
+        target->close(target);
+
+    zf_sync_keys_free(&keys);
+    free(missing.list);
+    free(threads);
+    free(sync.source);
+
+    return value;
+}
@@ -0,0 +1,41 @@
+#ifndef ZFLIST_ACTIONS_SYNC_H
+    #define ZFLIST_ACTIONS_SYNC_H
+
+    // default synchronization settings
+    #define ZF_SYNC_CONCURRENCY  4
+    #define ZF_SYNC_PIPELINE     32
+    #define ZF_SYNC_BATCH        1024   // existence checked per request
+
+    // one chunk id referenced by the flist
+    typedef struct zf_sync_key_t {
+        uint8_t *key;
+        size_t keylen;
+
+    } zf_sync_key_t;
+
+    typedef struct zf_sync_keys_t {
+        zf_sync_key_t *list;
+        size_t length;
+        size_t allocated;
+
+    } zf_sync_keys_t;
+
+    // shared by all the workers
+    typedef struct zf_sync_t {
+        zf_callback_t *cb;
+        pthread_mutex_t lock;
+
+        char *source;             // source backend (json)
+        char *target;             // target backend (json)
+
+        zf_sync_keys_t *missing;  // chunks to copy
+        size_t next;              // next chunk to take (protected by lock)
+        size_t pipeline;          // chunks per request
+
+        size_t copied;            // chunks copied
+        size_t bytes;             // bytes copied
+        size_t unavailable;       // chunks not found on the source
+        size_t errors;            // chunks not copied
+
+    } zf_sync_t;
+#endif
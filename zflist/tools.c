@@ -8,7 +8,9 @@
 #include <unistd.h>
 #include <libgen.h>
 #include <getopt.h>
+#include <sys/stat.h>
 #include "libflist.h"
+#include "zero_chunk.h"
 #include "zflist.h"
 #include "filesystem.h"
 #include "tools.h"
@@ -17,14 +19,97 @@ void __cleanup_free(void *p) {
     free(* (void **) p);
 }
 
-flist_ctx_t *zf_internal_init(char *mountpoint) {
+// sqlite tuning (ingest for large putdir, read for lookups),
+// needs to be set before the database is opened
+void zf_internal_db_profile(flist_db_t *database) {
+    flist_db_profile_t profile;
+    char *value;
+
+    if(!(value = getenv("ZFLIST_SQLITE_PROFILE")))
+        return;
+
+    if(libflist_db_profile_parse(&profile, value) || libflist_db_sqlite_profile(database, profile)) {
+        fprintf(stderr, "[-] sqlite profile: %s, using default\n", libflist_strerror());
+        return;
+    }
+
+    debug("[+] database: sqlite profile: %s\n", libflist_db_profile_name(profile));
+}
+
+// entries schema of new flists, and of old flists converted on
+// commit (v2 by default, v1 keeps them readable by older tools)
+int zf_internal_db_schema(flist_db_t *database) {
+    char *value;
+    int version;
+
+    if(!(value = getenv("ZFLIST_SCHEMA")))
+        return 2;
+
+    if(strcmp(value, "v1") == 0) {
+        version = 1;
+
+    } else if(strcmp(value, "v2") == 0) {
+        version = 2;
+
+    } else {
+        fprintf(stderr, "[-] schema: unknown schema: %s, using v2\n", value);
+        return 2;
+    }
+
+    if(libflist_db_sqlite_schema(database, version)) {
+        fprintf(stderr, "[-] schema: %s, using v2\n", libflist_strerror());
+        return 2;
+    }
+
+    debug("[+] database: schema: %s\n", value);
+
+    return version;
+}
+
+flist_ctx_t *zf_internal_init(char *mountpoint, int access) {
     flist_ctx_t *ctx;
     flist_db_t *database = libflist_db_sqlite_init(mountpoint);
+    char *compression;
+    char *cipher;
 
     debug("[+] database: opening the flist database\n");
 
+    zf_internal_db_profile(database);
+
+    // read-only commands don't lock the workspace
+    if(access != ZF_DB_WRITE)
+        libflist_db_sqlite_readonly(database, access == ZF_DB_IMMUTABLE);
+
     ctx = libflist_context_create(database, NULL);
-    ctx->db->open(ctx->db);
+
+    if(!ctx->db->open(ctx->db)) {
+        zf_internal_cleanup(ctx);
+        return NULL;
+    }
+
+    // chunks hash is an flist setting
+    if(!libflist_metadata_hash_load(ctx->db, &ctx->compressor))
+        fprintf(stderr, "[-] hash: %s, using default\n", libflist_strerror());
+
+    // small chunks may be compressed against the flist dictionary
+    if(!libflist_metadata_dictionary_load(ctx->db, &ctx->compressor))
+        fprintf(stderr, "[-] dictionary: %s\n", libflist_strerror());
+
+    // chunks compression used for new files
+    if((compression = getenv("ZFLIST_COMPRESSION"))) {
+        if(libflist_compressor_parse(&ctx->compressor, compression))
+            fprintf(stderr, "[-] compression: %s, using default\n", libflist_strerror());
+
+        debug("[+] compression: %s (level %d)\n", libflist_compression_name(ctx->compressor.type), ctx->compressor.level);
+    }
+
+    // chunks encryption used for new files
+    if((cipher = getenv("ZFLIST_CIPHER"))) {
+        if(libflist_cipher_parse(&ctx->compressor, cipher))
+            fprintf(stderr, "[-] cipher: %s, using default\n", libflist_strerror());
+
+        debug("[+] cipher: %s\n", libflist_cipher_name(ctx->compressor.cipher));
+    }
 
     return ctx;
 }
@@ -244,6 +329,85 @@ int zf_backend_detect() {
     return 1;
 }
 
+// cache directory of one backend, chunks are keyed only by their id, a
+// cache shared between backends would serve chunks the backend doesn't
+// have, each backend (identified by its json settings) has its own
+// subdirectory: <ZFLIST_CACHE>/<hash of the backend json>
+static char *zf_backend_cache_dir(char *cacheroot, char *identity) {
+    uint8_t *hash;
+    char *hexhash, *cachedir;
+
+    if(mkdir(cacheroot, 0755) < 0 && errno != EEXIST) {
+        perror(cacheroot);
+        return NULL;
+    }
+
+    if(!(hash = libflist_chunk_hash(identity, strlen(identity))))
+        return NULL;
+
+    hexhash = libflist_hashhex(hash, ZEROCHUNK_HASH_LENGTH);
+    free(hash);
+
+    if(asprintf(&cachedir, "%s/%s", cacheroot, hexhash) < 0) {
+        perror("asprintf");
+        cachedir = NULL;
+    }
+
+    free(hexhash);
+
+    return cachedir;
+}
+
+// wrap the backend with a local cache
+// if a cache directory is configured
+static flist_db_t *zf_backend_cache(flist_db_t *backdb, char *identity) {
+    flist_db_t *cachedb = backdb, *packdb;
+    char *cacheroot, *cachedir, *cachesize, *cachepack;
+    size_t maxsize = ZFLIST_CACHE_DEFAULT_SIZE;
+
+    if(!(cacheroot = getenv("ZFLIST_CACHE")))
+        return backdb;
+
+    if(!(cachedir = zf_backend_cache_dir(cacheroot, identity))) {
+        fprintf(stderr, "[-] backend: cache: %s: could not use cache directory\n", cacheroot);
+        return backdb;
+    }
+
+    // cache directory used as pack files directory,
+    // pack files are never evicted, size is not limited
+    if((cachepack = getenv("ZFLIST_CACHE_PACK")) && strcmp(cachepack, "1") == 0) {
+        debug("[+] backend: using local pack cache: %s\n", cachedir);
+
+        if(!(packdb = libflist_db_pack_init(cachedir))) {
+            fprintf(stderr, "[-] backend: cache: %s\n", libflist_strerror());
+            free(cachedir);
+            return backdb;
+        }
+
+        if(!(cachedb = libflist_db_cache_local_init(backdb, packdb))) {
+            fprintf(stderr, "[-] backend: cache: %s\n", libflist_strerror());
+            packdb->close(packdb);
+            cachedb = backdb;
+        }
+
+        free(cachedir);
+        return cachedb;
+    }
+
+    if((cachesize = getenv("ZFLIST_CACHE_SIZE")))
+        maxsize = strtoul(cachesize, NULL, 10);
+
+    debug("[+] backend: using local cache: %s (%lu MB)\n", cachedir, maxsize);
+
+    if(!(cachedb = libflist_db_cache_init(backdb, cachedir, maxsize * 1024 * 1024))) {
+        fprintf(stderr, "[-] backend: cache: %s\n", libflist_strerror());
+        cachedb = backdb;
+    }
+
+    free(cachedir);
+    return cachedb;
+}
+
 flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx) {
     flist_db_t *backdb = NULL;
     char *envbackend;
@@ -258,26 +422,47 @@ flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx) {
         return NULL;
     }
 
+    backdb = zf_backend_cache(backdb, envbackend);
+
     // updating context
-    ctx->backend = libflist_backend_init(backdb, "/");
+    libflist_context_set_backend(ctx, libflist_backend_init(backdb, "/"));
 
     debug("[+] backend: connected and attached to context\n");
 
+    // snapshot of keys already on the backend, only
+    // useful for large uploads, listing keys has a cost
+    char *inventory = getenv("ZFLIST_BACKEND_INVENTORY");
+
+    if(ctx->backend && inventory && strcmp(inventory, "1") == 0) {
+        if(libflist_backend_inventory(ctx->backend))
+            fprintf(stderr, "[-] backend: inventory: %s\n", libflist_strerror());
+    }
+
     return ctx;
 }
 
-flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx) {
+// cached backend reads chunks from the local cache when available,
+// verification needs to reach the backend itself (cached set to 0)
+flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx, int cached) {
+    flist_backend_t *backend;
     flist_db_t *backdb = NULL;
+    char *identity;
 
     debug("[+] backend: detecting public backend settings\n");
 
     if(!(backdb = libflist_metadata_backend_database(ctx->db)))
         return NULL;
 
-    // updating context
-    if(!(ctx->backend = libflist_backend_init(backdb, "/")))
+    // metadata value is owned by the database
+    if(cached && (identity = libflist_metadata_get(ctx->db, "backend")))
+        backdb = zf_backend_cache(backdb, identity);
+
+    if(!(backend = libflist_backend_init(backdb, "/")))
         return NULL;
 
+    // updating context
+    libflist_context_set_backend(ctx, backend);
+
     debug("[+] backend: public connected and attached to context\n");
 
     return ctx;
@@ -287,20 +472,25 @@ flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx) {
 //
 // integrity checker
 //
-int zf_integrity_check(zf_callback_t *cb, inode_t *inode) {
-    for(size_t i = 0; i < inode->chunks->size; i++) {
-        inode_chunk_t *ichunk = &inode->chunks->list[i];
-        flist_chunk_t *chunk = libflist_chunk_new(ichunk->entryid, ichunk->decipher, NULL, 0);
+int zf_integrity_check(zf_callback_t *cb, inode_t *inode, int integrity) {
+    flist_backend_t *backend = cb->ctx->backend;
+    int missing;
 
-        if(!libflist_backend_exists(cb->ctx->backend, chunk)) {
-            libflist_chunk_free(chunk);
-            return 0;
-        }
+    // all the chunks of the file are checked with one batch
+    if(integrity == ZF_INTEGRITY_SERVER)
+        missing = libflist_backend_chunks_invalid(backend, inode->chunks);
+    else
+        missing = libflist_backend_chunks_missing(backend, inode->chunks);
 
-        libflist_chunk_free(chunk);
+    if(missing < 0) {
+        debug("[-] integrity: %s\n", libflist_strerror());
+        return 0;
     }
 
-    return 1;
+    if(missing)
+        debug("[-] integrity: %s: %d chunks missing or invalid\n", inode->name, missing);
+
+    return (missing == 0);
 }
 
 //
@@ -331,7 +521,7 @@ static int zf_find_recursive_text(zf_callback_t *cb, dirnode_t *dirnode, int int
             libflist_stats_regular_add(cb->ctx, 1);
             libflist_stats_size_add(cb->ctx, inode->size);
 
-            if(integrity && !zf_integrity_check(cb, inode))
+            if(integrity && !zf_integrity_check(cb, inode, integrity))
                 libflist_stats_failure_add(cb->ctx, 1);
         }
 
@@ -379,7 +569,7 @@ static int zf_find_recursive_json(zf_callback_t *cb, dirnode_t *dirnode, int int
             libflist_stats_regular_add(cb->ctx, 1);
             libflist_stats_size_add(cb->ctx, inode->size);
 
-            if(integrity && !zf_integrity_check(cb, inode))
+            if(integrity && !zf_integrity_check(cb, inode, integrity))
                 libflist_stats_failure_add(cb->ctx, 1);
         }
 
@@ -4,7 +4,9 @@
     // automatic cleanup
     void __cleanup_free(void *p);
 
-    flist_ctx_t *zf_internal_init(char *mountpoint);
+    void zf_internal_db_profile(flist_db_t *database);
+    int zf_internal_db_schema(flist_db_t *database);
+    flist_ctx_t *zf_internal_init(char *mountpoint, int access);
     void zf_internal_cleanup(flist_ctx_t *ctx);
 
     void zf_internal_json_init(zf_callback_t *cb);
@@ -12,7 +14,7 @@
 
     int zf_backend_detect();
     flist_ctx_t *zf_backend_extract(flist_ctx_t *ctx);
-    flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx);
+    flist_ctx_t *zf_public_backend_extract(flist_ctx_t *ctx, int cached);
 
     int zf_open_file(zf_callback_t *cb, char *filename, char *endpoint);
     int zf_remove_database(zf_callback_t *cb, char *mountpoint);
@@ -23,6 +25,11 @@
 
     char *zf_inode_typename(inode_type_t type, inode_special_t special);
 
+    // chunks verification while walking files (find, check)
+    #define ZF_INTEGRITY_NONE    0   // not verified
+    #define ZF_INTEGRITY_EXISTS  1   // chunks exist on the backend
+    #define ZF_INTEGRITY_SERVER  2   // chunks verified by the backend (zdb CHECK)
+
     int zf_find_recursive(zf_callback_t *cb, dirnode_t *dirnode, int integrity);
     int zf_find_finalize(zf_callback_t *cb);
 
@@ -16,27 +16,32 @@ zfe_settings_t settings;
 // commands list
 //
 zf_cmds_t zf_commands[] = {
-    {.name = "open",     .db = 0, .callback = zf_open,     .help = "open an flist to enable editing"},
-    {.name = "init",     .db = 0, .callback = zf_init,     .help = "initialize an empty flist to enable editing"},
-    {.name = "ls",       .db = 1, .callback = zf_ls,       .help = "list the content of a directory"},
-    {.name = "find",     .db = 1, .callback = zf_find,     .help = "list full contents of files and directories"},
-    {.name = "stat",     .db = 1, .callback = zf_stat,     .help = "dump inode full metadata"},
-    {.name = "cat",      .db = 1, .callback = zf_cat,      .help = "print file contents (backend metadata required)"},
-    {.name = "get",      .db = 1, .callback = zf_get,      .help = "download remote file (backend metadata required)"},
-    {.name = "put",      .db = 1, .callback = zf_put,      .help = "insert local file into the flist"},
-    {.name = "putdir",   .db = 1, .callback = zf_putdir,   .help = "insert local directory into the flist (recursively)"},
-    {.name = "chmod",    .db = 1, .callback = zf_chmod,    .help = "change mode of a file (like chmod command)"},
-    {.name = "rm",       .db = 1, .callback = zf_rm,       .help = "remove a file (not a directory)"},
-    {.name = "rmdir",    .db = 1, .callback = zf_rmdir,    .help = "remove a directory (recursively)"},
-    {.name = "mkdir",    .db = 1, .callback = zf_mkdir,    .help = "create an empty directory (non-recursive)"},
-    {.name = "metadata", .db = 1, .callback = zf_metadata, .help = "get or set metadata"},
-    {.name = "merge",    .db = 1, .callback = zf_merge,    .help = "merge another flist into the current one"},
-    {.name = "check",    .db = 1, .callback = zf_check,    .help = "check archive integrity (chunks valid in the backed)"},
-    {.name = "debug",    .db = 1, .callback = zf_debug,    .help = "provide and apply some debug features"},
-    {.name = "prefetch", .db = 0, .callback = zf_prefetch, .help = "read directory contents to fill flist cache"},
-    {.name = "hub",      .db = 0, .callback = zf_hub,      .help = "0-hub command line tools"},
-    {.name = "commit",   .db = 0, .callback = zf_commit,   .help = "commit changes to a new flist"},
-    {.name = "close",    .db = 0, .callback = zf_close,    .help = "close mountpoint and discard files"},
+    {.name = "open",     .db = ZF_DB_NONE,  .callback = zf_open,     .help = "open an flist to enable editing"},
+    {.name = "init",     .db = ZF_DB_NONE,  .callback = zf_init,     .help = "initialize an empty flist to enable editing"},
+    {.name = "ls",       .db = ZF_DB_READ,  .callback = zf_ls,       .help = "list the content of a directory"},
+    {.name = "find",     .db = ZF_DB_READ,  .callback = zf_find,     .help = "list full contents of files and directories"},
+    {.name = "stat",     .db = ZF_DB_READ,  .callback = zf_stat,     .help = "dump inode full metadata"},
+    {.name = "cat",      .db = ZF_DB_READ,  .callback = zf_cat,      .help = "print file contents (backend metadata required)"},
+    {.name = "get",      .db = ZF_DB_READ,  .callback = zf_get,      .help = "download remote file (backend metadata required)"},
+    {.name = "put",      .db = ZF_DB_WRITE, .callback = zf_put,      .help = "insert local file into the flist"},
+    {.name = "putdir",   .db = ZF_DB_WRITE, .callback = zf_putdir,   .help = "insert local directory into the flist (recursively)"},
+    {.name = "chmod",    .db = ZF_DB_WRITE, .callback = zf_chmod,    .help = "change mode of a file (like chmod command)"},
+    {.name = "rm",       .db = ZF_DB_WRITE, .callback = zf_rm,       .help = "remove a file (not a directory)"},
+    {.name = "rmdir",    .db = ZF_DB_WRITE, .callback = zf_rmdir,    .help = "remove a directory (recursively)"},
+    {.name = "mkdir",    .db = ZF_DB_WRITE, .callback = zf_mkdir,    .help = "create an empty directory (non-recursive)"},
+    {.name = "metadata", .db = ZF_DB_WRITE, .callback = zf_metadata, .help = "get or set metadata"},
+    {.name = "merge",    .db = ZF_DB_WRITE, .callback = zf_merge,    .help = "merge another flist into the current one"},
+    {.name = "export",   .db = ZF_DB_READ,  .callback = zf_export,   .help = "copy flist entries and metadata to a backend"},
+    {.name = "import",   .db = ZF_DB_WRITE, .callback = zf_import,   .help = "copy flist entries and metadata from a backend"},
+    {.name = "check",    .db = ZF_DB_READ,  .callback = zf_check,    .help = "check archive integrity (chunks valid in the backend)"},
+    {.name = "debug",    .db = ZF_DB_WRITE, .callback = zf_debug,    .help = "provide and apply some debug features"},
+    {.name = "prefetch", .db = ZF_DB_NONE,  .callback = zf_prefetch, .help = "read directory contents to fill flist cache"},
+    {.name = "hub",      .db = ZF_DB_NONE,  .callback = zf_hub,      .help = "0-hub command line tools"},
+    {.name = "bench",    .db = ZF_DB_NONE,  .callback = zf_bench,    .help = "measure backend performance (ZFLIST_BACKEND)"},
+    {.name = "gc",       .db = ZF_DB_NONE,  .callback = zf_gc,       .help = "list (or delete) backend keys not referenced by flists"},
+    {.name = "sync-chunks", .db = ZF_DB_READ,  .callback = zf_sync_chunks, .help = "copy chunks missing on another backend (mirroring)"},
+    {.name = "commit",   .db = ZF_DB_NONE,  .callback = zf_commit,   .help = "commit changes to a new flist"},
+    {.name = "close",    .db = ZF_DB_NONE,  .callback = zf_close,    .help = "close mountpoint and discard files"},
 };
 
 int usage(char *basename) {
@@ -62,6 +67,29 @@ int usage(char *basename) {
     fprintf(stderr, "  If you want to upload chunks when inserting files, please set\n");
     fprintf(stderr, "  environment variable ZFLIST_BACKEND to a json backend formatted string,\n");
     fprintf(stderr, "  check backend documentation for more information\n");
+    fprintf(stderr, "  For large uploads, ZFLIST_BACKEND_INVENTORY=1 lists backend keys once\n");
+    fprintf(stderr, "  to only check existence of chunks probably already there.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  Chunks can be cached locally by setting ZFLIST_CACHE to a directory (one\n");
+    fprintf(stderr, "  subdirectory per backend), the cache of each backend is limited to\n");
+    fprintf(stderr, "  ZFLIST_CACHE_SIZE megabytes (default: %d).\n", ZFLIST_CACHE_DEFAULT_SIZE);
+    fprintf(stderr, "  With ZFLIST_CACHE_PACK=1, the cache directory holds pack files (faster,\n");
+    fprintf(stderr, "  without size limit), usable by one zflist at a time.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  The workspace database can be tuned with ZFLIST_SQLITE_PROFILE (ingest\n");
+    fprintf(stderr, "  for faster -putdir- of large trees, read for large lookups).\n");
+    fprintf(stderr, "  It's compacted on -commit-, ZFLIST_COMPACT=incremental only releases\n");
+    fprintf(stderr, "  free pages (faster), ZFLIST_COMPACT=none skips it.\n");
+    fprintf(stderr, "  New flists (and old ones on -commit-) use the v2 database schema,\n");
+    fprintf(stderr, "  ZFLIST_SCHEMA=v1 keeps the old schema, readable by older tools.\n");
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  New chunks are compressed with snappy, you can choose another compression\n");
+    fprintf(stderr, "  with ZFLIST_COMPRESSION (snappy, store, lz4, zstd, zstd:level or zstd-dict\n");
+    fprintf(stderr, "  to compress small files with a dictionary trained by -putdir-).\n");
+    fprintf(stderr, "  New chunks are encrypted with xxtea, you can choose an authenticated cipher\n");
+    fprintf(stderr, "  with ZFLIST_CIPHER (aes-256-gcm, chacha20-poly1305 or aead for the fastest one).\n");
+    fprintf(stderr, "  Chunks are hashed with blake2b, ZFLIST_HASH=blake3 during -init- creates\n");
+    fprintf(stderr, "  an flist using blake3 (recorded in the flist metadata).\n");
     fprintf(stderr, "\n");
     fprintf(stderr, "  To use the hub subsystem, you need to specify at least a jwt token\n");
     fprintf(stderr, "  via the environment variable ZFLIST_HUB_TOKEN, this jwt needs to be\n");
@@ -99,20 +127,24 @@ int zf_callback(zf_cmds_t *cmd, int argc, char *argv[], zfe_settings_t *settings
     if(progress && strcmp(progress, "1") == 0)
         cb.progress = 1;
 
+    int value = 1;
+
     // open database (if used)
-    if(cmd->db)
-        cb.ctx = zf_internal_init(settings->mnt);
+    if(cmd->db && !(cb.ctx = zf_internal_init(settings->mnt, cmd->db))) {
+        zf_error(&cb, cmd->name, "database: %s", libflist_strerror());
 
-    // call the callback
-    debug("[+] system: callback found for command: %s\n", cmd->name);
-    int value = cmd->callback(&cb);
+    } else {
+        // call the callback
+        debug("[+] system: callback found for command: %s\n", cmd->name);
+        value = cmd->callback(&cb);
+    }
 
     // dump json response if set
     if(cb.jout)
         zf_internal_json_finalize(&cb);
 
     // commit database (if used)
-    if(cmd->db)
+    if(cb.ctx)
         zf_internal_cleanup(cb.ctx);
 
     return value;
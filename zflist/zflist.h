@@ -5,6 +5,9 @@
 
     #define ZFLIST_HUB_BASEURL   "https://hub.grid.tf"
 
+    // default local backend cache size (in MB)
+    #define ZFLIST_CACHE_DEFAULT_SIZE  1024
+
     #ifdef FLIST_DEBUG
         #define debug(...) { printf(__VA_ARGS__); }
     #else
@@ -36,11 +39,17 @@
 
     } zf_callback_t;
 
+    // database access needed by a command
+    #define ZF_DB_NONE       0  // database not used
+    #define ZF_DB_WRITE      1  // workspace opened for changes
+    #define ZF_DB_READ       2  // read-only, concurrent with other commands
+    #define ZF_DB_IMMUTABLE  3  // read-only, never changed (extracted flist)
+
     typedef struct zf_cmds_t {
         char *name;  // command name
         int (*callback)(zf_callback_t *cb);
         char *help;  // help message
-        int db;      // does the callback need the db
+        int db;      // database access needed by the callback (ZF_DB_*)
 
     } zf_cmds_t;
 